@@ -10,6 +10,21 @@
 
 #include "BTreeIndex.h"
 #include "BTreeNode.h"
+#include <algorithm>
+
+double BTreeIndex::fillFactor = 1.0;
+
+/*
+ * set the fraction of each node that build() fills.
+ * @param fill[IN] the fraction, in (0, 1]
+ * @return error code. RC_INVALID_ATTRIBUTE if out of range
+ */
+RC BTreeIndex::setFillFactor(double fill)
+{
+    if (!(fill > 0 && fill <= 1)) return RC_INVALID_ATTRIBUTE;
+    fillFactor = fill;
+    return 0;
+}
 
 /*
  * BTreeIndex constructor
@@ -19,6 +34,7 @@ BTreeIndex::BTreeIndex()
     /* Initially, use a leafNode as both a leaf and root
      * PageId of the root node is set to 1, initial root content is stored in PageId 1
      * PageId 0 is reserved to store the treeHeight, rootPid, PageIdCount
+     * and the head of the list of free pages
      * other derived node later would be stored in the following pages
      */
     rootPid = 1;
@@ -28,6 +44,8 @@ BTreeIndex::BTreeIndex()
     /* there is a empty root node from the begining */
     treeHeight = 1;
     PageIdCount = 1;
+    freePid = 0;
+    format = BT_FORMAT_SOA;
 }
 
 /*
@@ -46,12 +64,35 @@ RC BTreeIndex::open(const string& indexname, char mode)
      * and store the information about that opened file.
      * So it is just an integer number that uniquely represents an opened file in operating system.
      */
-    pf.open(indexname, mode);
+    RC rc = pf.open(indexname, mode);
+    if (rc < 0) {
+        return rc;
+    }
+    
+    /* a new index lays its nodes out in BT_FORMAT_SOA. an index written
+     * before the layout was kept in the file header reads as
+     * BT_FORMAT_INTERLEAVED, and keeps that layout when it grows
+     */
+    if (mode == 'w' && pf.endPid() == 0 && (rc = pf.setFormat(BT_FORMAT_SOA)) < 0) {
+        pf.close();
+        return rc;
+    }
+    format = pf.getFormat();
     
     if (mode == 'r') {
-        /* read the first page of the index file, and set rootPid and treeHeight */
+        /* index lookups jump around the file */
+        pf.advise(PageFile::ACCESS_RANDOM);
+    }
+    
+    /* an existing index, read or updated: read the first page of the index
+     * file, and set rootPid, treeHeight, PageIdCount and freePid
+     */
+    if (pf.endPid() > 0) {
         char buffer[PageFile::PAGE_SIZE];
-        pf.read(0, buffer);
+        if ((rc = pf.read(0, buffer)) < 0) {
+            pf.close();
+            return rc;
+        }
         
         char* iter = &(buffer[0]);
         memcpy(&rootPid, iter, sizeof(PageId));
@@ -59,6 +100,11 @@ RC BTreeIndex::open(const string& indexname, char mode)
         memcpy(&treeHeight, iter, sizeof(int));
         iter += sizeof(int);
         memcpy(&PageIdCount, iter, sizeof(int));
+        iter += sizeof(int);
+        memcpy(&freePid, iter, sizeof(PageId));
+        
+        /* older files did not store PageIdCount; the pages are given out in order */
+        PageIdCount = max(PageIdCount, pf.endPid() - 1);
     }
     
     return 0;
@@ -82,7 +128,9 @@ RC BTreeIndex::close()
         iter += sizeof(PageId);
         memcpy(iter, &treeHeight, sizeof(PageId));
         iter += sizeof(int);
-        memcpy(&PageIdCount, iter, sizeof(int));
+        memcpy(iter, &PageIdCount, sizeof(int));
+        iter += sizeof(int);
+        memcpy(iter, &freePid, sizeof(PageId));
         
         pf.write(0, buffer);
     }
@@ -119,15 +167,15 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
          */
         else {
             /* insert the new pair into the new sibling leaf node */
-            BTLeafNode sibling;
+            BTLeafNode sibling(format);
             int siblingKey = 0;
             root.insertAndSplit(key, rid, sibling, siblingKey);
-            int siblingPid = ++PageIdCount;
+            int siblingPid = allocatePage();
             /* link two leaf node */
             root.setNextNodePtr(siblingPid);
             /* create a new root */
-            BTNonLeafNode newRoot;
-            int newRootPid = ++PageIdCount;
+            BTNonLeafNode newRoot(format);
+            int newRootPid = allocatePage();
             newRoot.initializeRoot(rootPid, siblingKey, siblingPid);
             /* write all modified node back to disk */
             root.write(rootPid, pf);
@@ -143,7 +191,10 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     else {
         /* find the position to insert the new pair */
         IndexCursor cursor;
-        locate(key, cursor);
+        RC rc = locate(key, cursor);
+        if (rc != 0 && rc != RC_NO_SUCH_RECORD) {
+            return rc;
+        }
         /* insert the new pair into the leaf level */
         BTLeafNode currLeafNode;
         currLeafNode.read(cursor.pid, pf);
@@ -153,18 +204,18 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
         }
         /* if the leaf is full, insert and split, update parents */
         else {
-            BTLeafNode siblingLeaf;
-            BTNonLeafNode siblingNonLeaf;
+            BTLeafNode siblingLeaf(format);
             int siblingKey = -1, siblingPid = -1;
             /* get locate traverse path */
             vector<PageId> parent = cursor.parent;
-            for (int i = parent.size(); i >= 0; i--) {
+            int levels = parent.size();
+            for (int i = levels; i >= 0; i--) {
                 // Initial leaf level
-                if (i == parent.size()) {
+                if (i == levels) {
                     //                    cout << "spliting leaf with key: " << key << endl;
                     currLeafNode.insertAndSplit(key, rid, siblingLeaf, siblingKey);
                     /* allocate next avaiable Pid to the new sibling leaf node */
-                    siblingPid = ++PageIdCount;
+                    siblingPid = allocatePage();
                     //                    cout << " siblingKey is " << siblingKey << " siblingPid is " << siblingPid << endl;
                     //                    cout << endl;
                     /* link with the new sibling leaf node */
@@ -176,22 +227,26 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
                 }
                 // Non-leaf level (include root level)
                 else {
+                    /* the new node goes right behind the child that split off it */
+                    PageId childPid = (i + 1 == levels) ? cursor.pid : parent[i + 1];
                     BTNonLeafNode currNode;
                     currNode.read(parent[i], pf);
-                    if (currNode.insert(siblingKey, siblingPid) == 0) {
+                    if (currNode.insert(childPid, siblingKey, siblingPid) == 0) {
                         currNode.write(parent[i], pf);
                         break;
                     }
                     else {
                         //                        cout << "spliting non leaf" << endl;
-                        currNode.insertAndSplit(siblingKey, siblingPid, siblingNonLeaf, siblingKey);
-                        siblingPid = ++PageIdCount;
+                        /* every level splits into a new, empty sibling */
+                        BTNonLeafNode siblingNonLeaf(format);
+                        currNode.insertAndSplit(childPid, siblingKey, siblingPid, siblingNonLeaf, siblingKey);
+                        siblingPid = allocatePage();
                         currNode.write(parent[i], pf);
                         siblingNonLeaf.write(siblingPid, pf);
                         
                         if (i == 0) {
-                            BTNonLeafNode newRoot;
-                            int newRootPid = ++PageIdCount;
+                            BTNonLeafNode newRoot(format);
+                            int newRootPid = allocatePage();
                             newRoot.initializeRoot(rootPid, siblingKey, siblingPid);
                             newRoot.write(newRootPid, pf);
                             /* update rootPid and treeHeight */
@@ -207,6 +262,323 @@ RC BTreeIndex::insert(int key, const RecordId& rid)
     return 0;
 }
 
+/*
+ * Insert many (key, RecordId) pairs to the index at once. An empty index
+ * is built bottom up, writing every page once.
+ * @param entries[IN/OUT] the pairs, in any order. they are sorted
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::build(vector<IndexEntry>& entries)
+{
+    RC rc;
+    
+    /* an index with entries already takes the new ones one at a time. so
+     * does an index with free pages, as the leaves need a run of pages
+     */
+    bool empty = (treeHeight == 1 && freePid == 0);
+    if (empty) {
+        BTLeafNode root;
+        root.read(rootPid, pf);
+        empty = (root.getKeyCount() == 0);
+    }
+    if (!empty) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if ((rc = insert(entries[i].key, entries[i].rid)) < 0) return rc;
+        }
+        return 0;
+    }
+    
+    /* sort the pairs by key. like insert(), the pairs of a key stay in the
+     * order they came in
+     */
+    stable_sort(entries.begin(), entries.end(),
+                [](const IndexEntry& a, const IndexEntry& b) { return a.key < b.key; });
+    if (entries.empty()) return 0;
+    
+    /* the leaves take the pages from the root on, left to right, so each
+     * one knows the page of the next. the pairs are spread evenly over as
+     * few leaves as the fill factor allows
+     */
+    long n = entries.size();
+    long perLeaf = max(1, (int)(BTLeafNode::MAX_KEYS * fillFactor));
+    long nleaves = (n + perLeaf - 1) / perLeaf;
+    vector<int>    keys;  /// the smallest key under each node of the level built last
+    vector<PageId> pids;  /// and its page
+    for (long i = 0; i < nleaves; i++) {
+        BTLeafNode leaf(format);
+        long from = i * n / nleaves;
+        long to = (i + 1) * n / nleaves;
+        for (long j = from; j < to; j++) {
+            leaf.append(entries[j].key, entries[j].rid);
+        }
+        PageId pid = rootPid + i;
+        leaf.setNextNodePtr((i + 1 < nleaves) ? pid + 1 : 0);
+        if ((rc = leaf.write(pid, pf)) < 0) return rc;
+        keys.push_back(entries[from].key);
+        pids.push_back(pid);
+    }
+    PageIdCount = max(PageIdCount, rootPid + (int)nleaves - 1);
+    treeHeight = 1;
+    
+    /* build the non-leaf levels one above the other until one node is left.
+     * each node takes at least 3 children, so that no node is left with
+     * a single child when the children are spread evenly
+     */
+    long perNode = max(3, (int)((BTNonLeafNode::MAX_KEYS + 1) * fillFactor));
+    while (pids.size() > 1) {
+        long c = pids.size();
+        long nnodes = (c + perNode - 1) / perNode;
+        vector<int>    upKeys;
+        vector<PageId> upPids;
+        for (long i = 0; i < nnodes; i++) {
+            BTNonLeafNode node(format);
+            long from = i * c / nnodes;
+            long to = (i + 1) * c / nnodes;
+            node.initializeRoot(pids[from], keys[from + 1], pids[from + 1]);
+            for (long j = from + 2; j < to; j++) {
+                node.append(keys[j], pids[j]);
+            }
+            PageId pid = allocatePage();
+            if ((rc = node.write(pid, pf)) < 0) return rc;
+            upKeys.push_back(keys[from]);
+            upPids.push_back(pid);
+        }
+        keys.swap(upKeys);
+        pids.swap(upPids);
+        treeHeight++;
+    }
+    rootPid = pids[0];
+    
+    return 0;
+}
+
+/*
+ * Remove the (key, RecordId) pair from the index.
+ * @param key[IN] the key of the pair
+ * @param rid[IN] the RecordId of the pair
+ * @return error code. RC_NO_SUCH_RECORD if the pair is not in the index
+ * --------------------------------------------------------------------
+ * Algorithm:
+ 1. find the leaf of the pair and remove the pair from it
+ 2. while the node is less than half full and is not the root, look at a
+    sibling under the same parent. if both fit in one node, merge them
+    and remove the separator from the parent, whose turn it is next.
+    otherwise even them out, update the separator and stop
+ 3. a non-leaf root left with a single child gives its place to the child
+ */
+RC BTreeIndex::erase(int key, const RecordId& rid)
+{
+    RC rc;
+    
+    /* 1. find the pair among the pairs with the key, which may run on
+     * into the next leaves
+     */
+    IndexCursor cursor;
+    if ((rc = locate(key, cursor)) < 0 && rc != RC_NO_SUCH_RECORD) {
+        return rc;
+    }
+    BTLeafNode leaf;
+    PageId leafPid = cursor.pid;
+    if ((rc = leaf.read(leafPid, pf)) < 0) {
+        return rc;
+    }
+    for (;;) {
+        if (cursor.eid == leaf.getKeyCount()) {
+            if ((leafPid = leaf.getNextNodePtr()) == 0) {
+                return RC_NO_SUCH_RECORD;
+            }
+            cursor.eid = 0;
+            if ((rc = leaf.read(leafPid, pf)) < 0) {
+                return rc;
+            }
+            continue;
+        }
+        int currKey;
+        RecordId currRid;
+        leaf.readEntry(cursor.eid, currKey, currRid);
+        if (currKey != key) {
+            return RC_NO_SUCH_RECORD;
+        }
+        if (currRid.pid == rid.pid && currRid.sid == rid.sid) {
+            break;
+        }
+        cursor.eid++;
+    }
+    
+    /* the parents of a later leaf are found again from the root */
+    if (leafPid != cursor.pid) {
+        cursor.pid = leafPid;
+        cursor.parent.clear();
+        if (!findPath(rootPid, 1, key, leafPid, cursor.parent)) {
+            return RC_INVALID_PID;
+        }
+    }
+    leaf.remove(cursor.eid);
+    
+    vector<PageId>& parent = cursor.parent;
+    if (parent.empty() || leaf.getKeyCount() >= BTLeafNode::MAX_KEYS / 2) {
+        return leaf.write(cursor.pid, pf);
+    }
+    
+    /* 2. the leaf level: merge with or borrow from the next leaf under the
+     * same parent, or the previous one for the last child
+     */
+    BTNonLeafNode node;
+    PageId nodePid = parent.back();
+    parent.pop_back();
+    if ((rc = node.read(nodePid, pf)) < 0) {
+        return rc;
+    }
+    int child = node.findChild(cursor.pid);
+    int sep = (child < node.getKeyCount()) ? child : child - 1;
+    PageId leftPid = node.getChildPtr(sep);
+    PageId rightPid = node.getChildPtr(sep + 1);
+    
+    BTLeafNode sibling;
+    if ((rc = sibling.read((leftPid == cursor.pid) ? rightPid : leftPid, pf)) < 0) {
+        return rc;
+    }
+    BTLeafNode& left = (leftPid == cursor.pid) ? leaf : sibling;
+    BTLeafNode& right = (leftPid == cursor.pid) ? sibling : leaf;
+    if (left.getKeyCount() + right.getKeyCount() <= BTLeafNode::MAX_KEYS) {
+        left.merge(right);
+        if ((rc = left.write(leftPid, pf)) < 0 || (rc = freePage(rightPid)) < 0) {
+            return rc;
+        }
+        node.remove(sep);
+    } else {
+        int separator;
+        left.redistribute(right, separator);
+        node.setKey(sep, separator);
+        if ((rc = left.write(leftPid, pf)) < 0 || (rc = right.write(rightPid, pf)) < 0) {
+            return rc;
+        }
+        return node.write(nodePid, pf);
+    }
+    
+    /* the non-leaf levels, up to the root */
+    while (!parent.empty() && node.getKeyCount() < BTNonLeafNode::MAX_KEYS / 2) {
+        BTNonLeafNode upper;
+        PageId upperPid = parent.back();
+        parent.pop_back();
+        if ((rc = upper.read(upperPid, pf)) < 0) {
+            return rc;
+        }
+        child = upper.findChild(nodePid);
+        sep = (child < upper.getKeyCount()) ? child : child - 1;
+        leftPid = upper.getChildPtr(sep);
+        rightPid = upper.getChildPtr(sep + 1);
+        
+        BTNonLeafNode siblingNode;
+        if ((rc = siblingNode.read((leftPid == nodePid) ? rightPid : leftPid, pf)) < 0) {
+            return rc;
+        }
+        BTNonLeafNode& leftNode = (leftPid == nodePid) ? node : siblingNode;
+        BTNonLeafNode& rightNode = (leftPid == nodePid) ? siblingNode : node;
+        int separator = upper.getKey(sep);
+        if (leftNode.getKeyCount() + rightNode.getKeyCount() + 1 <= BTNonLeafNode::MAX_KEYS) {
+            leftNode.merge(separator, rightNode);
+            if ((rc = leftNode.write(leftPid, pf)) < 0 || (rc = freePage(rightPid)) < 0) {
+                return rc;
+            }
+            upper.remove(sep);
+        } else {
+            leftNode.redistribute(rightNode, separator);
+            upper.setKey(sep, separator);
+            if ((rc = leftNode.write(leftPid, pf)) < 0 || (rc = rightNode.write(rightPid, pf)) < 0) {
+                return rc;
+            }
+            return upper.write(upperPid, pf);
+        }
+        
+        /* the parent lost a key, so it is the next to look at */
+        if ((rc = upper.write(upperPid, pf)) < 0 || (rc = node.read(upperPid, pf)) < 0) {
+            return rc;
+        }
+        nodePid = upperPid;
+    }
+    
+    /* 3. a root without keys has a single child left, which becomes the root */
+    if (parent.empty() && node.getKeyCount() == 0) {
+        rootPid = node.getChildPtr(0);
+        treeHeight--;
+        return freePage(nodePid);
+    }
+    return node.write(nodePid, pf);
+}
+
+/*
+ * Find the non-leaf nodes from a node down to a leaf. Only the children
+ * that may hold key are looked into.
+ * @param pid[IN] the node to start from
+ * @param level[IN] the level of the node. the root is at level 1
+ * @param key[IN] a key in the leaf
+ * @param leafPid[IN] the PageId of the leaf
+ * @param path[OUT] the PageIds of the nodes from pid down, without the leaf
+ * @return true if the leaf was found
+ */
+bool BTreeIndex::findPath(PageId pid, int level, int key, PageId leafPid, vector<PageId>& path)
+{
+    if (level == treeHeight) {
+        return pid == leafPid;
+    }
+    
+    BTNonLeafNode node;
+    if (node.read(pid, pf) != 0) {
+        return false;
+    }
+    path.push_back(pid);
+    int count = node.getKeyCount();
+    for (int i = 0; i <= count; i++) {
+        /* the keys of the i'th child are between the keys around it */
+        if (i > 0 && node.getKey(i - 1) > key) break;
+        if (i < count && node.getKey(i) < key) continue;
+        if (findPath(node.getChildPtr(i), level + 1, key, leafPid, path)) {
+            return true;
+        }
+    }
+    path.pop_back();
+    return false;
+}
+
+/*
+ * Give out a page for a new node, from the free list if it is not empty.
+ * @return the PageId of the page
+ */
+PageId BTreeIndex::allocatePage()
+{
+    /* a free page holds the PageId of the next free page */
+    if (freePid > 0) {
+        char buffer[PageFile::PAGE_SIZE];
+        PageId pid = freePid;
+        if (pf.read(pid, buffer) == 0) {
+            memcpy(&freePid, buffer, sizeof(PageId));
+            return pid;
+        }
+        /* the pages left in a list that cannot be read are not used again */
+        freePid = 0;
+    }
+    return ++PageIdCount;
+}
+
+/*
+ * Put a page no node uses any more on the free list.
+ * @param pid[IN] the PageId of the page
+ * @return error code. 0 if no error
+ */
+RC BTreeIndex::freePage(PageId pid)
+{
+    RC rc;
+    char buffer[PageFile::PAGE_SIZE];
+    memset(buffer, 0, PageFile::PAGE_SIZE);
+    memcpy(buffer, &freePid, sizeof(PageId));
+    if ((rc = pf.write(pid, buffer)) < 0) {
+        return rc;
+    }
+    freePid = pid;
+    return 0;
+}
+
 /**
  * Run the standard B+Tree key search algorithm and identify the
  * leaf node where searchKey may exist. If an index entry with
@@ -234,6 +606,7 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
         cursor.parent.push_back(currentPid);
         if(node.read(currentPid, pf) != 0)
             return RC_FILE_READ_FAILED;
+        IoStats::countLevel(pf.getStats(), level);
         
         node.locateChildPtr(searchKey, currentPid);
     }
@@ -241,10 +614,24 @@ RC BTreeIndex::locate(int searchKey, IndexCursor& cursor)
     BTLeafNode node; // there is only one leaf node
     if(node.read(currentPid, pf) != 0)
         return RC_FILE_READ_FAILED;
+    IoStats::countLevel(pf.getStats(), treeHeight);
     RC rc = node.locate(searchKey, eid);
     cursor.pid = currentPid;
     cursor.eid = eid;
     
+    /* the keys equal to searchKey may start in the next leaf.
+     * the cursor stays behind the last entry, where readForward() moves on from
+     */
+    if (rc == RC_NO_SUCH_RECORD && eid == node.getKeyCount() && node.getNextNodePtr() != 0) {
+        int key;
+        RecordId rid;
+        if (node.read(node.getNextNodePtr(), pf) == 0 && node.getKeyCount() > 0) {
+            IoStats::countLevel(pf.getStats(), treeHeight);
+            node.readEntry(0, key, rid);
+            if (key == searchKey) rc = 0;
+        }
+    }
+    
     return rc;
 }
 
@@ -263,6 +650,7 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
     RC rc = node.read(cursor.pid, pf);
     if(rc != 0)
         return rc;
+    IoStats::countLevel(pf.getStats(), treeHeight);
     if (cursor.eid == node.getKeyCount()) {
         if (node.getNextNodePtr() == 0) {
             key = -1;
@@ -274,6 +662,7 @@ RC BTreeIndex::readForward(IndexCursor& cursor, int& key, RecordId& rid)
         RC rc = node.read(cursor.pid, pf);
         if(rc != 0)
             return rc;
+        IoStats::countLevel(pf.getStats(), treeHeight);
     }
     rc = node.readEntry(cursor.eid, key, rid);
     if(rc != 0)
@@ -33,6 +33,14 @@ typedef struct {
     vector<PageId> parent;
 } IndexCursor;
 
+/**
+ * A (key, RecordId) pair to build an index from.
+ */
+typedef struct {
+    int      key;
+    RecordId rid;
+} IndexEntry;
+
 /**
  * Implements a B-Tree index for bruinbase.
  *
@@ -59,12 +67,47 @@ public:
     
     /**
      * Insert (key, RecordId) pair to the index.
+     * A key may be inserted many times, with different RecordIds.
      * @param key[IN] the key for the value inserted into the index
      * @param rid[IN] the RecordId for the record being inserted into the index
      * @return error code. 0 if no error
      */
     RC insert(int key, const RecordId& rid);
     
+    /**
+     * Remove (key, RecordId) pair from the index. A node left less than
+     * half full takes entries from a sibling, or is merged with it, and
+     * the pages of merged nodes go on a free list for later nodes.
+     * @param key[IN] the key of the pair
+     * @param rid[IN] the RecordId of the pair
+     * @return error code. RC_NO_SUCH_RECORD if the pair is not in the index
+     */
+    RC erase(int key, const RecordId& rid);
+    
+    /**
+     * Insert many (key, RecordId) pairs to the index at once.
+     * An empty index is built bottom up: the pairs are sorted, the leaves
+     * are filled left to right, then each level of non-leaf nodes above
+     * them, and every page is written once. An index that already has
+     * entries takes the pairs one insert() at a time.
+     * @param entries[IN/OUT] the pairs, in any order. they are sorted
+     * @return error code. 0 if no error
+     */
+    RC build(vector<IndexEntry>& entries);
+    
+    /**
+     * set the fraction of each node that build() fills. the room left
+     * takes later inserts without splitting the node.
+     * @param fill[IN] the fraction, in (0, 1]. 1 by default
+     * @return error code. RC_INVALID_ATTRIBUTE if out of range
+     */
+    static RC setFillFactor(double fill);
+    
+    /**
+     * @return the fraction of each node that build() fills
+     */
+    static double getFillFactor() { return fillFactor; }
+    
     /**
      * Run the standard B+Tree key search algorithm and identify the
      * leaf node where searchKey may exist. If an index entry with
@@ -77,6 +120,9 @@ public:
      * code RC_NO_SUCH_RECORD.
      * Using the returned "IndexCursor", you will have to call readForward()
      * to retrieve the actual (key, rid) pair from the index.
+     * The cursor is at the first of the entries with searchKey, which may
+     * run on into the next leaves. If they start in the next leaf, the
+     * cursor is behind the last entry of the leaf, and 0 is returned.
      * @param key[IN] the key to find
      * @param cursor[OUT] the cursor pointing to the index entry with
      *                    searchKey or immediately behind the largest key
@@ -110,10 +156,6 @@ public:
         return PageIdCount;
     }
     
-    PageFile getPageFile() {
-        return pf;
-    }
-    
     
 private:
     PageFile pf;         /// the PageFile used to store the actual b+tree in disk
@@ -125,8 +167,37 @@ private:
     /// variables in disk, so that they can be reconstructed when the index
     /// is opened again later.
     int PageIdCount;
+    PageId   freePid;    /// the first page of the list of free pages. 0 if none
     
     char mode;
+    int  format;         /// the layout of the nodes. one of BTNodeFormat
+    
+    static double fillFactor;  /// the fraction of each node build() fills
+    
+    /**
+     * Give out a page for a new node, from the free list if it is not empty.
+     * @return the PageId of the page
+     */
+    PageId allocatePage();
+    
+    /**
+     * Put a page no node uses any more on the free list.
+     * @param pid[IN] the PageId of the page
+     * @return error code. 0 if no error
+     */
+    RC freePage(PageId pid);
+    
+    /**
+     * Find the non-leaf nodes from a node down to a leaf. Only the children
+     * that may hold key are looked into.
+     * @param pid[IN] the node to start from
+     * @param level[IN] the level of the node. the root is at level 1
+     * @param key[IN] a key in the leaf
+     * @param leafPid[IN] the PageId of the leaf
+     * @param path[OUT] the PageIds of the nodes from pid down, without the leaf
+     * @return true if the leaf was found
+     */
+    bool findPath(PageId pid, int level, int key, PageId leafPid, vector<PageId>& path);
 };
 
 #endif /* BTREEINDEX_H */
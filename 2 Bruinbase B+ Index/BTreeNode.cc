@@ -4,15 +4,111 @@
  leaf node structure:
  |# keys(4 byte)|, |PageId(4 byte)|, |key(4 byte) RecordId(pid, sid)|, |key(4 byte) RecordId(pid, sid)|....
  For each node, its content is stored in page file,
+
+ In BT_FORMAT_SOA the keys of a node are stored one after another and the
+ pointers in an array of their own, so a search reads only the keys:
+ non-leaf node structure:
+ |# keys(4 byte)|, |key|key|...(MAX_KEYS keys)|, |PageId|PageId|...(MAX_KEYS + 1 PageIds)|
+ leaf node structure:
+ |# keys(4 byte)|, |PageId(4 byte)|, |key|key|...(MAX_KEYS keys)|, |RecordId|RecordId|...(MAX_KEYS RecordIds)|
  */
 #include "BTreeNode.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// # keys the binary search narrows the range down to before the keys
+// left are compared all at once
+static const int SEARCH_BLOCK = 8;
+
+/*
+ * Count the keys of a block that are smaller than searchKey, or not
+ * larger than it if upper is set. With SSE2 four keys are compared at once.
+ * @param block[IN] the keys
+ * @param len[IN] # keys
+ * @param searchKey[IN] the key to compare with
+ * @param upper[IN] true to count the keys equal to searchKey too
+ * @return # keys counted
+ */
+static int countBelow(const int* block, int len, int searchKey, bool upper)
+{
+    int count = 0;
+    int i = 0;
+    
+#ifdef __SSE2__
+    __m128i x = _mm_set1_epi32(searchKey);
+    for (; i + 4 <= len; i += 4) {
+        __m128i k = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i m = upper ? _mm_andnot_si128(_mm_cmpgt_epi32(k, x), _mm_set1_epi32(-1))
+                          : _mm_cmplt_epi32(k, x);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+    }
+#endif
+    
+    for (; i < len; i++) count += upper ? (block[i] <= searchKey) : (block[i] < searchKey);
+    return count;
+}
+
+/*
+ * Find the position of searchKey among the sorted keys of a node, i.e.
+ * count the keys smaller than searchKey, or not larger than it if upper
+ * is set. The keys are stride bytes apart.
+ * @param keys[IN] the first key
+ * @param stride[IN] # bytes from one key to the next
+ * @param n[IN] # keys
+ * @param searchKey[IN] the key to look for
+ * @param upper[IN] true to count the keys equal to searchKey too
+ * @return # keys counted
+ */
+static int searchKeys(const char* keys, int stride, int n, int searchKey, bool upper)
+{
+    const char* base = keys;
+    int len = n;
+    
+    // halve the range without branching on the keys until it fits in a
+    // block. every key before base is counted
+    while (len > SEARCH_BLOCK) {
+        int half = len / 2;
+        int key;
+        memcpy(&key, base + half * stride, sizeof(int));
+        int below = upper ? (key <= searchKey) : (key < searchKey);
+        base += below * half * stride;
+        len -= half;
+    }
+    
+    // line the keys of the block up and count them at once
+    int block[SEARCH_BLOCK];
+    for (int i = 0; i < len; i++) memcpy(&block[i], base + i * stride, sizeof(int));
+    return (base - keys) / stride + countBelow(block, len, searchKey, upper);
+}
 
 /* constructor, set all values in buffer to 0 */
-BTLeafNode::BTLeafNode()
+BTLeafNode::BTLeafNode(int format)
 {
+    this->format = format;
+    buffer = page;
+    pinnedFile = NULL;
     memset(buffer, 0, PageFile::PAGE_SIZE);
 }
 
+/* destructor, give the pinned frame back to the buffer pool */
+BTLeafNode::~BTLeafNode()
+{
+    unpin();
+}
+
+/*
+ * Unpin the frame the node is working on and switch back to the private page.
+ */
+void BTLeafNode::unpin()
+{
+    if (pinnedFile != NULL) {
+        pinnedFile->unpin(pinnedPid);
+        pinnedFile = NULL;
+        buffer = page;
+    }
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -27,6 +123,15 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
         rc = RC_INVALID_PID;
         return rc;
     }
+    unpin();
+    format = pf.getFormat();
+    // work on the buffer pool frame in place if one is available
+    if (pf.pin(pid, buffer) == 0) {
+        pinnedFile = &pf;
+        pinnedPid = pid;
+        return 0;
+    }
+    buffer = page;
     memset(buffer, 0, PageFile::PAGE_SIZE);
     if ((rc = pf.read(pid, buffer)) < 0) {
         return RC_FILE_READ_FAILED ;
@@ -35,6 +140,61 @@ RC BTLeafNode::read(PageId pid, const PageFile& pf)
     
 }
 
+/*
+ * The key of the i'th entry. The keys follow the key count and the next pointer.
+ */
+char* BTLeafNode::keyPtr(int i)
+{
+    return buffer + sizeof(int) + sizeof(PageId) + i * keyStride();
+}
+
+/*
+ * The RecordId of the i'th entry, next to its key or in the array after the keys.
+ */
+char* BTLeafNode::ridPtr(int i)
+{
+    if (format == BT_FORMAT_SOA)
+        return buffer + sizeof(int) + sizeof(PageId) + MAX_KEYS * sizeof(int) + i * sizeof(RecordId);
+    return keyPtr(i) + sizeof(int);
+}
+
+/*
+ * The # bytes from one key to the next.
+ */
+int BTLeafNode::keyStride() const
+{
+    return (format == BT_FORMAT_SOA) ? sizeof(int) : sizeof(int) + sizeof(RecordId);
+}
+
+/*
+ * Move n entries from entry from to entry to of node dst, which may be
+ * this node. The ranges may overlap. dst must be in the same layout.
+ */
+void BTLeafNode::moveEntries(int from, BTLeafNode& dst, int to, int n)
+{
+    if (n <= 0) return;
+    if (format == BT_FORMAT_SOA) {
+        memmove(dst.keyPtr(to), keyPtr(from), n * sizeof(int));
+        memmove(dst.ridPtr(to), ridPtr(from), n * sizeof(RecordId));
+    } else {
+        memmove(dst.keyPtr(to), keyPtr(from), n * keyStride());
+    }
+}
+
+/*
+ * Zero n entries from entry from on.
+ */
+void BTLeafNode::clearEntries(int from, int n)
+{
+    if (n <= 0) return;
+    if (format == BT_FORMAT_SOA) {
+        memset(keyPtr(from), 0, n * sizeof(int));
+        memset(ridPtr(from), 0, n * sizeof(RecordId));
+    } else {
+        memset(keyPtr(from), 0, n * keyStride());
+    }
+}
+
 /*
  * Write the content of the node to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
@@ -54,7 +214,7 @@ int BTLeafNode::getKeyCount()
 {
     int count = 0;
     //first four bytes stores # of keys(or records) in a page
-    memcpy(&count, &buffer, sizeof(int));
+    memcpy(&count, buffer, sizeof(int));
     return count;
 }
 
@@ -66,76 +226,34 @@ int BTLeafNode::getKeyCount()
  --------------------------------------------------------------------
  * Algorithm:
  1. check leaf node is full or not
- 2. if not full, find the location to insert the new pair
- 3. copy the right part of the node at the insertion position to a temp
+ 2. if not full, find the location to insert the new pair, behind the equal keys
+ 3. shift the entries from the location on to the right by one
  4. insert new (record, key) pair at the location
- 5. copy back the temp part after the new pair
- 6. ++keyCount
- * Note: leaf node structure
- |Number of keys(4 byte)|, |PageId(4 byte)|, |key(4 byte) RecordId(pid, sid)|, |key(4 byte) RecordId(pid, sid)|....
+ 5. ++keyCount
  */
 RC BTLeafNode::insert(int key, const RecordId& rid)
 {
     // 1. check leaf node is full or not
-    int slot_size = sizeof(int) + sizeof(RecordId);
-    int used_size = sizeof(int) + sizeof(PageId) + getKeyCount() * slot_size;
-    int remaining_size = PageFile::PAGE_SIZE - used_size;
-    
-    if(remaining_size < slot_size) {
+    int count = getKeyCount();
+    if(count >= MAX_KEYS) {
         return RC_NODE_FULL;
     }
     
-    // 2. find the location to insert the new (record,key) pair
-    int insertPosition = getKeyCount();
-    RC rc = locate(key, insertPosition);
-    if (rc == 0) {
-        return 0;
-    }
-    
-    // First skip the initial key count and pageId in the leaf node structure
-    char* iter = &(buffer[0]);
-    iter += sizeof(int);
-    iter += sizeof(PageId);
-    
-    // 3. move to correct position insert the new (key, record) pair
-    for (int i = 0; i < insertPosition; i++) {
-        iter += slot_size;
-    }
-    
-    // 4. copy the right part of the node at the insertion position to a temp
-    // allocate a new page temp to store the right part of the node at the insertion position
-    char* temp = (char*)malloc(PageFile::PAGE_SIZE * sizeof(char));
-    // initialize the new page values to zero
-    memset(temp, 0, PageFile::PAGE_SIZE);
-    
-    bool insert_at_end = (insertPosition == getKeyCount());
-    // if the new pair is not inserted at the end, copy the right part to temp
-    if (insert_at_end == false) {
-        // copy the right part to temp
-        memcpy(temp, iter, slot_size * (getKeyCount() - insertPosition));
-        // set the original right part to zero
-        memset(iter, 0, slot_size * (getKeyCount() - insertPosition));
-    }
+    // 2. find the location to insert the new (record,key) pair:
+    // behind the pairs with the same key
+    int insertPosition = searchKeys(keyPtr(0), keyStride(), count, key, true);
     
-    memcpy(iter, &key, sizeof(int));
-    iter += sizeof(int);
-    memcpy(iter, &rid, sizeof(RecordId));
-    iter += sizeof(RecordId);
+    // 3. make room for the new pair. in BT_FORMAT_SOA the keys and the
+    // RecordIds are shifted separately
+    moveEntries(insertPosition, *this, insertPosition + 1, count - insertPosition);
     
-    // 5. if the new pair is not inserted at the end, copy back the temp part back after the new pair
-    if (insert_at_end == false) {
-        memcpy(iter, temp, slot_size * (getKeyCount() - insertPosition));
-    }
-    free(temp);
+    // 4. insert the new (key, record) pair
+    memcpy(keyPtr(insertPosition), &key, sizeof(int));
+    memcpy(ridPtr(insertPosition), &rid, sizeof(RecordId));
     
-    // 6. increase the keyCount by 1
-    // move the iter, point to the # key
-    iter = &(buffer[0]);
-    // increase the keyCount by 1
-    int currKeyCount = getKeyCount();
-    currKeyCount++;
-    // store the new keyCount value to # key (the first 4 byte)
-    memcpy(iter, &currKeyCount, sizeof(int));
+    // 5. increase the keyCount by 1
+    count++;
+    memcpy(buffer, &count, sizeof(int));
     return 0;
 }
 
@@ -153,89 +271,140 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
                               BTLeafNode& sibling, int& siblingKey)
 {
     int nkeys = getKeyCount();
-    int slot_size = sizeof(int) + sizeof(RecordId);
-    
-    char* iter = &(buffer[0]);
-    iter += sizeof(int); // # of keys
-    iter += sizeof(PageId);
     
-    int i = 0; // ith key
-    while(i < nkeys / 2){
-        iter += slot_size;
-        i++;
-    }
+    // the middle pair
     int midkey;
-    memcpy(&midkey, iter, sizeof(int)); // obtain the midkey
-    char *tmp = (char*)malloc(1024 * sizeof(char)); // allocate a temp space
-    memset(tmp, 0, 1024 * sizeof(char));
-    int nkeysIntmp = 0;
-    
+    memcpy(&midkey, keyPtr(nkeys / 2), sizeof(int)); // obtain the midkey
+    
+    // the pairs past the midkey move if the new key goes right of it, to
+    // guarantee left has one more key than right. otherwise the midkey moves too
+    int firstMoved = (key > midkey) ? nkeys/2 + 1 : nkeys/2;
+    int nmoved = nkeys - firstMoved;
+    
+    // move them to the sibling in one copy. the sibling takes the layout of this node
+    sibling.unpin();
+    sibling.format = format;
+    memset(sibling.buffer, 0, PageFile::PAGE_SIZE);
+    moveEntries(firstMoved, sibling, 0, nmoved);
+    memcpy(sibling.buffer, &nmoved, sizeof(int));
+    clearEntries(firstMoved, nmoved);
+    memcpy(buffer, &firstMoved, sizeof(int));
+    
+    // both nodes have room now for the new pair
     if(key > midkey){
-        // copy the second half past the midkey, to guarantee left has one more key than right
-        iter += slot_size;
-        if(nkeys % 2 == 0){ // even number of keys
-            nkeysIntmp = nkeys/2-1;
-            memcpy(tmp, iter, slot_size * (nkeys/2-1));
-            memset(iter, 0, slot_size * (nkeys/2-1));
-            
-        }
-        else{ // odd number of keys
-            nkeysIntmp = nkeys/2;
-            memcpy(tmp, iter, slot_size * (nkeys/2));
-            memset(iter, 0, slot_size * (nkeys/2));
-        }
-        
-        // update number of keys
-        *(int *)buffer = nkeys/2 + 1;
-        
         if(sibling.insert(key, rid) != 0) { // insert into sibling
             return RC_FILE_WRITE_FAILED;
         }
     }
     else{
-        if(nkeys % 2 == 0){ // even number of keys
-            nkeysIntmp = nkeys/2;
-            memcpy(tmp, iter, slot_size * (nkeys/2));
-            memset(iter, 0, slot_size * (nkeys/2));
-            
-        }
-        else{ // odd number of keys
-            nkeysIntmp = nkeys/2+1;
-            memcpy(tmp, iter, slot_size * (nkeys/2+1));
-            memset(iter, 0, slot_size * (nkeys/2+1));
-        }
-        
-        // update number of keys
-        *(int *)buffer = nkeys/2;
-        
         if(insert(key, rid) != 0) { // insert into the original node
             return RC_FILE_WRITE_FAILED;
         }
     }
     
-    // copy tmp to sibling node
-    char* tempIter = tmp;
-    for(int i = 0; i < nkeysIntmp; i++){
-        int key;
-        RecordId r;
-        memcpy(&key, tempIter, sizeof(int)); // retrieve key
-
-        tempIter += sizeof(int);
-        memcpy(&r, tempIter, sizeof(RecordId));
-        tempIter += sizeof(RecordId);
-        
-        if(sibling.insert(key, r) != 0) {
-            return RC_FILE_WRITE_FAILED;
-        }
-    }
-    free(tmp);
-    
     // store the siblingkey
     RecordId rec;
     sibling.readEntry(0, siblingKey, rec);
     return 0;
 }
 
+/*
+ * Add the (key, rid) pair behind the last entry of the node, without a
+ * search. The key MUST NOT be smaller than any key in the node.
+ * @param key[IN] the key to add
+ * @param rid[IN] the RecordId to add
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTLeafNode::append(int key, const RecordId& rid)
+{
+    int count = getKeyCount();
+    if (count >= MAX_KEYS) {
+        return RC_NODE_FULL;
+    }
+    
+    memcpy(keyPtr(count), &key, sizeof(int));
+    memcpy(ridPtr(count), &rid, sizeof(RecordId));
+    count++;
+    memcpy(buffer, &count, sizeof(int));
+    return 0;
+}
+
+/*
+ * Remove the eid entry from the node.
+ * @param eid[IN] the entry number to remove
+ * @return 0 if successful. Return an error code if there is no such entry.
+ */
+RC BTLeafNode::remove(int eid)
+{
+    int count = getKeyCount();
+    if (eid < 0 || eid >= count) {
+        return RC_NO_SUCH_RECORD;
+    }
+    
+    moveEntries(eid + 1, *this, eid, count - eid - 1);
+    clearEntries(count - 1, 1);
+    count--;
+    memcpy(buffer, &count, sizeof(int));
+    return 0;
+}
+
+/*
+ * Move every entry of right, the next node of this one, to the end of
+ * this node, which takes over the next pointer of right.
+ * @param right[IN/OUT] the next node. it is left empty
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::merge(BTLeafNode& right)
+{
+    int count = getKeyCount();
+    int rcount = right.getKeyCount();
+    if (count + rcount > MAX_KEYS) {
+        return RC_NODE_FULL;
+    }
+    
+    right.moveEntries(0, *this, count, rcount);
+    right.clearEntries(0, rcount);
+    count += rcount;
+    rcount = 0;
+    memcpy(buffer, &count, sizeof(int));
+    memcpy(right.buffer, &rcount, sizeof(int));
+    return setNextNodePtr(right.getNextNodePtr());
+}
+
+/*
+ * Even out the # entries of this node and right, the next node of this one.
+ * @param right[IN/OUT] the next node
+ * @param separator[OUT] the first key in right after the move
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTLeafNode::redistribute(BTLeafNode& right, int& separator)
+{
+    int count = getKeyCount();
+    int rcount = right.getKeyCount();
+    int newCount = (count + rcount) / 2;
+    
+    if (newCount < count) {
+        // the last entries of this node go to the front of right
+        int m = count - newCount;
+        right.moveEntries(0, right, m, rcount);
+        moveEntries(newCount, right, 0, m);
+        clearEntries(newCount, m);
+    } else if (newCount > count) {
+        // the first entries of right go to the end of this node
+        int m = newCount - count;
+        right.moveEntries(0, *this, count, m);
+        right.moveEntries(m, right, 0, rcount - m);
+        right.clearEntries(rcount - m, m);
+    }
+    rcount += count - newCount;
+    count = newCount;
+    memcpy(buffer, &count, sizeof(int));
+    memcpy(right.buffer, &rcount, sizeof(int));
+    
+    memcpy(&separator, right.keyPtr(0), sizeof(int));
+    return 0;
+}
+
 /**
  * If searchKey exists in the node, set eid to the index entry
  * with searchKey and return 0. If not, set eid to the index entry
@@ -249,27 +418,14 @@ RC BTLeafNode::insertAndSplit(int key, const RecordId& rid,
  */
 RC BTLeafNode::locate(int searchKey, int& eid)
 {
-    // First skip the initial key count and pageId in the leaf node structure
-    char* iter = &(buffer[0]);
-    iter += sizeof(int);
-    iter += sizeof(PageId);
-    int slot_size = sizeof(RecordId) + sizeof(int);
-    int currKey = 0;
-    eid = getKeyCount();
-    for (int i = 0; i < getKeyCount(); i++) {
-        // Read current key
-        memcpy(&currKey, iter, sizeof(int));
-        
-        // found the insertion location (###########Could the input key be 0?)
-        if (currKey == searchKey) {
-            eid = i;
-            return 0;
-        } else if (currKey > searchKey) {
-            eid = i;
-            break;
-        }
-        // move to the next pair
-        iter += slot_size;
+    int count = getKeyCount();
+    int currKey;
+    
+    // the first key not smaller than searchKey
+    eid = searchKeys(keyPtr(0), keyStride(), count, searchKey, false);
+    if (eid < count) {
+        memcpy(&currKey, keyPtr(eid), sizeof(int));
+        if (currKey == searchKey) return 0;
     }
     return RC_NO_SUCH_RECORD;
 }
@@ -283,21 +439,9 @@ RC BTLeafNode::locate(int searchKey, int& eid)
  */
 RC BTLeafNode::readEntry(int eid, int& key, RecordId& rid)
 {
-    // First skip the initial key count and pageId in the leaf node structure
-    int slot_size = sizeof(RecordId) + sizeof(int);
-    char* iter = &(buffer[0]);
-    iter += sizeof(int);
-    iter += sizeof(PageId);
-    
-    // Skip previous keys
-    for (int i = 0; i < eid; i++) {
-        iter += slot_size;
-    }
-    
     // Read entry values
-    memcpy(&key, iter, sizeof(int));
-    iter += sizeof(int);
-    memcpy(&rid, iter, sizeof(RecordId));
+    memcpy(&key, keyPtr(eid), sizeof(int));
+    memcpy(&rid, ridPtr(eid), sizeof(RecordId));
     return 0;
 }
 
@@ -343,10 +487,31 @@ RC BTLeafNode::setNextNodePtr(PageId pid)
 
 /*******************BTNonLeafNode*********************/
 
-BTNonLeafNode::BTNonLeafNode() {
+BTNonLeafNode::BTNonLeafNode(int format) {
+    this->format = format;
+    buffer = page;
+    pinnedFile = NULL;
     memset(buffer, 0, PageFile::PAGE_SIZE);
 }
 
+/* destructor, give the pinned frame back to the buffer pool */
+BTNonLeafNode::~BTNonLeafNode()
+{
+    unpin();
+}
+
+/*
+ * Unpin the frame the node is working on and switch back to the private page.
+ */
+void BTNonLeafNode::unpin()
+{
+    if (pinnedFile != NULL) {
+        pinnedFile->unpin(pinnedPid);
+        pinnedFile = NULL;
+        buffer = page;
+    }
+}
+
 /*
  * Read the content of the node from the page pid in the PageFile pf.
  * @param pid[IN] the PageId to read
@@ -355,10 +520,77 @@ BTNonLeafNode::BTNonLeafNode() {
  */
 RC BTNonLeafNode::read(PageId pid, const PageFile& pf)
 {
-    //store PageFile and PageId that this node corresponds to, makes life easier
+    unpin();
+    format = pf.getFormat();
+    // work on the buffer pool frame in place if one is available
+    if (pf.pin(pid, buffer) == 0) {
+        pinnedFile = &pf;
+        pinnedPid = pid;
+        return 0;
+    }
+    buffer = page;
     return pf.read(pid, buffer);
 }
 
+/*
+ * The i'th key. In BT_FORMAT_SOA the keys follow the key count, otherwise
+ * each key follows the child pointer before it.
+ */
+char* BTNonLeafNode::keyPtr(int i)
+{
+    if (format == BT_FORMAT_SOA)
+        return buffer + sizeof(int) + i * sizeof(int);
+    return buffer + sizeof(int) + sizeof(PageId) + i * keyStride();
+}
+
+/*
+ * The i'th child pointer, the one in front of the i'th key.
+ */
+char* BTNonLeafNode::pidPtr(int i)
+{
+    if (format == BT_FORMAT_SOA)
+        return buffer + sizeof(int) + MAX_KEYS * sizeof(int) + i * sizeof(PageId);
+    return buffer + sizeof(int) + i * keyStride();
+}
+
+/*
+ * The # bytes from one key to the next.
+ */
+int BTNonLeafNode::keyStride() const
+{
+    return (format == BT_FORMAT_SOA) ? sizeof(int) : sizeof(int) + sizeof(PageId);
+}
+
+/*
+ * Move n keys, each with the child pointer behind it, from key from to
+ * key to of node dst, which may be this node. The ranges may overlap.
+ * dst must be in the same layout.
+ */
+void BTNonLeafNode::moveEntries(int from, BTNonLeafNode& dst, int to, int n)
+{
+    if (n <= 0) return;
+    if (format == BT_FORMAT_SOA) {
+        memmove(dst.keyPtr(to), keyPtr(from), n * sizeof(int));
+        memmove(dst.pidPtr(to + 1), pidPtr(from + 1), n * sizeof(PageId));
+    } else {
+        memmove(dst.keyPtr(to), keyPtr(from), n * keyStride());
+    }
+}
+
+/*
+ * Zero n keys from key from on, with the child pointers behind them.
+ */
+void BTNonLeafNode::clearEntries(int from, int n)
+{
+    if (n <= 0) return;
+    if (format == BT_FORMAT_SOA) {
+        memset(keyPtr(from), 0, n * sizeof(int));
+        memset(pidPtr(from + 1), 0, n * sizeof(PageId));
+    } else {
+        memset(keyPtr(from), 0, n * keyStride());
+    }
+}
+
 /*
  * Write the content of the node to the page pid in the PageFile pf.
  * @param pid[IN] the PageId to write to
@@ -378,188 +610,274 @@ int BTNonLeafNode::getKeyCount()
 {
     int count = 0;
     //first four bytes stores number of keys in a non-leaf node
-    memcpy(&count, &buffer, sizeof(int));
+    memcpy(&count, buffer, sizeof(int));
     
     return count;
 }
 
 
 /*
- * Insert a (key, pid) pair to the node.
+ * Insert a (key, pid) pair to the node, right behind the pointer to child.
+ * @param child[IN] the PageId of the child that split
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
  * @return 0 if successful. Return an error code if the node is full.
  * Note: non-leaf node structure
  |Number of keys(4 byte)|, |PageId|, |key, PageId(4 byte)|, |key, PageId(4 byte)|, |key, PageId(4 byte)|....
  */
-RC BTNonLeafNode::insert(int key, PageId pid)
+RC BTNonLeafNode::insert(PageId child, int key, PageId pid)
 {
     // 1. check non-leaf node is full or not
-    int slot_size = sizeof(int) + sizeof(PageId);
-    int used_size = sizeof(int) + sizeof(PageId) + getKeyCount() * slot_size;
-    int remaining_size = PageFile::PAGE_SIZE - used_size;
-    
-    if(remaining_size < slot_size) {
+    if(getKeyCount() >= MAX_KEYS) {
         return RC_NODE_FULL;
     }
     
-    // 2. find the location to insert the new (record,key) pair
-    // move the iter to the first key in the node
-    char* iter = &(buffer[0]);
-    iter += sizeof(int);
-    iter += sizeof(PageId);
-    int position = getKeyCount();
-    int currKey = 0;
-    for (int i = 0; i < getKeyCount(); i++) {
-        // Read current key
-        memcpy(&currKey, iter, sizeof(int));
-        // found the insertion location (###########Could the input key be 0?)
-        if (currKey == key) {
-            return 0;
-        } else if (currKey > key) {
-            position = i;
-            break;
-        }
-        // move to the next pair
-        iter += slot_size;
+    // 2. the new key goes in front of the key behind child
+    int position = findChild(child);
+    if (position < 0) {
+        return RC_INVALID_PID;
     }
     
-    // 3. move to the correct position, and insert the new (key, PageId) pair
-    iter = &(buffer[0]);
-    for (int i = 0; i <= position; i++) {
-        iter += slot_size;
-    }
-    
-    // 4. copy the right part of the node at the insertion position to a temp
-    // allocate a new page temp to store the right part of the node at the insertion position
-    char* temp = (char*)malloc(PageFile::PAGE_SIZE * sizeof(char));
-    // initialize the new page values to zero
-    memset(temp, 0, PageFile::PAGE_SIZE);
-    
-    bool insert_at_end = (position == getKeyCount());
-    // if the new pair is not inserted at the end, copy the right part to temp
-    if (insert_at_end == false) {
-        // copy the right part to temp
-        memcpy(temp, iter, slot_size * (getKeyCount() - position));
-        // set the original right part to zero
-        memset(iter, 0, slot_size * (getKeyCount() - position));
-    }
-    
-    memcpy(iter, &key, sizeof(int));
-    iter += sizeof(int);
-    memcpy(iter, &pid, sizeof(PageId));
-    iter += sizeof(PageId);
+    insertAt(position, key, pid);
+    return 0;
+}
+
+/*
+ * Insert the (key, pid) pair as the position'th key, with pid behind it.
+ * The node MUST have room for it.
+ */
+void BTNonLeafNode::insertAt(int position, int key, PageId pid)
+{
+    int count = getKeyCount();
     
-    // 5. if the new pair is not inserted at the end, copy back the temp part back after the new pair
-    if (insert_at_end == false) {
-        memcpy(iter, temp, slot_size * (getKeyCount() - position));
-    }
-    free(temp);
+    // make room for the new pair, and insert it: the key at the position
+    // and the PageId right behind it
+    moveEntries(position, *this, position + 1, count - position);
+    memcpy(keyPtr(position), &key, sizeof(int));
+    memcpy(pidPtr(position + 1), &pid, sizeof(PageId));
     
-    // 6. increase the keyCount by 1
-    // move the iter, point to the # key
-    iter = &(buffer[0]);
     // increase the keyCount by 1
-    int currKeyCount = getKeyCount();
-    currKeyCount++;
-    // store the new keyCount value to # key (the first 4 byte)
-    memcpy(iter, &currKeyCount, sizeof(int));
-    return 0;
+    count++;
+    memcpy(buffer, &count, sizeof(int));
 }
 
 /*
- * Insert the (key, pid) pair to the node
+ * Insert the (key, pid) pair to the node, right behind the pointer to child,
  * and split the node half and half with sibling.
  * The middle key after the split is returned in midKey.
+ * @param child[IN] the PageId of the child that split
  * @param key[IN] the key to insert
  * @param pid[IN] the PageId to insert
  * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
  * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
  * @return 0 if successful. Return an error code if there is an error.
  */
-RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
+RC BTNonLeafNode::insertAndSplit(PageId child, int key, PageId pid, BTNonLeafNode& sibling, int& midKey)
 {
-    
     int nkeys = getKeyCount();
-    int slot_size = sizeof(int) + sizeof(PageId);
     
-    char* iter = &(buffer[0]);
-    iter += sizeof(int); // # of keys
-    iter += sizeof(PageId);
+    // the position of the new pair, in front of the key behind child
+    int position = findChild(child);
+    if (position < 0) {
+        return RC_INVALID_PID;
+    }
     
-    int i = 0; // ith key
-    while(i < nkeys / 2){
-        iter += slot_size;
-        i++;
+    // of the nkeys + 1 keys with the new one, the first total / 2 stay, the
+    // next moves up to the parent, and the pid behind it becomes the first
+    // pid of the sibling. mid is the old key at the split point, or the
+    // first one moved if the new key itself moves up
+    int left = (nkeys + 1) / 2;
+    int mid = (position < left) ? left - 1 : left;
+    int firstMoved;
+    PageId siblingPid0;
+    if (position == left) {
+        midKey = key;
+        siblingPid0 = pid;
+        firstMoved = mid;
+    } else {
+        memcpy(&midKey, keyPtr(mid), sizeof(int));
+        memcpy(&siblingPid0, pidPtr(mid + 1), sizeof(PageId));
+        firstMoved = mid + 1;
     }
     
-    int original_midkey;
-    memcpy(&original_midkey, iter, sizeof(int)); // obtain the midkey
-    char *tmp = (char*)malloc(1024 * sizeof(char)); // allocate a temp space
-    memset(tmp, 0, 1024 * sizeof(char));
-    
-    if(key > original_midkey){
-        // copy the second half past the midkey, to guarantee left has one more key than right
-        iter += slot_size;
-        if(nkeys % 2 == 0){ // even number of keys
-            memcpy(tmp, iter, slot_size * (nkeys/2-1));
-            memset(iter, 0, slot_size * (nkeys/2-1));
-            
-        }
-        else{ // odd number of keys
-            memcpy(tmp, iter, slot_size * (nkeys/2));
-            memset(iter, 0, slot_size * (nkeys/2));
-            
-        }
-        
-        // update number of keys
-        *(int *)buffer = nkeys/2+1;
-        
-        if(sibling.insert(key, pid) != 0) // insert into sibling
-            return RC_FILE_WRITE_FAILED;
+    // move the keys past the middle to the sibling in one copy.
+    // the sibling takes the layout of this node
+    int nmoved = nkeys - firstMoved;
+    sibling.unpin();
+    sibling.format = format;
+    memset(sibling.buffer, 0, PageFile::PAGE_SIZE);
+    moveEntries(firstMoved, sibling, 0, nmoved);
+    memcpy(sibling.pidPtr(0), &siblingPid0, sizeof(PageId));
+    memcpy(sibling.buffer, &nmoved, sizeof(int));
+    
+    // the middle key leaves this node too
+    clearEntries(mid, nkeys - mid);
+    memcpy(buffer, &mid, sizeof(int));
+    
+    // both nodes have room now for the new pair, unless it moved up
+    if (position < left) insertAt(position, key, pid);
+    if (position > left) sibling.insertAt(position - firstMoved, key, pid);
+    return 0;
+}
+
+/*
+ * Add the (key, pid) pair behind the last key of the node, without a
+ * search. The key MUST NOT be smaller than any key in the node.
+ * @param key[IN] the key to add
+ * @param pid[IN] the PageId to add behind the key
+ * @return 0 if successful. Return an error code if the node is full.
+ */
+RC BTNonLeafNode::append(int key, PageId pid)
+{
+    int count = getKeyCount();
+    if (count >= MAX_KEYS) {
+        return RC_NODE_FULL;
     }
-    else{
-        if(nkeys % 2 == 0){ // even number of keys
-            memcpy(tmp, iter, slot_size * (nkeys/2));
-            memset(iter, 0, slot_size * (nkeys/2));
-            
-        }
-        else{ // odd number of keys
-            memcpy(tmp, iter, slot_size * (nkeys/2+1));
-            memset(iter, 0, slot_size * (nkeys/2+1));
-        }
-        
-        // update number of keys
-        *(int *)buffer = nkeys/2;
-        
-        if(insert(key, pid) != 0) // insert into the original node
-            return RC_FILE_WRITE_FAILED;
+    
+    memcpy(keyPtr(count), &key, sizeof(int));
+    memcpy(pidPtr(count + 1), &pid, sizeof(PageId));
+    count++;
+    memcpy(buffer, &count, sizeof(int));
+    return 0;
+}
+
+/*
+ * Remove the eid'th key and the child pointer behind it from the node.
+ * @param eid[IN] the key number to remove
+ * @return 0 if successful. Return an error code if there is no such key.
+ */
+RC BTNonLeafNode::remove(int eid)
+{
+    int count = getKeyCount();
+    if (eid < 0 || eid >= count) {
+        return RC_NO_SUCH_RECORD;
     }
     
-    // copy tmp to sibling node
-    char* tempIter = tmp;
-    while(tempIter){
-        int k;
-        PageId p;
-        
-        memcpy(&k, tempIter, sizeof(int));
-        if(k == 0) break;
-        tempIter += sizeof(int);
-        memcpy(&p, tempIter, sizeof(PageId));
-        tempIter += sizeof(PageId);
-        
-        if(sibling.insert(k, p) != 0)
-            return RC_FILE_WRITE_FAILED;
+    moveEntries(eid + 1, *this, eid, count - eid - 1);
+    clearEntries(count - 1, 1);
+    count--;
+    memcpy(buffer, &count, sizeof(int));
+    return 0;
+}
+
+/*
+ * Move the separator key and every key and child pointer of right, the
+ * node behind this one under the same parent, to the end of this node.
+ * @param separator[IN] the key between the two nodes in the parent
+ * @param right[IN/OUT] the node behind this one. it is left empty
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::merge(int separator, BTNonLeafNode& right)
+{
+    int count = getKeyCount();
+    int rcount = right.getKeyCount();
+    if (count + rcount + 1 > MAX_KEYS) {
+        return RC_NODE_FULL;
     }
     
-    // store the midkey
-    iter -= slot_size;
-    memcpy(&midKey, iter, sizeof(int));
+    // the separator comes down in front of the first child of right
+    append(separator, right.getChildPtr(0));
+    right.moveEntries(0, *this, count + 1, rcount);
+    count += rcount + 1;
+    memcpy(buffer, &count, sizeof(int));
     
-    free(tmp);
+    memset(right.buffer, 0, PageFile::PAGE_SIZE);
+    return 0;
+}
+
+/*
+ * Even out the # keys of this node and right, the node behind this one
+ * under the same parent, by rotating keys through the separator.
+ * @param right[IN/OUT] the node behind this one
+ * @param separator[IN/OUT] the key between the two nodes in the parent
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTNonLeafNode::redistribute(BTNonLeafNode& right, int& separator)
+{
+    int count = getKeyCount();
+    int rcount = right.getKeyCount();
+    // the separator is counted with the keys. one of them goes back up
+    int newCount = (count + rcount + 1) / 2;
+    int newRcount = count + rcount - newCount;
+    
+    if (newCount < count) {
+        // the separator and the last keys of this node go to the front of
+        // right, and the key in front of them goes up
+        int m = count - newCount;
+        PageId pid0 = right.getChildPtr(0);
+        right.moveEntries(0, right, m, rcount);
+        memcpy(right.pidPtr(m), &pid0, sizeof(PageId));
+        memcpy(right.keyPtr(m - 1), &separator, sizeof(int));
+        moveEntries(newCount + 1, right, 0, m - 1);
+        memcpy(right.pidPtr(0), pidPtr(newCount + 1), sizeof(PageId));
+        memcpy(&separator, keyPtr(newCount), sizeof(int));
+        clearEntries(newCount, m);
+    } else if (newCount > count) {
+        // the separator and the first keys of right go to the end of this
+        // node, and the key behind them goes up
+        int m = newCount - count;
+        append(separator, right.getChildPtr(0));
+        right.moveEntries(0, *this, count + 1, m - 1);
+        memcpy(&separator, right.keyPtr(m - 1), sizeof(int));
+        memcpy(right.pidPtr(0), right.pidPtr(m), sizeof(PageId));
+        right.moveEntries(m, right, 0, rcount - m);
+        right.clearEntries(rcount - m, m);
+    }
+    memcpy(buffer, &newCount, sizeof(int));
+    memcpy(right.buffer, &newRcount, sizeof(int));
+    return 0;
+}
+
+/*
+ * @param eid[IN] the key number, from 0 to # keys - 1
+ * @return the eid'th key
+ */
+int BTNonLeafNode::getKey(int eid)
+{
+    int key;
+    memcpy(&key, keyPtr(eid), sizeof(int));
+    return key;
+}
+
+/*
+ * Replace the eid'th key. The keys MUST stay sorted.
+ * @param eid[IN] the key number, from 0 to # keys - 1
+ * @param key[IN] the new key
+ * @return 0 if successful. Return an error code if there is no such key.
+ */
+RC BTNonLeafNode::setKey(int eid, int key)
+{
+    if (eid < 0 || eid >= getKeyCount()) {
+        return RC_NO_SUCH_RECORD;
+    }
+    memcpy(keyPtr(eid), &key, sizeof(int));
     return 0;
 }
 
+/*
+ * @param i[IN] the child number, from 0 to # keys
+ * @return the PageId of the i'th child, the one in front of the i'th key
+ */
+PageId BTNonLeafNode::getChildPtr(int i)
+{
+    PageId pid;
+    memcpy(&pid, pidPtr(i), sizeof(PageId));
+    return pid;
+}
+
+/*
+ * @param pid[IN] the PageId of a child
+ * @return the number of the child with the PageId. -1 if there is none
+ */
+int BTNonLeafNode::findChild(PageId pid)
+{
+    int count = getKeyCount();
+    for (int i = 0; i <= count; i++) {
+        if (getChildPtr(i) == pid) return i;
+    }
+    return -1;
+}
+
 /*
  * Given the searchKey, find the child-node pointer to follow and
  * output it in pid.
@@ -569,46 +887,11 @@ RC BTNonLeafNode::insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, in
  */
 RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
 {
-    int position = -1, realKey = -1;
-    char* iter = &(buffer[0]);
-    iter += sizeof(int);
-    iter += sizeof(PageId);
-    int slot_size = sizeof(int) + sizeof(PageId);
-    int currKey = 0;
-    bool found = false;
-    for (int i = 0; i < getKeyCount(); i++) {
-        // Read current key
-        memcpy(&currKey, iter, sizeof(int));
-        // found the insertion location (###########Could the input key be 0?)
-        if (currKey >= searchKey) {
-            position = i;
-            realKey = currKey;
-            found = true;
-            break;
-        }
-        // move to the next pair
-        iter += slot_size;
-    }
-    if (!found) {
-        position = getKeyCount() - 1;
-        realKey = currKey;
-    }
-    
-    // First skip the initial key count and pageId in the leaf node structure
-    iter = &(buffer[0]);
-    
-    // Skip previous keys
-    for (int i = 0; i <= position; i++) {
-        iter += slot_size;
-    }
-    
-    if (searchKey < realKey) {
-        iter -= sizeof(PageId);
-    } else {
-        iter += sizeof(int);
-    }
-    // Read entry values
-    memcpy(&pid, iter, sizeof(PageId));
+    // the child to follow is the one in front of the first key not smaller
+    // than searchKey. a key equal to searchKey may be the first key of the
+    // child behind it and the last of the child in front of it
+    int child = searchKeys(keyPtr(0), keyStride(), getKeyCount(), searchKey, false);
+    memcpy(&pid, pidPtr(child), sizeof(PageId));
     
     return 0;
 }
@@ -622,16 +905,12 @@ RC BTNonLeafNode::locateChildPtr(int searchKey, PageId& pid)
  */
 RC BTNonLeafNode::initializeRoot(PageId pid1, int key, PageId pid2)
 {
-    char* iter = &(buffer[0]);
     int k = 1;
-    memcpy(iter, &k, sizeof(int));
-    iter += sizeof(int);
+    memcpy(buffer, &k, sizeof(int));
     
-    memcpy(iter, &pid1, sizeof(PageId));
-    iter += sizeof(PageId);
-    memcpy(iter, &key, sizeof(int));
-    iter += sizeof(int);
-    memcpy(iter, &pid2, sizeof(PageId));
+    memcpy(pidPtr(0), &pid1, sizeof(PageId));
+    memcpy(keyPtr(0), &key, sizeof(int));
+    memcpy(pidPtr(1), &pid2, sizeof(PageId));
     
     return 0; 
 }
@@ -16,16 +16,37 @@
 #include "cstring"
 #include <stdlib.h>
 using namespace std;
+
+/**
+ * The layouts of the nodes of a B+tree. The layout of an index is kept in
+ * the header of its file, so indexes written in an older layout can still
+ * be read; every node of an index is in the same layout.
+ */
+enum BTNodeFormat {
+    BT_FORMAT_INTERLEAVED = 0,  // each key stored next to its pointer
+    BT_FORMAT_SOA = 1           // the keys in one array, the pointers in another
+};
+
 /**
  * BTLeafNode: The class representing a B+tree leaf node.
  */
 class BTLeafNode {
   public:
-   /* Constructor */
-    BTLeafNode();
+   /* # of (key, rid) pairs that fit in a page after the key count and the next pointer */
+    static const int MAX_KEYS = (PageFile::PAGE_SIZE - sizeof(int) - sizeof(PageId))
+                                / (sizeof(int) + sizeof(RecordId));
+
+   /**
+    * Constructor. read() switches the node to the layout of its file.
+    * @param format[IN] the layout of a new node
+    */
+    BTLeafNode(int format = BT_FORMAT_SOA);
+
+   /* Destructor. Unpins the frame the node is working on */
+    ~BTLeafNode();
     
    /**
-    * Insert the (key, rid) pair to the node.
+    * Insert the (key, rid) pair to the node, behind the pairs with the same key.
     * Remember that all keys inside a B+tree node should be kept sorted.
     * @param key[IN] the key to insert
     * @param rid[IN] the RecordId to insert
@@ -46,6 +67,39 @@ class BTLeafNode {
     */
     RC insertAndSplit(int key, const RecordId& rid, BTLeafNode& sibling, int& siblingKey);
 
+   /**
+    * Add the (key, rid) pair behind the last entry of the node, without a
+    * search. The key MUST NOT be smaller than any key in the node.
+    * @param key[IN] the key to add
+    * @param rid[IN] the RecordId to add
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC append(int key, const RecordId& rid);
+
+   /**
+    * Remove the eid entry from the node.
+    * @param eid[IN] the entry number to remove
+    * @return 0 if successful. Return an error code if there is no such entry.
+    */
+    RC remove(int eid);
+
+   /**
+    * Move every entry of right, the next node of this one, to the end of
+    * this node, which takes over the next pointer of right.
+    * The entries of both nodes MUST fit in one node.
+    * @param right[IN/OUT] the next node. it is left empty
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC merge(BTLeafNode& right);
+
+   /**
+    * Even out the # entries of this node and right, the next node of this one.
+    * @param right[IN/OUT] the next node
+    * @param separator[OUT] the first key in right after the move
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC redistribute(BTLeafNode& right, int& separator);
+
    /**
     * If searchKey exists in the node, set eid to the index entry
     * with searchKey and return 0. If not, set eid to the index entry
@@ -89,6 +143,8 @@ class BTLeafNode {
  
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The node works on the buffer pool frame of the page in place while
+    * it stays pinned, so changes must be written back with write().
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
     * @return 0 if successful. Return an error code if there is an error.
@@ -105,10 +161,48 @@ class BTLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Unpin the buffer pool frame the node is working on, if any,
+    * and switch back to the private page.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    void unpin();
+
+   /**
+    * The key of the i'th entry, its RecordId, and the # bytes between two keys.
+    */
+    char* keyPtr(int i);
+    char* ridPtr(int i);
+    int keyStride() const;
+
+   /**
+    * Move n entries from entry from to entry to of node dst, which may be
+    * this node. The ranges may overlap. dst must be in the same layout.
+    */
+    void moveEntries(int from, BTLeafNode& dst, int to, int n);
+
+   /**
+    * Zero n entries from entry from on.
+    */
+    void clearEntries(int from, int n);
+
+    int format;  // the layout of the node. one of BTNodeFormat
+
+   /**
+    * The content of the node. It points either to a pinned buffer pool
+    * frame of the disk page that contains the node, or to page.
+    */
+    char* buffer;
+
+   /**
+    * The main memory buffer for the node when it is not pinned.
+    */
+    char page[PageFile::PAGE_SIZE];
+
+    const PageFile* pinnedFile;  // the file of the pinned frame. NULL if none
+    PageId          pinnedPid;   // the page of the pinned frame
+
+    // a copy would unpin the frame twice
+    BTLeafNode(const BTLeafNode&);
+    BTLeafNode& operator=(const BTLeafNode&);
 }; 
 
 
@@ -117,35 +211,111 @@ class BTLeafNode {
  */
 class BTNonLeafNode {
   public:
-   /* Constructor */
-   BTNonLeafNode();
+   /* # of (key, pid) pairs that fit in a page after the key count and the first pointer */
+   static const int MAX_KEYS = (PageFile::PAGE_SIZE - sizeof(int) - sizeof(PageId))
+                               / (sizeof(int) + sizeof(PageId));
+
+   /**
+    * Constructor. read() switches the node to the layout of its file.
+    * @param format[IN] the layout of a new node
+    */
+   BTNonLeafNode(int format = BT_FORMAT_SOA);
+
+   /* Destructor. Unpins the frame the node is working on */
+   ~BTNonLeafNode();
     
    /**
-    * Insert a (key, pid) pair to the node.
+    * Insert a (key, pid) pair to the node, right behind the pointer to
+    * child: pid is the new node that child split off. The place is not
+    * found by the key, which other keys of the node may be equal to.
     * Remember that all keys inside a B+tree node should be kept sorted.
+    * @param child[IN] the PageId of the child that split
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
     * @return 0 if successful. Return an error code if the node is full.
     */
-    RC insert(int key, PageId pid);
+    RC insert(PageId child, int key, PageId pid);
 
    /**
-    * Insert the (key, pid) pair to the node
+    * Insert the (key, pid) pair to the node, right behind the pointer to child,
     * and split the node half and half with sibling.
     * The sibling node MUST be empty when this function is called.
     * The middle key after the split is returned in midKey.
     * Remember that all keys inside a B+tree node should be kept sorted.
+    * @param child[IN] the PageId of the child that split
     * @param key[IN] the key to insert
     * @param pid[IN] the PageId to insert
     * @param sibling[IN] the sibling node to split with. This node MUST be empty when this function is called.
     * @param midKey[OUT] the key in the middle after the split. This key should be inserted to the parent node.
     * @return 0 if successful. Return an error code if there is an error.
     */
-    RC insertAndSplit(int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+    RC insertAndSplit(PageId child, int key, PageId pid, BTNonLeafNode& sibling, int& midKey);
+
+   /**
+    * Add the (key, pid) pair behind the last key of the node, without a
+    * search. The key MUST NOT be smaller than any key in the node.
+    * @param key[IN] the key to add
+    * @param pid[IN] the PageId to add behind the key
+    * @return 0 if successful. Return an error code if the node is full.
+    */
+    RC append(int key, PageId pid);
+
+   /**
+    * Remove the eid'th key and the child pointer behind it from the node.
+    * @param eid[IN] the key number to remove
+    * @return 0 if successful. Return an error code if there is no such key.
+    */
+    RC remove(int eid);
+
+   /**
+    * Move the separator key and every key and child pointer of right, the
+    * node behind this one under the same parent, to the end of this node.
+    * The keys of both nodes and the separator MUST fit in one node.
+    * @param separator[IN] the key between the two nodes in the parent
+    * @param right[IN/OUT] the node behind this one. it is left empty
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC merge(int separator, BTNonLeafNode& right);
+
+   /**
+    * Even out the # keys of this node and right, the node behind this one
+    * under the same parent, by rotating keys through the separator.
+    * @param right[IN/OUT] the node behind this one
+    * @param separator[IN/OUT] the key between the two nodes in the parent
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC redistribute(BTNonLeafNode& right, int& separator);
+
+   /**
+    * @param eid[IN] the key number, from 0 to # keys - 1
+    * @return the eid'th key
+    */
+    int getKey(int eid);
+
+   /**
+    * Replace the eid'th key. The keys MUST stay sorted.
+    * @param eid[IN] the key number, from 0 to # keys - 1
+    * @param key[IN] the new key
+    * @return 0 if successful. Return an error code if there is no such key.
+    */
+    RC setKey(int eid, int key);
+
+   /**
+    * @param i[IN] the child number, from 0 to # keys
+    * @return the PageId of the i'th child, the one in front of the i'th key
+    */
+    PageId getChildPtr(int i);
+
+   /**
+    * @param pid[IN] the PageId of a child
+    * @return the number of the child with the PageId. -1 if there is none
+    */
+    int findChild(PageId pid);
 
    /**
     * Given the searchKey, find the child-node pointer to follow and
-    * output it in pid.
+    * output it in pid. Keys equal to searchKey may be found in more than
+    * one child; the pointer is to the first of them.
     * Remember that the keys inside a B+tree node are sorted.
     * @param searchKey[IN] the searchKey that is being looked up.
     * @param pid[OUT] the pointer to the child node to follow.
@@ -170,6 +340,8 @@ class BTNonLeafNode {
 
    /**
     * Read the content of the node from the page pid in the PageFile pf.
+    * The node works on the buffer pool frame of the page in place while
+    * it stays pinned, so changes must be written back with write().
     * @param pid[IN] the PageId to read
     * @param pf[IN] PageFile to read from
     * @return 0 if successful. Return an error code if there is an error.
@@ -186,10 +358,56 @@ class BTNonLeafNode {
 
   private:
    /**
-    * The main memory buffer for loading the content of the disk page 
-    * that contains the node.
+    * Unpin the buffer pool frame the node is working on, if any,
+    * and switch back to the private page.
+    */
+    void unpin();
+
+   /**
+    * The i'th key, the i'th child pointer (0 to # keys), and the # bytes
+    * between two keys.
+    */
+    char* keyPtr(int i);
+    char* pidPtr(int i);
+    int keyStride() const;
+
+   /**
+    * Move n keys, each with the child pointer behind it, from key from to
+    * key to of node dst, which may be this node. The ranges may overlap.
+    * dst must be in the same layout.
+    */
+    void moveEntries(int from, BTNonLeafNode& dst, int to, int n);
+
+   /**
+    * Insert the (key, pid) pair as the position'th key, with pid behind it.
+    * The node MUST have room for it.
     */
-    char buffer[PageFile::PAGE_SIZE];
+    void insertAt(int position, int key, PageId pid);
+
+   /**
+    * Zero n keys from key from on, with the child pointers behind them.
+    */
+    void clearEntries(int from, int n);
+
+    int format;  // the layout of the node. one of BTNodeFormat
+
+   /**
+    * The content of the node. It points either to a pinned buffer pool
+    * frame of the disk page that contains the node, or to page.
+    */
+    char* buffer;
+
+   /**
+    * The main memory buffer for the node when it is not pinned.
+    */
+    char page[PageFile::PAGE_SIZE];
+
+    const PageFile* pinnedFile;  // the file of the pinned frame. NULL if none
+    PageId          pinnedPid;   // the page of the pinned frame
+
+    // a copy would unpin the frame twice
+    BTNonLeafNode(const BTNonLeafNode&);
+    BTNonLeafNode& operator=(const BTNonLeafNode&);
 }; 
 
 #endif /* BTREENODE_H */
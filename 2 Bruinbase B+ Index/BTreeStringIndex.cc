@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "BTreeStringIndex.h"
+#include <algorithm>
+#include <cstring>
+
+/*
+ * The first MAX_KEY_LENGTH bytes of a key, the part the index keeps.
+ */
+static string_view cut(string_view key)
+{
+    return key.substr(0, BTreeStringIndex::MAX_KEY_LENGTH);
+}
+
+/*
+ * The key a non-leaf node keeps between two neighbouring leaves: the
+ * shortest prefix of the first key of the right leaf that is larger than
+ * the last key of the left one. The first key is kept whole if the two
+ * keys are equal.
+ * @param last[IN] the last key of the left leaf
+ * @param first[IN] the first key of the right leaf. not smaller than last
+ * @return the key
+ */
+static string separator(string_view last, string_view first)
+{
+    size_t n = 0;
+    while (n < last.size() && n < first.size() && last[n] == first[n]) n++;
+    return string(first.substr(0, n + 1));
+}
+
+/*
+ * BTreeStringIndex constructor
+ */
+BTreeStringIndex::BTreeStringIndex()
+{
+    /* page 0 keeps rootPid, treeHeight and lastPid. the first root, an
+     * empty leaf, is at page 1
+     */
+    rootPid = 1;
+    treeHeight = 1;
+    lastPid = 1;
+    mode = 'r';
+}
+
+/*
+ * Open the index file in read or write mode.
+ * @param indexname[IN] the name of the index file
+ * @param mode[IN] 'r' for read, 'w' for write
+ * @return error code. 0 if no error
+ */
+RC BTreeStringIndex::open(const string& indexname, char mode)
+{
+    RC rc;
+
+    this->mode = mode;
+    if ((rc = pf.open(indexname, mode)) < 0) {
+        return rc;
+    }
+
+    /* a new index starts with an empty root leaf */
+    if (pf.endPid() == 0 && mode == 'w') {
+        BTStringLeafNode root;
+        rootPid = 1;
+        treeHeight = 1;
+        lastPid = 1;
+        if ((rc = pf.setFormat(BT_STRING_FORMAT_PREFIX)) < 0 || (rc = root.write(rootPid, pf)) < 0) {
+            pf.close();
+            return rc;
+        }
+        return 0;
+    }
+
+    if (pf.getFormat() != BT_STRING_FORMAT_PREFIX) {
+        pf.close();
+        return RC_INVALID_FILE_FORMAT;
+    }
+
+    char buffer[PageFile::PAGE_SIZE];
+    if ((rc = pf.read(0, buffer)) < 0) {
+        pf.close();
+        return rc;
+    }
+    memcpy(&rootPid, buffer, sizeof(PageId));
+    memcpy(&treeHeight, buffer + sizeof(PageId), sizeof(int));
+    memcpy(&lastPid, buffer + sizeof(PageId) + sizeof(int), sizeof(PageId));
+    lastPid = max(lastPid, pf.endPid() - 1);
+
+    if (mode == 'r') {
+        /* index lookups jump around the file */
+        pf.advise(PageFile::ACCESS_RANDOM);
+    }
+    return 0;
+}
+
+/*
+ * Close the index file, writing rootPid, treeHeight and lastPid to page 0
+ * if it was opened for writing.
+ * @return error code. 0 if no error
+ */
+RC BTreeStringIndex::close()
+{
+    RC rc = 0;
+
+    if (mode == 'w') {
+        char buffer[PageFile::PAGE_SIZE];
+        memset(buffer, 0, PageFile::PAGE_SIZE);
+        memcpy(buffer, &rootPid, sizeof(PageId));
+        memcpy(buffer + sizeof(PageId), &treeHeight, sizeof(int));
+        memcpy(buffer + sizeof(PageId) + sizeof(int), &lastPid, sizeof(PageId));
+        rc = pf.write(0, buffer);
+    }
+    RC rc2 = pf.close();
+    return (rc < 0) ? rc : rc2;
+}
+
+/*
+ * Insert (key, RecordId) pair to the index.
+ * @param key[IN] the key. cut to MAX_KEY_LENGTH bytes
+ * @param rid[IN] the RecordId for the record being inserted into the index
+ * @return error code. 0 if no error
+ --------------------------------------------------------------------
+ * Algorithm:
+ 1. find the leaf of the key and insert the pair into it
+ 2. while a node is full, split it and insert the new node behind it
+    into the parent, one level up
+ 3. if the root split, a new root takes the two halves
+ */
+RC BTreeStringIndex::insert(string_view key, const RecordId& rid)
+{
+    RC rc;
+    IndexCursor cursor;
+
+    /* 1. the leaf */
+    key = cut(key);
+    if ((rc = locate(key, cursor)) < 0 && rc != RC_NO_SUCH_RECORD) {
+        return rc;
+    }
+    BTStringLeafNode leaf;
+    if ((rc = leaf.read(cursor.pid, pf)) < 0) {
+        return rc;
+    }
+    if (leaf.insert(key, rid) == 0) {
+        return leaf.write(cursor.pid, pf);
+    }
+
+    BTStringLeafNode siblingLeaf;
+    string siblingKey;
+    leaf.insertAndSplit(key, rid, siblingLeaf, siblingKey);
+    PageId siblingPid = ++lastPid;
+    siblingLeaf.setNextNodePtr(leaf.getNextNodePtr());
+    leaf.setNextNodePtr(siblingPid);
+    if ((rc = leaf.write(cursor.pid, pf)) < 0 || (rc = siblingLeaf.write(siblingPid, pf)) < 0) {
+        return rc;
+    }
+
+    /* 2. the non-leaf levels. the new node goes right behind the child
+     * that split off it
+     */
+    PageId childPid = cursor.pid;
+    for (int i = cursor.parent.size() - 1; i >= 0; i--) {
+        BTStringNonLeafNode node;
+        if ((rc = node.read(cursor.parent[i], pf)) < 0) {
+            return rc;
+        }
+        if (node.insert(childPid, siblingKey, siblingPid) == 0) {
+            return node.write(cursor.parent[i], pf);
+        }
+
+        BTStringNonLeafNode siblingNode;
+        string midKey;
+        if ((rc = node.insertAndSplit(childPid, siblingKey, siblingPid, siblingNode, midKey)) < 0) {
+            return rc;
+        }
+        siblingPid = ++lastPid;
+        if ((rc = node.write(cursor.parent[i], pf)) < 0 || (rc = siblingNode.write(siblingPid, pf)) < 0) {
+            return rc;
+        }
+        childPid = cursor.parent[i];
+        siblingKey.swap(midKey);
+    }
+
+    /* 3. a new root */
+    BTStringNonLeafNode root;
+    PageId newRootPid = ++lastPid;
+    root.initializeRoot(rootPid, siblingKey, siblingPid);
+    if ((rc = root.write(newRootPid, pf)) < 0) {
+        return rc;
+    }
+    rootPid = newRootPid;
+    treeHeight++;
+    return 0;
+}
+
+/*
+ * Insert many (key, RecordId) pairs to the index at once. An empty index
+ * is built bottom up, writing every page once.
+ * @param entries[IN/OUT] the pairs, in any order. they are sorted
+ * @return error code. 0 if no error
+ */
+RC BTreeStringIndex::build(vector<StringIndexEntry>& entries)
+{
+    RC rc;
+
+    bool empty = (treeHeight == 1);
+    if (empty) {
+        BTStringLeafNode root;
+        if ((rc = root.read(rootPid, pf)) < 0) {
+            return rc;
+        }
+        empty = (root.getKeyCount() == 0);
+    }
+    if (!empty) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if ((rc = insert(entries[i].key, entries[i].rid)) < 0) return rc;
+        }
+        return 0;
+    }
+
+    /* sort the pairs by key. like insert(), the pairs of a key stay in the
+     * order they came in. a key sorts in the same place once it is cut
+     */
+    stable_sort(entries.begin(), entries.end(),
+                [](const StringIndexEntry& a, const StringIndexEntry& b) { return a.key < b.key; });
+    if (entries.empty()) return 0;
+
+    /* the keys take different room, so each node is filled until its keys
+     * and slots reach the fill factor of the page, or the next key does
+     * not fit. the leaves take the pages from the root on, left to right
+     */
+    int budget = (int)(PageFile::PAGE_SIZE * BTreeIndex::getFillFactor());
+    size_t n = entries.size();
+    vector<string> keys;  /// the key in front of each node of the level built last
+    vector<PageId> pids;  /// and its page
+    PageId pid = rootPid;
+    for (size_t j = 0; j < n; pid++) {
+        BTStringLeafNode leaf;
+        keys.push_back((j == 0) ? string() : separator(cut(entries[j - 1].key), cut(entries[j].key)));
+        pids.push_back(pid);
+        while (j < n && (leaf.getKeyCount() == 0 || leaf.getUsedBytes() < budget)
+               && leaf.append(cut(entries[j].key), entries[j].rid) == 0) {
+            j++;
+        }
+        leaf.setNextNodePtr((j < n) ? pid + 1 : 0);
+        if ((rc = leaf.write(pid, pf)) < 0) return rc;
+    }
+    lastPid = max(lastPid, pid - 1);
+    treeHeight = 1;
+
+    /* build the non-leaf levels one above the other until one node is left.
+     * each node takes at least 3 children; if the last one is left with a
+     * single child, the node in front of it gives it one more
+     */
+    while (pids.size() > 1) {
+        size_t c = pids.size();
+        vector<size_t> starts;
+        for (size_t from = 0; from < c; ) {
+            starts.push_back(from);
+            if (from + 1 == c) break;
+            BTStringNonLeafNode node;
+            node.initializeRoot(pids[from], keys[from + 1], pids[from + 1]);
+            size_t to = from + 2;
+            while (to < c && (to - from < 3 || node.getUsedBytes() < budget)
+                   && node.append(keys[to], pids[to]) == 0) {
+                to++;
+            }
+            from = to;
+        }
+        if (starts.size() > 1 && starts.back() == c - 1) starts.back()--;
+        starts.push_back(c);
+
+        vector<string> upKeys;
+        vector<PageId> upPids;
+        for (size_t g = 0; g + 1 < starts.size(); g++) {
+            BTStringNonLeafNode node;
+            size_t from = starts[g];
+            node.initializeRoot(pids[from], keys[from + 1], pids[from + 1]);
+            for (size_t j = from + 2; j < starts[g + 1]; j++) {
+                node.append(keys[j], pids[j]);
+            }
+            PageId nodePid = ++lastPid;
+            if ((rc = node.write(nodePid, pf)) < 0) return rc;
+            upKeys.push_back(keys[from]);
+            upPids.push_back(nodePid);
+        }
+        keys.swap(upKeys);
+        pids.swap(upPids);
+        treeHeight++;
+    }
+    rootPid = pids[0];
+
+    return 0;
+}
+
+/*
+ * Find the first entry whose key is not smaller than searchKey.
+ * @param searchKey[IN] the key to find. cut to MAX_KEY_LENGTH bytes
+ * @param cursor[OUT] the cursor pointing to the entry
+ * @return 0 if the key of the entry is searchKey. Otherwise, an error code
+ */
+RC BTreeStringIndex::locate(string_view searchKey, IndexCursor& cursor)
+{
+    PageId pid = rootPid;
+
+    searchKey = cut(searchKey);
+    cursor.parent.clear();
+    for (int level = 1; level < treeHeight; level++) {
+        BTStringNonLeafNode node;
+        cursor.parent.push_back(pid);
+        if (node.read(pid, pf) != 0) {
+            return RC_FILE_READ_FAILED;
+        }
+        IoStats::countLevel(pf.getStats(), level);
+        node.locateChildPtr(searchKey, pid);
+    }
+
+    BTStringLeafNode leaf;
+    if (leaf.read(pid, pf) != 0) {
+        return RC_FILE_READ_FAILED;
+    }
+    IoStats::countLevel(pf.getStats(), treeHeight);
+    RC rc = leaf.locate(searchKey, cursor.eid);
+    cursor.pid = pid;
+
+    /* the keys equal to searchKey may start in the next leaf.
+     * the cursor stays behind the last entry, where readForward() moves on from
+     */
+    if (rc == RC_NO_SUCH_RECORD && cursor.eid == leaf.getKeyCount() && leaf.getNextNodePtr() != 0) {
+        string key;
+        RecordId rid;
+        if (leaf.read(leaf.getNextNodePtr(), pf) == 0 && leaf.readEntry(0, key, rid) == 0) {
+            IoStats::countLevel(pf.getStats(), treeHeight);
+            if (key == searchKey) rc = 0;
+        }
+    }
+    return rc;
+}
+
+/*
+ * Read the (key, rid) pair at the location specified by the index cursor,
+ * and move foward the cursor to the next entry.
+ * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+ * @param key[OUT] the key stored at the index cursor location
+ * @param rid[OUT] the RecordId stored at the index cursor location
+ * @return error code. RC_END_OF_TREE behind the last entry
+ */
+RC BTreeStringIndex::readForward(IndexCursor& cursor, string& key, RecordId& rid)
+{
+    RC rc;
+    BTStringLeafNode leaf;
+
+    if ((rc = leaf.read(cursor.pid, pf)) != 0) {
+        return rc;
+    }
+    IoStats::countLevel(pf.getStats(), treeHeight);
+    if (cursor.eid == leaf.getKeyCount()) {
+        if (leaf.getNextNodePtr() == 0) {
+            return RC_END_OF_TREE;
+        }
+        cursor.pid = leaf.getNextNodePtr();
+        cursor.eid = 0;
+        if ((rc = leaf.read(cursor.pid, pf)) != 0) {
+            return rc;
+        }
+        IoStats::countLevel(pf.getStats(), treeHeight);
+    }
+
+    if ((rc = leaf.readEntry(cursor.eid, key, rid)) != 0) {
+        return rc;
+    }
+    cursor.eid++;
+    return 0;
+}
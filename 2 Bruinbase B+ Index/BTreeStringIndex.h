@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BTREESTRINGINDEX_H
+#define BTREESTRINGINDEX_H
+
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "RecordFile.h"
+#include "BTreeIndex.h"
+#include "BTreeStringNode.h"
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+/**
+ * A (key, RecordId) pair to build a string index from.
+ */
+typedef struct {
+    string   key;
+    RecordId rid;
+} StringIndexEntry;
+
+/**
+ * A B+tree index on string keys, e.g. on the value column of a table.
+ * Keys are compared byte by byte, as SqlEngine compares values.
+ *
+ * A key longer than MAX_KEY_LENGTH is cut to its first MAX_KEY_LENGTH
+ * bytes, so the index tells apart the values that differ in those bytes
+ * only. A lookup finds every entry whose value starts with the cut key,
+ * and the caller checks the values of the tuples it reads.
+ */
+class BTreeStringIndex {
+public:
+    /* the longest key kept in the index. longer keys are cut */
+    static const int MAX_KEY_LENGTH = BTStringLeafNode::MAX_KEY_LENGTH;
+
+    BTreeStringIndex();
+
+    /**
+     * Open the index file in read or write mode.
+     * Under 'w' mode, the index file is created if it does not exist.
+     * @param indexname[IN] the name of the index file
+     * @param mode[IN] 'r' for read, 'w' for write
+     * @return error code. RC_INVALID_FILE_FORMAT if the file is not a
+     *         string index in the layout of this version
+     */
+    RC open(const std::string& indexname, char mode);
+
+    /**
+     * Close the index file.
+     * @return error code. 0 if no error
+     */
+    RC close();
+
+    /**
+     * Insert (key, RecordId) pair to the index.
+     * A key may be inserted many times, with different RecordIds.
+     * @param key[IN] the key. cut to MAX_KEY_LENGTH bytes
+     * @param rid[IN] the RecordId for the record being inserted into the index
+     * @return error code. 0 if no error
+     */
+    RC insert(string_view key, const RecordId& rid);
+
+    /**
+     * Insert many (key, RecordId) pairs to the index at once. An empty index
+     * is built bottom up like BTreeIndex::build(), with each node filled to
+     * the fill factor of BTreeIndex. An index that already has entries
+     * takes the pairs one insert() at a time.
+     * @param entries[IN/OUT] the pairs, in any order. they are sorted
+     * @return error code. 0 if no error
+     */
+    RC build(vector<StringIndexEntry>& entries);
+
+    /**
+     * Find the first entry whose key is not smaller than searchKey, which
+     * may be behind the last entry of its leaf.
+     * @param searchKey[IN] the key to find. cut to MAX_KEY_LENGTH bytes
+     * @param cursor[OUT] the cursor pointing to the entry
+     * @return 0 if the key of the entry is searchKey. Otherwise, an error code
+     */
+    RC locate(string_view searchKey, IndexCursor& cursor);
+
+    /**
+     * Read the (key, rid) pair at the location specified by the index cursor,
+     * and move foward the cursor to the next entry.
+     * @param cursor[IN/OUT] the cursor pointing to an leaf-node index entry in the b+tree
+     * @param key[OUT] the key stored at the index cursor location
+     * @param rid[OUT] the RecordId stored at the index cursor location
+     * @return error code. RC_END_OF_TREE behind the last entry
+     */
+    RC readForward(IndexCursor& cursor, string& key, RecordId& rid);
+
+private:
+    PageFile pf;         /// the PageFile used to store the actual b+tree in disk
+
+    PageId   rootPid;    /// the PageId of the root node
+    int      treeHeight; /// the height of the tree
+    PageId   lastPid;    /// the last page given to a node
+
+    char mode;
+};
+
+#endif /* BTREESTRINGINDEX_H */
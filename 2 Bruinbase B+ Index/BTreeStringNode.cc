@@ -0,0 +1,722 @@
+/*
+ leaf node structure:
+ |# keys(4 byte)|, |PageId(4 byte)|, |heap(4 byte)|, |prefix length(4 byte)|, |slot|slot|..., free space, |key bytes|, |prefix|
+ slot: |offset(2 byte) length(2 byte) RecordId(pid, sid)|, the key without the prefix
+ non-leaf node structure:
+ |# keys(4 byte)|, |PageId(4 byte)|, |heap(4 byte)|, |0(4 byte)|, |slot|slot|..., free space, |key bytes|
+ slot: |offset(2 byte) length(2 byte) PageId(4 byte)|, the PageId is of the child behind the key
+
+ The slots are kept in key order from the front of the page, and the bytes
+ of the keys are stacked from the end of the page towards them. heap is the
+ offset of the lowest key byte. A key is never moved once it is in a node:
+ a split builds both nodes over again, which leaves no holes between keys.
+ An empty key may have an offset of PAGE_SIZE, which wraps to 0 in 2 bytes
+ and is never read.
+
+ The prefix shared by every key of a leaf is at the end of the page. A key
+ without it makes the leaf be built over again under a shorter prefix.
+ The keys of a non-leaf node are mostly short: a leaf split passes up the
+ shortest key that tells the two leaves apart, not the first key of the
+ new leaf.
+ */
+#include "BTreeStringNode.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+static_assert(PageFile::PAGE_SIZE <= 65536, "a key offset must fit in 2 bytes");
+
+// the key count, the next (or first child) pointer, the heap offset and
+// the prefix length
+static const int HEADER_SIZE = 4 * sizeof(int);
+static const int HEAP_OFFSET = 2 * sizeof(int);
+static const int PREFIX_OFFSET = 3 * sizeof(int);
+
+// the slot of a leaf entry and of a non-leaf key
+static const int LEAF_SLOT_SIZE = 2 * sizeof(uint16_t) + sizeof(RecordId);
+static const int NONLEAF_SLOT_SIZE = 2 * sizeof(uint16_t) + sizeof(PageId);
+
+// the most entries a leaf holds, with a key in the prefix alone, and one more
+static const int MAX_LEAF_ENTRIES = (PageFile::PAGE_SIZE - HEADER_SIZE) / LEAF_SLOT_SIZE + 1;
+
+/*
+ * Read and write the int at offset of a node.
+ */
+static int getInt(const char* node, int offset)
+{
+    int value;
+    memcpy(&value, node + offset, sizeof(int));
+    return value;
+}
+
+static void putInt(char* node, int offset, int value)
+{
+    memcpy(node + offset, &value, sizeof(int));
+}
+
+/*
+ * The key of the i'th slot of a node whose slots are slotSize bytes.
+ * In a leaf, the key without the prefix of the node.
+ */
+static string_view slotKey(const char* node, int slotSize, int i)
+{
+    uint16_t offset, length;
+    const char* slot = node + HEADER_SIZE + i * slotSize;
+    memcpy(&offset, slot, sizeof(uint16_t));
+    memcpy(&length, slot + sizeof(uint16_t), sizeof(uint16_t));
+    return string_view(node + offset, length);
+}
+
+/*
+ * The pointer stored in the i'th slot of a node, behind the key.
+ */
+static char* slotPtr(const char* node, int slotSize, int i)
+{
+    return const_cast<char*>(node) + HEADER_SIZE + i * slotSize + 2 * sizeof(uint16_t);
+}
+
+/*
+ * The prefix shared by the keys of a leaf.
+ */
+static string_view leafPrefix(const char* node)
+{
+    int length = getInt(node, PREFIX_OFFSET);
+    return string_view(node + PageFile::PAGE_SIZE - length, length);
+}
+
+/*
+ * Count the keys of a node that are smaller than searchKey, or not larger
+ * than it if upper is set.
+ * @param node[IN] the node
+ * @param slotSize[IN] # bytes of a slot
+ * @param searchKey[IN] the key to look for
+ * @param upper[IN] true to count the keys equal to searchKey too
+ * @return # keys counted
+ */
+static int searchKeys(const char* node, int slotSize, string_view searchKey, bool upper)
+{
+    int lo = 0, hi = getInt(node, 0);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int diff = slotKey(node, slotSize, mid).compare(searchKey);
+        if (diff < 0 || (upper && diff == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Put a key in the i'th slot of a node, moving the slots from i on back
+ * by one, and stack its bytes on the heap. The pointer of the slot is
+ * left for the caller to set. The node MUST have room for the key.
+ */
+static void putKey(char* node, int slotSize, int i, string_view key)
+{
+    int count = getInt(node, 0);
+    int heap = getInt(node, HEAP_OFFSET) - key.size();
+    char* slot = node + HEADER_SIZE + i * slotSize;
+
+    memmove(slot + slotSize, slot, (count - i) * slotSize);
+    memcpy(node + heap, key.data(), key.size());
+    uint16_t offset = heap, length = key.size();
+    memcpy(slot, &offset, sizeof(uint16_t));
+    memcpy(slot + sizeof(uint16_t), &length, sizeof(uint16_t));
+
+    putInt(node, 0, count + 1);
+    putInt(node, HEAP_OFFSET, heap);
+}
+
+/*
+ * @return # bytes left between the slots and the heap of a node
+ */
+static int freeBytes(const char* node, int slotSize)
+{
+    return getInt(node, HEAP_OFFSET) - HEADER_SIZE - getInt(node, 0) * slotSize;
+}
+
+/*
+ * A key of a leaf in two pieces: the prefix of the leaf and the rest.
+ */
+struct SplitKey {
+    string_view head;
+    string_view tail;
+
+    size_t size() const { return head.size() + tail.size(); }
+    char operator[](size_t i) const { return (i < head.size()) ? head[i] : tail[i - head.size()]; }
+
+    // copy length bytes from byte from on to dst
+    void copy(char* dst, size_t from, size_t length) const
+    {
+        if (from < head.size()) {
+            size_t n = min(length, head.size() - from);
+            memcpy(dst, head.data() + from, n);
+            dst += n;
+            length -= n;
+            from = head.size();
+        }
+        if (length > 0) memcpy(dst, tail.data() + (from - head.size()), length);
+    }
+};
+
+/*
+ * @return # bytes at the front of a and b that are the same
+ */
+static size_t commonPrefix(const SplitKey& a, const SplitKey& b)
+{
+    size_t n = min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+/* constructor, an empty node */
+BTStringLeafNode::BTStringLeafNode()
+{
+    buffer = page;
+    pinnedFile = NULL;
+    memset(buffer, 0, PageFile::PAGE_SIZE);
+    putInt(buffer, HEAP_OFFSET, PageFile::PAGE_SIZE);
+}
+
+/* destructor, give the pinned frame back to the buffer pool */
+BTStringLeafNode::~BTStringLeafNode()
+{
+    unpin();
+}
+
+/*
+ * Unpin the frame the node is working on and switch back to the private page.
+ */
+void BTStringLeafNode::unpin()
+{
+    if (pinnedFile != NULL) {
+        pinnedFile->unpin(pinnedPid);
+        pinnedFile = NULL;
+        buffer = page;
+    }
+}
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringLeafNode::read(PageId pid, const PageFile& pf)
+{
+    if (pid == 0) {
+        return RC_INVALID_PID;
+    }
+    unpin();
+    // work on the buffer pool frame in place if one is available
+    if (pf.pin(pid, buffer) == 0) {
+        pinnedFile = &pf;
+        pinnedPid = pid;
+        return 0;
+    }
+    buffer = page;
+    if (pf.read(pid, buffer) < 0) {
+        return RC_FILE_READ_FAILED;
+    }
+    return 0;
+}
+
+/*
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringLeafNode::write(PageId pid, PageFile& pf)
+{
+    return pf.write(pid, buffer);
+}
+
+/*
+ * Return the number of keys stored in the node.
+ * @return the number of keys in the node
+ */
+int BTStringLeafNode::getKeyCount()
+{
+    return getInt(buffer, 0);
+}
+
+/*
+ * @return # bytes the keys, their prefix and the slots take in the node
+ */
+int BTStringLeafNode::getUsedBytes()
+{
+    return PageFile::PAGE_SIZE - HEADER_SIZE - freeBytes(buffer, LEAF_SLOT_SIZE);
+}
+
+/*
+ * Count the keys of the node that are smaller than key, or not larger
+ * than it if upper is set. The prefix of the node is compared first:
+ * unless key starts with it, key is smaller or larger than every key.
+ */
+int BTStringLeafNode::search(string_view key, bool upper)
+{
+    string_view prefix = leafPrefix(buffer);
+    int diff = key.substr(0, prefix.size()).compare(prefix);
+    if (diff < 0) return 0;
+    if (diff > 0) return getKeyCount();
+    return searchKeys(buffer, LEAF_SLOT_SIZE, key.substr(prefix.size()), upper);
+}
+
+/*
+ * Build the node over again from the entries from to to - 1 of the node
+ * old with the (key, rid) pair as its position'th entry.
+ * --------------------------------------------------------------------
+ * Algorithm:
+ 1. the entries are sorted, so the prefix they share is the one the
+    first and the last entries share
+ 2. put the prefix at the end of the page, and the rest of each key
+    on the heap below it
+ */
+void BTStringLeafNode::rebuild(const char* old, int position, string_view key, const RecordId& rid,
+                               int from, int to)
+{
+    string_view oldPrefix = leafPrefix(old);
+
+    // the i'th entry of old with the new one in it
+    auto keyOf = [&](int i) {
+        SplitKey k = { key, string_view() };
+        if (i != position) k = { oldPrefix, slotKey(old, LEAF_SLOT_SIZE, (i < position) ? i : i - 1) };
+        return k;
+    };
+    auto ridOf = [&](int i) {
+        RecordId r = rid;
+        if (i != position) memcpy(&r, slotPtr(old, LEAF_SLOT_SIZE, (i < position) ? i : i - 1), sizeof(RecordId));
+        return r;
+    };
+
+    SplitKey first = keyOf(from);
+    int length = commonPrefix(first, keyOf(to - 1));
+    int heap = PageFile::PAGE_SIZE - length;
+    first.copy(buffer + heap, 0, length);
+    putInt(buffer, 0, 0);
+    putInt(buffer, HEAP_OFFSET, heap);
+    putInt(buffer, PREFIX_OFFSET, length);
+
+    for (int i = from; i < to; i++) {
+        SplitKey k = keyOf(i);
+        RecordId r = ridOf(i);
+        int rest = k.size() - length;
+        char* slot = buffer + HEADER_SIZE + (i - from) * LEAF_SLOT_SIZE;
+        heap -= rest;
+        k.copy(buffer + heap, length, rest);
+        uint16_t offset = heap, size = rest;
+        memcpy(slot, &offset, sizeof(uint16_t));
+        memcpy(slot + sizeof(uint16_t), &size, sizeof(uint16_t));
+        memcpy(slot + 2 * sizeof(uint16_t), &r, sizeof(RecordId));
+    }
+    putInt(buffer, 0, to - from);
+    putInt(buffer, HEAP_OFFSET, heap);
+}
+
+/*
+ * Insert the (key, rid) pair as the position'th entry.
+ * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+ */
+RC BTStringLeafNode::insertAt(int position, string_view key, const RecordId& rid)
+{
+    string_view prefix = leafPrefix(buffer);
+    int count = getKeyCount();
+
+    // a key with the prefix of the node goes in as it is
+    if (count > 0 && key.substr(0, prefix.size()) == prefix) {
+        if (freeBytes(buffer, LEAF_SLOT_SIZE) < LEAF_SLOT_SIZE + (int)(key.size() - prefix.size())) {
+            return RC_NODE_FULL;
+        }
+        putKey(buffer, LEAF_SLOT_SIZE, position, key.substr(prefix.size()));
+        memcpy(slotPtr(buffer, LEAF_SLOT_SIZE, position), &rid, sizeof(RecordId));
+        return 0;
+    }
+
+    // otherwise the bytes the prefix loses are stored in every key.
+    // the first key of an empty node is all prefix
+    int length = commonPrefix({ key, string_view() }, { prefix, string_view() });
+    int used = getUsedBytes() + (count - 1) * (int)(prefix.size() - length)
+               + LEAF_SLOT_SIZE + key.size() - length;
+    if (count > 0 && used > PageFile::PAGE_SIZE - HEADER_SIZE) {
+        return RC_NODE_FULL;
+    }
+    char old[PageFile::PAGE_SIZE];
+    memcpy(old, buffer, PageFile::PAGE_SIZE);
+    rebuild(old, position, key, rid, 0, count + 1);
+    return 0;
+}
+
+/*
+ * Insert the (key, rid) pair to the node, behind the pairs with the same key.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+ */
+RC BTStringLeafNode::insert(string_view key, const RecordId& rid)
+{
+    return insertAt(search(key, true), key, rid);
+}
+
+/*
+ * Insert the (key, rid) pair to the node and split the node with sibling.
+ * @param key[IN] the key to insert
+ * @param rid[IN] the RecordId to insert
+ * @param sibling[IN] the sibling node to split with. it MUST be empty
+ * @param siblingKey[OUT] the shortest key between the two nodes
+ * @return 0 if successful. Return an error code if there is an error.
+ --------------------------------------------------------------------
+ * Algorithm:
+ 1. copy the node aside, and line up its pairs with the new one in key order
+ 2. find the pair to split at, the one that leaves the larger of the two
+    nodes smallest. the size of a node depends on the prefix its keys
+    share, which is the shortest prefix any two neighbouring keys share
+ 3. build this node again from the pairs in front of it, and sibling
+    from the pair on, each under the prefix its keys share
+ 4. the key passed up is the first key of sibling, cut behind the first
+    byte that differs from the last key of this node
+ */
+RC BTStringLeafNode::insertAndSplit(string_view key, const RecordId& rid,
+                                    BTStringLeafNode& sibling, string& siblingKey)
+{
+    char old[PageFile::PAGE_SIZE];
+    memcpy(old, buffer, PageFile::PAGE_SIZE);
+
+    int count = getInt(old, 0);
+    int position = search(key, true);
+    int n = count + 1;
+    string_view oldPrefix = leafPrefix(old);
+
+    // the i'th key of the node with the new one in it
+    auto keyOf = [&](int i) {
+        SplitKey k = { key, string_view() };
+        if (i != position) k = { oldPrefix, slotKey(old, LEAF_SLOT_SIZE, (i < position) ? i : i - 1) };
+        return k;
+    };
+
+    // the size of sibling if it starts at each pair: the keys in full and
+    // the slots, less the prefix for all keys but one
+    int right[MAX_LEAF_ENTRIES];
+    int bytes = 0;
+    int shared = keyOf(n - 1).size();
+    for (int i = n - 1; i >= 1; i--) {
+        if (i < n - 1) shared = min(shared, (int)commonPrefix(keyOf(i), keyOf(i + 1)));
+        bytes += LEAF_SLOT_SIZE + keyOf(i).size();
+        right[i] = bytes - (n - 1 - i) * shared;
+    }
+
+    // the size of this node if it ends in front of each pair
+    int first = 1;
+    int best = INT_MAX;
+    bytes = 0;
+    shared = keyOf(0).size();
+    for (int i = 1; i < n; i++) {
+        if (i > 1) shared = min(shared, (int)commonPrefix(keyOf(i - 2), keyOf(i - 1)));
+        bytes += LEAF_SLOT_SIZE + keyOf(i - 1).size();
+        int larger = max(bytes - (i - 1) * shared, right[i]);
+        if (larger < best) {
+            best = larger;
+            first = i;
+        }
+    }
+
+    SplitKey last = keyOf(first - 1);
+    SplitKey next = keyOf(first);
+    size_t length = min(commonPrefix(last, next) + 1, next.size());
+    siblingKey.resize(length);
+    next.copy(&siblingKey[0], 0, length);
+
+    rebuild(old, position, key, rid, 0, first);
+    sibling.rebuild(old, position, key, rid, first, n);
+    return 0;
+}
+
+/*
+ * Add the (key, rid) pair behind the last entry of the node.
+ * @param key[IN] the key to add
+ * @param rid[IN] the RecordId to add
+ * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+ */
+RC BTStringLeafNode::append(string_view key, const RecordId& rid)
+{
+    return insertAt(getKeyCount(), key, rid);
+}
+
+/*
+ * Find the first entry whose key is not smaller than searchKey.
+ * @param searchKey[IN] the key to search for
+ * @param eid[OUT] the entry number. # keys if every key is smaller
+ * @return 0 if the key of the entry is searchKey. If not, RC_NO_SUCH_RECORD.
+ */
+RC BTStringLeafNode::locate(string_view searchKey, int& eid)
+{
+    string_view prefix = leafPrefix(buffer);
+    eid = search(searchKey, false);
+    if (eid < getKeyCount() && searchKey.substr(0, prefix.size()) == prefix
+        && slotKey(buffer, LEAF_SLOT_SIZE, eid) == searchKey.substr(prefix.size())) {
+        return 0;
+    }
+    return RC_NO_SUCH_RECORD;
+}
+
+/*
+ * Read the (key, rid) pair from the eid entry.
+ * @param eid[IN] the entry number to read the (key, rid) pair from
+ * @param key[OUT] the key of the entry
+ * @param rid[OUT] the RecordId of the entry
+ * @return 0 if successful. Return an error code if there is no such entry.
+ */
+RC BTStringLeafNode::readEntry(int eid, string& key, RecordId& rid)
+{
+    if (eid < 0 || eid >= getKeyCount()) {
+        return RC_INVALID_CURSOR;
+    }
+    key.assign(leafPrefix(buffer));
+    key.append(slotKey(buffer, LEAF_SLOT_SIZE, eid));
+    memcpy(&rid, slotPtr(buffer, LEAF_SLOT_SIZE, eid), sizeof(RecordId));
+    return 0;
+}
+
+/*
+ * Return the pid of the next sibling node.
+ * @return the PageId of the next sibling node
+ */
+PageId BTStringLeafNode::getNextNodePtr()
+{
+    return getInt(buffer, sizeof(int));
+}
+
+/*
+ * Set the pid of the next sibling node.
+ * @param pid[IN] the PageId of the next sibling node
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringLeafNode::setNextNodePtr(PageId pid)
+{
+    putInt(buffer, sizeof(int), pid);
+    return 0;
+}
+
+/* constructor, an empty node */
+BTStringNonLeafNode::BTStringNonLeafNode()
+{
+    buffer = page;
+    pinnedFile = NULL;
+    memset(buffer, 0, PageFile::PAGE_SIZE);
+    putInt(buffer, HEAP_OFFSET, PageFile::PAGE_SIZE);
+}
+
+/* destructor, give the pinned frame back to the buffer pool */
+BTStringNonLeafNode::~BTStringNonLeafNode()
+{
+    unpin();
+}
+
+/*
+ * Unpin the frame the node is working on and switch back to the private page.
+ */
+void BTStringNonLeafNode::unpin()
+{
+    if (pinnedFile != NULL) {
+        pinnedFile->unpin(pinnedPid);
+        pinnedFile = NULL;
+        buffer = page;
+    }
+}
+
+/*
+ * Read the content of the node from the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to read
+ * @param pf[IN] PageFile to read from
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNonLeafNode::read(PageId pid, const PageFile& pf)
+{
+    if (pid == 0) {
+        return RC_INVALID_PID;
+    }
+    unpin();
+    // work on the buffer pool frame in place if one is available
+    if (pf.pin(pid, buffer) == 0) {
+        pinnedFile = &pf;
+        pinnedPid = pid;
+        return 0;
+    }
+    buffer = page;
+    if (pf.read(pid, buffer) < 0) {
+        return RC_FILE_READ_FAILED;
+    }
+    return 0;
+}
+
+/*
+ * Write the content of the node to the page pid in the PageFile pf.
+ * @param pid[IN] the PageId to write to
+ * @param pf[IN] PageFile to write to
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNonLeafNode::write(PageId pid, PageFile& pf)
+{
+    return pf.write(pid, buffer);
+}
+
+/*
+ * Return the number of keys stored in the node.
+ * @return the number of keys in the node
+ */
+int BTStringNonLeafNode::getKeyCount()
+{
+    return getInt(buffer, 0);
+}
+
+/*
+ * @return # bytes the keys and the slots take in the node
+ */
+int BTStringNonLeafNode::getUsedBytes()
+{
+    return PageFile::PAGE_SIZE - HEADER_SIZE - freeBytes(buffer, NONLEAF_SLOT_SIZE);
+}
+
+/*
+ * Empty the node, with pid as its only child.
+ */
+void BTStringNonLeafNode::clear(PageId pid)
+{
+    putInt(buffer, 0, 0);
+    putInt(buffer, sizeof(int), pid);
+    putInt(buffer, HEAP_OFFSET, PageFile::PAGE_SIZE);
+}
+
+/*
+ * Put the (key, pid) pair in the eid'th slot, with pid behind the key.
+ */
+void BTStringNonLeafNode::insertAt(int eid, string_view key, PageId pid)
+{
+    putKey(buffer, NONLEAF_SLOT_SIZE, eid, key);
+    memcpy(slotPtr(buffer, NONLEAF_SLOT_SIZE, eid), &pid, sizeof(PageId));
+}
+
+/*
+ * Insert a (key, pid) pair to the node, right behind the pointer to child.
+ * @param child[IN] the PageId of the child that split
+ * @param key[IN] the key to insert
+ * @param pid[IN] the PageId to insert
+ * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+ */
+RC BTStringNonLeafNode::insert(PageId child, string_view key, PageId pid)
+{
+    if (freeBytes(buffer, NONLEAF_SLOT_SIZE) < NONLEAF_SLOT_SIZE + (int)key.size()) {
+        return RC_NODE_FULL;
+    }
+
+    // the key goes in front of the pointer behind child
+    int count = getKeyCount();
+    int position = 0;
+    if (getInt(buffer, sizeof(int)) != child) {
+        while (position < count && getInt(slotPtr(buffer, NONLEAF_SLOT_SIZE, position), 0) != child) position++;
+        if (position == count) return RC_INVALID_PID;
+        position++;
+    }
+    insertAt(position, key, pid);
+    return 0;
+}
+
+/*
+ * Insert the (key, pid) pair to the node, right behind the pointer to
+ * child, and split the node with sibling.
+ * @param child[IN] the PageId of the child that split
+ * @param key[IN] the key to insert
+ * @param pid[IN] the PageId to insert
+ * @param sibling[IN] the sibling node to split with. it MUST be empty
+ * @param midKey[OUT] the key in the middle, to insert to the parent node
+ * @return 0 if successful. Return an error code if there is an error.
+ --------------------------------------------------------------------
+ * Algorithm:
+ 1. copy the node aside, and line up its keys with the new one, each
+    with the child pointer behind it
+ 2. find the key in the middle of the bytes of all the keys. a node holds
+    at least four keys, so there are keys on both sides of it
+ 3. build this node again from the keys in front of it, and sibling from
+    the pointer behind it and the keys after it
+ */
+RC BTStringNonLeafNode::insertAndSplit(PageId child, string_view key, PageId pid,
+                                       BTStringNonLeafNode& sibling, string& midKey)
+{
+    char old[PageFile::PAGE_SIZE];
+    memcpy(old, buffer, PageFile::PAGE_SIZE);
+
+    int count = getInt(old, 0);
+    int position = 0;
+    if (getInt(old, sizeof(int)) != child) {
+        while (position < count && getInt(slotPtr(old, NONLEAF_SLOT_SIZE, position), 0) != child) position++;
+        if (position == count) return RC_INVALID_PID;
+        position++;
+    }
+    int n = count + 1;
+
+    // the i'th key of the node with the new one in it, and the pointer behind it
+    auto keyOf = [&](int i) {
+        return (i == position) ? key : slotKey(old, NONLEAF_SLOT_SIZE, (i < position) ? i : i - 1);
+    };
+    auto pidOf = [&](int i) {
+        return (i == position) ? pid : getInt(slotPtr(old, NONLEAF_SLOT_SIZE, (i < position) ? i : i - 1), 0);
+    };
+
+    int total = 0;
+    for (int i = 0; i < n; i++) total += NONLEAF_SLOT_SIZE + keyOf(i).size();
+    int mid = 1;
+    int bytes = 2 * NONLEAF_SLOT_SIZE + keyOf(0).size() + keyOf(1).size();
+    while (mid < n - 2 && 2 * bytes < total) {
+        mid++;
+        bytes += NONLEAF_SLOT_SIZE + keyOf(mid).size();
+    }
+
+    clear(getInt(old, sizeof(int)));
+    for (int i = 0; i < mid; i++) insertAt(i, keyOf(i), pidOf(i));
+    sibling.clear(pidOf(mid));
+    for (int i = mid + 1; i < n; i++) sibling.insertAt(i - mid - 1, keyOf(i), pidOf(i));
+    midKey.assign(keyOf(mid));
+    return 0;
+}
+
+/*
+ * Add the (key, pid) pair behind the last key of the node.
+ * @param key[IN] the key to add
+ * @param pid[IN] the PageId to add behind the key
+ * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+ */
+RC BTStringNonLeafNode::append(string_view key, PageId pid)
+{
+    if (freeBytes(buffer, NONLEAF_SLOT_SIZE) < NONLEAF_SLOT_SIZE + (int)key.size()) {
+        return RC_NODE_FULL;
+    }
+    insertAt(getKeyCount(), key, pid);
+    return 0;
+}
+
+/*
+ * Find the child-node pointer to follow for searchKey: the one in front of
+ * the first key not smaller than searchKey.
+ * @param searchKey[IN] the searchKey that is being looked up
+ * @param pid[OUT] the pointer to the child node to follow
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNonLeafNode::locateChildPtr(string_view searchKey, PageId& pid)
+{
+    int i = searchKeys(buffer, NONLEAF_SLOT_SIZE, searchKey, false);
+    pid = (i == 0) ? getInt(buffer, sizeof(int)) : getInt(slotPtr(buffer, NONLEAF_SLOT_SIZE, i - 1), 0);
+    return 0;
+}
+
+/*
+ * Initialize the root node with (pid1, key, pid2).
+ * @param pid1[IN] the first PageId to insert
+ * @param key[IN] the key that should be inserted between the two PageIds
+ * @param pid2[IN] the PageId to insert behind the key
+ * @return 0 if successful. Return an error code if there is an error.
+ */
+RC BTStringNonLeafNode::initializeRoot(PageId pid1, string_view key, PageId pid2)
+{
+    clear(pid1);
+    return append(key, pid2);
+}
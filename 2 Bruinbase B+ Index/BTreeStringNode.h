@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BTREESTRINGNODE_H
+#define BTREESTRINGNODE_H
+
+#include "RecordFile.h"
+#include "PageFile.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+using namespace std;
+
+/**
+ * The layouts of the nodes of a B+tree on string keys, numbered on from
+ * BTNodeFormat so that an index on integer keys is never taken for one
+ * on strings, or the other way around. Only the last layout is read: an
+ * index in an older one is not used until it is loaded again.
+ */
+enum BTStringNodeFormat {
+    BT_STRING_FORMAT_SLOTTED = 2,  // a slot per key, the key bytes at the end of the page
+    BT_STRING_FORMAT_PREFIX = 3    // the same, with the prefix shared by the keys of a
+                                   // leaf stored once, and short non-leaf keys
+};
+
+/**
+ * BTStringLeafNode: a leaf node of a B+tree on string keys.
+ * Each (key, rid) pair has a slot with the place of its key in the page,
+ * so a node holds as many pairs as their keys leave room for.
+ * The prefix shared by the keys of the node is stored once, and each slot
+ * keeps the rest of its key. A search compares the prefix first, and the
+ * rest of the keys only if the prefix matches.
+ */
+class BTStringLeafNode {
+  public:
+   /* the longest key a node takes. any four pairs fit in a node */
+    static const int MAX_KEY_LENGTH = (PageFile::PAGE_SIZE - 4 * sizeof(int)) / 4
+                                      - (2 * sizeof(uint16_t) + sizeof(RecordId));
+
+    BTStringLeafNode();
+
+   /* Destructor. Unpins the frame the node is working on */
+    ~BTStringLeafNode();
+
+   /**
+    * Insert the (key, rid) pair to the node, behind the pairs with the same key.
+    * A key without the prefix of the node makes the prefix shorter, so the
+    * pair may not fit even if there is room for the key itself.
+    * @param key[IN] the key to insert. at most MAX_KEY_LENGTH bytes
+    * @param rid[IN] the RecordId to insert
+    * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+    */
+    RC insert(string_view key, const RecordId& rid);
+
+   /**
+    * Insert the (key, rid) pair to the node and split the node with
+    * sibling, so that each holds about half of the bytes of the keys.
+    * @param key[IN] the key to insert. at most MAX_KEY_LENGTH bytes
+    * @param rid[IN] the RecordId to insert
+    * @param sibling[IN] the sibling node to split with. it MUST be empty
+    * @param siblingKey[OUT] the shortest prefix of the first key in the
+    *                        sibling node that is larger than the last key
+    *                        left in this node, or the first key if the two
+    *                        are equal
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC insertAndSplit(string_view key, const RecordId& rid,
+                      BTStringLeafNode& sibling, string& siblingKey);
+
+   /**
+    * Add the (key, rid) pair behind the last entry of the node, without a
+    * search. The key MUST not be smaller than any key in the node.
+    * @param key[IN] the key to add. at most MAX_KEY_LENGTH bytes
+    * @param rid[IN] the RecordId to add
+    * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+    */
+    RC append(string_view key, const RecordId& rid);
+
+   /**
+    * Find the first entry whose key is not smaller than searchKey.
+    * @param searchKey[IN] the key to search for
+    * @param eid[OUT] the entry number. # keys if every key is smaller
+    * @return 0 if the key of the entry is searchKey. If not, RC_NO_SUCH_RECORD.
+    */
+    RC locate(string_view searchKey, int& eid);
+
+   /**
+    * Read the (key, rid) pair from the eid entry.
+    * @param eid[IN] the entry number to read the (key, rid) pair from
+    * @param key[OUT] the key of the entry, the prefix of the node and the rest
+    * @param rid[OUT] the RecordId of the entry
+    * @return 0 if successful. Return an error code if there is no such entry.
+    */
+    RC readEntry(int eid, string& key, RecordId& rid);
+
+   /**
+    * @return the PageId of the next sibling node. 0 if there is none
+    */
+    PageId getNextNodePtr();
+
+   /**
+    * Set the next sibling node PageId.
+    * @param pid[IN] the PageId of the next sibling node
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC setNextNodePtr(PageId pid);
+
+   /**
+    * @return the number of keys in the node
+    */
+    int getKeyCount();
+
+   /**
+    * @return # bytes the keys, their prefix and the slots take in the node
+    */
+    int getUsedBytes();
+
+   /**
+    * Read the content of the node from the page pid in the PageFile pf.
+    * The node works on the buffer pool frame of the page in place while
+    * it stays pinned, so changes must be written back with write().
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC read(PageId pid, const PageFile& pf);
+
+   /**
+    * Write the content of the node to the page pid in the PageFile pf.
+    * @param pid[IN] the PageId to write to
+    * @param pf[IN] PageFile to write to
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC write(PageId pid, PageFile& pf);
+
+  private:
+   /**
+    * Unpin the buffer pool frame the node is working on, if any,
+    * and switch back to the private page.
+    */
+    void unpin();
+
+   /**
+    * Count the keys of the node that are smaller than key, or not larger
+    * than it if upper is set.
+    */
+    int search(string_view key, bool upper);
+
+   /**
+    * Insert the (key, rid) pair as the position'th entry, with the
+    * prefix of the node cut to the part key shares.
+    * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+    */
+    RC insertAt(int position, string_view key, const RecordId& rid);
+
+   /**
+    * Build the node over again from the entries from to to - 1 of the
+    * node old with the (key, rid) pair as its position'th entry, under
+    * the longest prefix the entries share. The next pointer is kept.
+    * The entries MUST fit in the node.
+    */
+    void rebuild(const char* old, int position, string_view key, const RecordId& rid,
+                 int from, int to);
+
+   /**
+    * The content of the node. It points either to a pinned buffer pool
+    * frame of the disk page that contains the node, or to page.
+    */
+    char* buffer;
+
+   /**
+    * The main memory buffer for the node when it is not pinned.
+    */
+    char page[PageFile::PAGE_SIZE];
+
+    const PageFile* pinnedFile;  // the file of the pinned frame. NULL if none
+    PageId          pinnedPid;   // the page of the pinned frame
+
+    // a copy would unpin the frame twice
+    BTStringLeafNode(const BTStringLeafNode&);
+    BTStringLeafNode& operator=(const BTStringLeafNode&);
+};
+
+
+/**
+ * BTStringNonLeafNode: a non-leaf node of a B+tree on string keys.
+ * Each key has a slot with the place of the key in the page and the
+ * child pointer behind the key.
+ */
+class BTStringNonLeafNode {
+  public:
+    BTStringNonLeafNode();
+
+   /* Destructor. Unpins the frame the node is working on */
+    ~BTStringNonLeafNode();
+
+   /**
+    * Insert a (key, pid) pair to the node, right behind the pointer to
+    * child: pid is the new node that child split off.
+    * @param child[IN] the PageId of the child that split
+    * @param key[IN] the key to insert
+    * @param pid[IN] the PageId to insert
+    * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+    */
+    RC insert(PageId child, string_view key, PageId pid);
+
+   /**
+    * Insert the (key, pid) pair to the node, right behind the pointer to
+    * child, and split the node with sibling, so that each holds about
+    * half of the bytes of the keys. The key in the middle goes to neither.
+    * @param child[IN] the PageId of the child that split
+    * @param key[IN] the key to insert
+    * @param pid[IN] the PageId to insert
+    * @param sibling[IN] the sibling node to split with. it MUST be empty
+    * @param midKey[OUT] the key in the middle, to insert to the parent node
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC insertAndSplit(PageId child, string_view key, PageId pid,
+                      BTStringNonLeafNode& sibling, string& midKey);
+
+   /**
+    * Add the (key, pid) pair behind the last key of the node, without a
+    * search. The key MUST not be smaller than any key in the node.
+    * @param key[IN] the key to add
+    * @param pid[IN] the PageId to add behind the key
+    * @return 0 if successful. RC_NODE_FULL if there is no room for the pair.
+    */
+    RC append(string_view key, PageId pid);
+
+   /**
+    * Given the searchKey, find the child-node pointer to follow. Keys
+    * equal to searchKey may be found in more than one child; the pointer
+    * is to the first of them.
+    * @param searchKey[IN] the searchKey that is being looked up
+    * @param pid[OUT] the pointer to the child node to follow
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC locateChildPtr(string_view searchKey, PageId& pid);
+
+   /**
+    * Initialize the root node with (pid1, key, pid2).
+    * @param pid1[IN] the first PageId to insert
+    * @param key[IN] the key that should be inserted between the two PageIds
+    * @param pid2[IN] the PageId to insert behind the key
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC initializeRoot(PageId pid1, string_view key, PageId pid2);
+
+   /**
+    * @return the number of keys in the node
+    */
+    int getKeyCount();
+
+   /**
+    * @return # bytes the keys and the slots take in the node
+    */
+    int getUsedBytes();
+
+   /**
+    * Read the content of the node from the page pid in the PageFile pf.
+    * The node works on the buffer pool frame of the page in place while
+    * it stays pinned, so changes must be written back with write().
+    * @param pid[IN] the PageId to read
+    * @param pf[IN] PageFile to read from
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC read(PageId pid, const PageFile& pf);
+
+   /**
+    * Write the content of the node to the page pid in the PageFile pf.
+    * @param pid[IN] the PageId to write to
+    * @param pf[IN] PageFile to write to
+    * @return 0 if successful. Return an error code if there is an error.
+    */
+    RC write(PageId pid, PageFile& pf);
+
+  private:
+   /**
+    * Unpin the buffer pool frame the node is working on, if any,
+    * and switch back to the private page.
+    */
+    void unpin();
+
+   /**
+    * Empty the node, with pid as its only child.
+    */
+    void clear(PageId pid);
+
+   /**
+    * Put the (key, pid) pair in the eid'th slot, with pid behind the key,
+    * moving the slots from eid on back by one. The node MUST have room for it.
+    */
+    void insertAt(int eid, string_view key, PageId pid);
+
+   /**
+    * The content of the node. It points either to a pinned buffer pool
+    * frame of the disk page that contains the node, or to page.
+    */
+    char* buffer;
+
+   /**
+    * The main memory buffer for the node when it is not pinned.
+    */
+    char page[PageFile::PAGE_SIZE];
+
+    const PageFile* pinnedFile;  // the file of the pinned frame. NULL if none
+    PageId          pinnedPid;   // the page of the pinned frame
+
+    // a copy would unpin the frame twice
+    BTStringNonLeafNode(const BTStringNonLeafNode&);
+    BTStringNonLeafNode& operator=(const BTStringNonLeafNode&);
+};
+
+#endif /* BTREESTRINGNODE_H */
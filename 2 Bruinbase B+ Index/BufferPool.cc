@@ -0,0 +1,597 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "BufferPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using std::vector;
+
+BufferPool::BufferPool(size_t capacity)
+{
+  arena = NULL;
+  frames = NULL;
+  shards = NULL;
+  policyKind = ReplacementPolicy::POLICY_LRU;
+  if (init(capacity) < 0) init(PageFile::PAGE_SIZE);
+}
+
+BufferPool::~BufferPool()
+{
+  destroy();
+}
+
+RC BufferPool::setCapacity(size_t capacity)
+{
+  return rebuild(capacity, policyKind);
+}
+
+RC BufferPool::setPolicy(ReplacementPolicy::Kind kind)
+{
+  return rebuild(capacity, kind);
+}
+
+unsigned long long BufferPool::getHitCount()
+{
+  unsigned long long n = 0;
+  for (int s = 0; s < shardCount; s++) {
+    std::lock_guard<std::mutex> lock(shards[s].latch);
+    n += shards[s].hits;
+  }
+  return n;
+}
+
+unsigned long long BufferPool::getMissCount()
+{
+  unsigned long long n = 0;
+  for (int s = 0; s < shardCount; s++) {
+    std::lock_guard<std::mutex> lock(shards[s].latch);
+    n += shards[s].misses;
+  }
+  return n;
+}
+
+RC BufferPool::rebuild(size_t capacity, ReplacementPolicy::Kind kind)
+{
+  RC rc;
+
+  // dirty pages go to the disk before their frames are dropped
+  if ((rc = flushAll()) < 0) return rc;
+
+  // frames handed out to callers must stay where they are
+  for (int i = 0; i < frameCount; i++) {
+    if (frames[i].pinCount > 0 || frames[i].busy) return RC_FRAME_PINNED;
+  }
+
+  size_t oldCapacity = this->capacity;
+  ReplacementPolicy::Kind oldKind = policyKind;
+  destroy();
+  policyKind = kind;
+  if (init(capacity) < 0) {
+    policyKind = oldKind;
+    init(oldCapacity);
+    return RC_OUT_OF_MEMORY;
+  }
+  return 0;
+}
+
+RC BufferPool::init(size_t capacity)
+{
+  // we need at least one frame
+  frameCount = capacity / PageFile::PAGE_SIZE;
+  if (frameCount < 1) frameCount = 1;
+  this->capacity = (size_t)frameCount * PageFile::PAGE_SIZE;
+
+  shardCount = std::min(frameCount, (int)SHARD_COUNT);
+
+  // every frame is aligned to its size, as direct I/O requires
+  void* memory;
+  arena = NULL;
+  if (posix_memalign(&memory, PageFile::DIRECT_ALIGNMENT, this->capacity) == 0) {
+    arena = (char*)memory;
+  }
+  frames = (Frame*)malloc(frameCount * sizeof(Frame));
+  shards = new Shard[shardCount];
+  for (int s = 0; s < shardCount; s++) shards[s].policy = NULL;
+  if (arena == NULL || frames == NULL) {
+    destroy();
+    return RC_OUT_OF_MEMORY;
+  }
+
+  int perShard = frameCount / shardCount;
+  for (int s = 0; s < shardCount; s++) {
+    Shard& shard = shards[s];
+    shard.begin = s * perShard;
+    shard.end = (s == shardCount - 1) ? frameCount : shard.begin + perShard;
+
+    // use twice as many buckets as frames to keep the chains short
+    int bucketCount = 1;
+    while (bucketCount < 2 * (shard.end - shard.begin)) bucketCount <<= 1;
+    shard.bucketMask = bucketCount - 1;
+    shard.buckets = (int*)malloc(bucketCount * sizeof(int));
+    if (shard.buckets == NULL) {
+      destroy();
+      return RC_OUT_OF_MEMORY;
+    }
+    for (int i = 0; i < bucketCount; i++) shard.buckets[i] = -1;
+
+    // all frames start on the free list
+    for (int i = shard.begin; i < shard.end; i++) {
+      frames[i].fd = -1;
+      frames[i].pid = 0;
+      frames[i].pinCount = 0;
+      frames[i].dirty = false;
+      frames[i].busy = false;
+      frames[i].version = 0;
+      frames[i].shard = s;
+      frames[i].hashNext = (i + 1 < shard.end) ? i + 1 : -1;
+      frames[i].stats = NULL;
+    }
+    shard.freeList = shard.begin;
+    shard.policy = ReplacementPolicy::create(policyKind, shard.begin, shard.end);
+    shard.hits = shard.misses = 0;
+  }
+
+  return 0;
+}
+
+void BufferPool::destroy()
+{
+  if (shards != NULL) {
+    for (int s = 0; s < shardCount; s++) {
+      free(shards[s].buckets);
+      delete shards[s].policy;
+    }
+    delete[] shards;
+  }
+  free(arena);
+  free(frames);
+  arena = NULL;
+  frames = NULL;
+  shards = NULL;
+  frameCount = 0;
+  shardCount = 0;
+}
+
+BufferPool::Shard& BufferPool::shardOf(int fd, PageId pid)
+{
+  unsigned h = (unsigned)pid * 2654435761u ^ (unsigned)fd * 40503u;
+  return shards[(h >> 16) % shardCount];
+}
+
+int BufferPool::bucketOf(const Shard& s, int fd, PageId pid) const
+{
+  // mix the two ids so that consecutive pages spread over the buckets
+  unsigned h = (unsigned)pid * 2654435761u ^ (unsigned)fd * 40503u;
+  return (h ^ (h >> 16)) & s.bucketMask;
+}
+
+int BufferPool::find(Shard& s, int fd, PageId pid)
+{
+  for (int i = s.buckets[bucketOf(s, fd, pid)]; i >= 0; i = frames[i].hashNext) {
+    if (frames[i].fd == fd && frames[i].pid == pid) return i;
+  }
+  return -1;
+}
+
+int BufferPool::victim(Shard& s)
+{
+  int frame = s.freeList;
+
+  if (frame >= 0) {
+    s.freeList = frames[frame].hashNext;
+    return frame;
+  }
+
+  // let the policy pick among the frames that nobody holds
+  return s.policy->victim(*this);
+}
+
+int BufferPool::fetch(int fd, PageId pid, Fetch mode, IoStats* stats)
+{
+  Shard& s = shardOf(fd, pid);
+  std::unique_lock<std::mutex> lock(s.latch);
+
+  for (;;) {
+    int frame = find(s, fd, pid);
+
+    if (frame >= 0) {
+      // the page is there or on its way
+      if (mode == FETCH_FILL) return -1;
+
+      // somebody else is reading or writing the page. wait for it
+      if (frames[frame].busy) {
+        s.ready.wait(lock);
+        continue;
+      }
+      s.policy->access(frame);
+      if (mode == FETCH_READ) {
+        s.hits++;
+        IoStats::count(stats, IoStats::CACHE_HITS);
+      }
+      frames[frame].pinCount++;
+      return frame;
+    }
+
+    if (mode == FETCH_CACHED) return -1;
+
+    if ((frame = victim(s)) < 0) return RC_FRAME_PINNED;
+
+    if (frames[frame].dirty) {
+      // write back the dirty pages of the victim's file in one batch.
+      // the latch is released meanwhile, so start over afterwards
+      int vfd = frames[frame].fd;
+      frames[frame].pinCount++;
+      lock.unlock();
+      RC rc = flushFile(vfd);
+      lock.lock();
+      frames[frame].pinCount--;
+      if (rc < 0) return rc;
+      continue;
+    }
+
+    // take the frame over for the new page
+    install(s, frame, fd, pid, stats);
+
+    if (mode == FETCH_OVERWRITE) return frame;
+    if (mode == FETCH_FILL) {
+      frames[frame].busy = true;
+      return frame;
+    }
+    s.misses++;
+
+    // read the page without holding the latch
+    frames[frame].busy = true;
+    lock.unlock();
+    unsigned long long start = IoStats::now();
+    ssize_t n = ::pread(fd, data(frame), PageFile::PAGE_SIZE, (off_t)pid * PageFile::PAGE_SIZE);
+    IoStats::countSyscall(stats, start);
+    if (n >= 0 && n < PageFile::PAGE_SIZE) {
+      // the page lies beyond the end of the file
+      memset(data(frame) + n, 0, PageFile::PAGE_SIZE - n);
+    }
+    lock.lock();
+    frames[frame].busy = false;
+    s.ready.notify_all();
+
+    if (n < 0) {
+      release(s, frame);
+      return RC_FILE_READ_FAILED;
+    }
+
+    IoStats::count(stats, IoStats::PHYSICAL_READS);
+    IoStats::count(stats, IoStats::BYTES_READ, n);
+
+    return frame;
+  }
+}
+
+int BufferPool::readAhead(int fd, PageId first, int count, IoStats* stats)
+{
+  int run[IOV_MAX];
+  int n = 0, total = 0;
+  PageId start = first;
+  RC rc;
+
+  // leave most of the pool to the pages that are in use
+  count = std::min(count, frameCount / 2);
+
+  for (int i = 0; i < count; i++) {
+    PageId pid = first + i;
+    int frame = claim(fd, pid, stats);
+
+    if (frame == RC_FRAME_PINNED) break;
+    if (frame >= 0) {
+      if (n == 0) start = pid;
+      run[n++] = frame;
+      if (n < IOV_MAX) continue;
+    }
+
+    // the run ends at a cached page or when the iovec is full
+    if (n > 0) {
+      if ((rc = readRun(fd, start, run, n)) < 0) return rc;
+      total += n;
+      n = 0;
+    }
+  }
+
+  if (n > 0) {
+    if ((rc = readRun(fd, start, run, n)) < 0) return rc;
+    total += n;
+  }
+  return total;
+}
+
+// the reads started by one prefetch() call. it is freed by the
+// completion of the last read
+struct PrefetchBatch {
+  BufferPool*        pool;
+  std::atomic<int>   left;   // # of reads that have not completed
+  IoStats*           query;  // the stats of the query that asked for the pages
+  unsigned long long start;  // the time the reads were submitted
+  vector<IoRequest>  reqs;
+};
+
+int BufferPool::prefetch(int fd, const PageId* pids, int n, IoStats* stats)
+{
+  PrefetchBatch* batch = new PrefetchBatch;
+  batch->pool = this;
+  batch->query = IoStats::current();
+  batch->reqs.reserve(n);
+
+  for (int i = 0; i < n; i++) {
+    int frame = claim(fd, pids[i], stats);
+    if (frame == RC_FRAME_PINNED) break;
+    if (frame < 0) continue;
+
+    IoRequest req;
+    memset(&req, 0, sizeof(req));
+    req.fd = fd;
+    req.buffer = data(frame);
+    req.length = PageFile::PAGE_SIZE;
+    req.offset = (off_t)pids[i] * PageFile::PAGE_SIZE;
+    req.complete = prefetched;
+    req.arg = batch;
+    req.tag = frame;
+    batch->reqs.push_back(req);
+  }
+
+  int count = batch->reqs.size();
+  if (count == 0) {
+    delete batch;
+    return 0;
+  }
+  batch->left = count;
+  batch->start = IoStats::now();
+
+  // the batch may be gone as soon as submit() returns. when submit()
+  // fails, the reads it could not start complete with an error, and
+  // prefetched() releases their frames
+  RC rc = IoEngine::instance().submit(&batch->reqs[0], count);
+  return (rc < 0) ? rc : count;
+}
+
+void BufferPool::prefetched(IoRequest* req)
+{
+  PrefetchBatch* batch = (PrefetchBatch*)req->arg;
+  BufferPool* pool = batch->pool;
+  Frame& f = pool->frames[req->tag];
+  Shard& s = pool->shards[f.shard];
+
+  // the frame may be reused once it is no longer busy
+  IoStats* stats = f.stats;
+  IoStats::countSyscall(stats, batch->start, batch->query);
+  if (req->result >= PageFile::PAGE_SIZE) {
+    IoStats::count(stats, IoStats::PHYSICAL_READS, 1, batch->query);
+    IoStats::count(stats, IoStats::READ_AHEAD, 1, batch->query);
+    IoStats::count(stats, IoStats::BYTES_READ, req->result, batch->query);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(s.latch);
+    f.busy = false;
+    // a page that could not be read is not kept
+    if (req->result < PageFile::PAGE_SIZE) pool->release(s, req->tag);
+    s.ready.notify_all();
+  }
+  if (--batch->left == 0) delete batch;
+}
+
+int BufferPool::claim(int fd, PageId pid, IoStats* stats)
+{
+  Shard& s = shardOf(fd, pid);
+  std::lock_guard<std::mutex> lock(s.latch);
+
+  if (find(s, fd, pid) >= 0) return -1;
+
+  // only a clean frame can be taken without a write-back
+  int frame = victim(s);
+  if (frame < 0 || frames[frame].dirty) return RC_FRAME_PINNED;
+
+  install(s, frame, fd, pid, stats);
+  frames[frame].pinCount = 0;
+  frames[frame].busy = true;
+  return frame;
+}
+
+int BufferPool::readRun(int fd, PageId first, const int* run, int n)
+{
+  struct iovec iov[IOV_MAX];
+
+  for (int i = 0; i < n; i++) {
+    iov[i].iov_base = data(run[i]);
+    iov[i].iov_len = PageFile::PAGE_SIZE;
+  }
+  IoStats* stats = frames[run[0]].stats;
+  unsigned long long start = IoStats::now();
+  ssize_t got = ::preadv(fd, iov, n, (off_t)first * PageFile::PAGE_SIZE);
+  IoStats::countSyscall(stats, start);
+  if (got > 0) {
+    int pages = got / PageFile::PAGE_SIZE;
+    IoStats::count(stats, IoStats::PHYSICAL_READS, pages);
+    IoStats::count(stats, IoStats::READ_AHEAD, pages);
+    IoStats::count(stats, IoStats::BYTES_READ, (unsigned long long)pages * PageFile::PAGE_SIZE);
+  }
+
+  // a page beyond the end of the file or a failed read is not kept
+  for (int i = 0; i < n; i++) {
+    Frame& f = frames[run[i]];
+    Shard& s = shards[f.shard];
+    std::lock_guard<std::mutex> lock(s.latch);
+    f.busy = false;
+    if (got < (ssize_t)(i + 1) * PageFile::PAGE_SIZE) release(s, run[i]);
+    s.ready.notify_all();
+  }
+  return (got < 0) ? RC_FILE_READ_FAILED : 0;
+}
+
+void BufferPool::unpin(int frame)
+{
+  Shard& s = shards[frames[frame].shard];
+  std::lock_guard<std::mutex> lock(s.latch);
+  frames[frame].pinCount--;
+}
+
+void BufferPool::filled(int frame)
+{
+  Shard& s = shards[frames[frame].shard];
+  std::lock_guard<std::mutex> lock(s.latch);
+  frames[frame].busy = false;
+  s.ready.notify_all();
+}
+
+void BufferPool::unpin(int fd, PageId pid)
+{
+  Shard& s = shardOf(fd, pid);
+  std::lock_guard<std::mutex> lock(s.latch);
+  int frame = find(s, fd, pid);
+  if (frame >= 0 && frames[frame].pinCount > 0) frames[frame].pinCount--;
+}
+
+void BufferPool::setDirty(int frame)
+{
+  Shard& s = shards[frames[frame].shard];
+  std::lock_guard<std::mutex> lock(s.latch);
+  frames[frame].dirty = true;
+  frames[frame].version++;
+}
+
+// a dirty frame picked for write-back
+struct FlushEntry {
+  PageId   pid;
+  int      frame;
+  unsigned version;
+  IoStats* stats;
+  bool operator<(const FlushEntry& e) const { return pid < e.pid; }
+};
+
+RC BufferPool::flushFile(int fd)
+{
+  vector<FlushEntry> dirty;
+  struct iovec iov[IOV_MAX];
+  RC rc = 0;
+
+  // mark the dirty pages of the file busy so that nobody evicts them
+  for (int s = 0; s < shardCount; s++) {
+    std::lock_guard<std::mutex> lock(shards[s].latch);
+    for (int i = shards[s].begin; i < shards[s].end; i++) {
+      if (frames[i].fd == fd && frames[i].dirty && !frames[i].busy) {
+        FlushEntry e = { frames[i].pid, i, frames[i].version, frames[i].stats };
+        frames[i].busy = true;
+        dirty.push_back(e);
+      }
+    }
+  }
+  std::sort(dirty.begin(), dirty.end());
+
+  // write each run of consecutive pages with one system call
+  unsigned done = 0;
+  while (done < dirty.size()) {
+    PageId first = dirty[done].pid;
+    int n = 0;
+    while (done + n < dirty.size() && n < IOV_MAX && dirty[done + n].pid == first + n) {
+      iov[n].iov_base = data(dirty[done + n].frame);
+      iov[n].iov_len = PageFile::PAGE_SIZE;
+      n++;
+    }
+    unsigned long long start = IoStats::now();
+    ssize_t written = ::pwritev(fd, iov, n, (off_t)first * PageFile::PAGE_SIZE);
+    IoStats::countSyscall(dirty[done].stats, start);
+    if (written < (ssize_t)n * PageFile::PAGE_SIZE) {
+      rc = RC_FILE_WRITE_FAILED;
+      break;
+    }
+    IoStats::count(dirty[done].stats, IoStats::PHYSICAL_WRITES, n);
+    IoStats::count(dirty[done].stats, IoStats::BYTES_WRITTEN, written);
+    done += n;
+  }
+
+  // a page modified while it was being written stays dirty
+  for (unsigned i = 0; i < dirty.size(); i++) {
+    Frame& f = frames[dirty[i].frame];
+    Shard& s = shards[f.shard];
+    std::lock_guard<std::mutex> lock(s.latch);
+    if (i < done && f.version == dirty[i].version) f.dirty = false;
+    f.busy = false;
+    s.ready.notify_all();
+  }
+
+  return rc;
+}
+
+RC BufferPool::flushAll()
+{
+  RC rc;
+  vector<int> fds;
+
+  for (int s = 0; s < shardCount; s++) {
+    std::lock_guard<std::mutex> lock(shards[s].latch);
+    for (int i = shards[s].begin; i < shards[s].end; i++) {
+      if (frames[i].dirty) fds.push_back(frames[i].fd);
+    }
+  }
+  std::sort(fds.begin(), fds.end());
+  fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+
+  for (unsigned i = 0; i < fds.size(); i++) {
+    if ((rc = flushFile(fds[i])) < 0) return rc;
+  }
+  return 0;
+}
+
+void BufferPool::releaseFile(int fd)
+{
+  for (int s = 0; s < shardCount; s++) {
+    std::unique_lock<std::mutex> lock(shards[s].latch);
+    for (int i = shards[s].begin; i < shards[s].end; i++) {
+      if (frames[i].fd != fd) continue;
+      // let a write-back started by another thread finish first
+      while (frames[i].busy) shards[s].ready.wait(lock);
+      if (frames[i].fd == fd) release(shards[s], i);
+    }
+  }
+}
+
+void BufferPool::install(Shard& s, int frame, int fd, PageId pid, IoStats* stats)
+{
+  if (frames[frame].fd >= 0) {
+    hashRemove(s, frame);
+    s.policy->remove(frame);
+  }
+  frames[frame].fd = fd;
+  frames[frame].pid = pid;
+  frames[frame].pinCount = 1;
+  frames[frame].dirty = false;
+  frames[frame].stats = stats;
+  int b = bucketOf(s, fd, pid);
+  frames[frame].hashNext = s.buckets[b];
+  s.buckets[b] = frame;
+  s.policy->insert(frame, fd, pid);
+}
+
+void BufferPool::release(Shard& s, int frame)
+{
+  hashRemove(s, frame);
+  s.policy->remove(frame);
+  frames[frame].fd = -1;
+  frames[frame].pinCount = 0;
+  frames[frame].dirty = false;
+  frames[frame].hashNext = s.freeList;
+  s.freeList = frame;
+}
+
+void BufferPool::hashRemove(Shard& s, int frame)
+{
+  int* link = &s.buckets[bucketOf(s, frames[frame].fd, frames[frame].pid)];
+  while (*link != frame) link = &frames[*link].hashNext;
+  *link = frames[frame].hashNext;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <condition_variable>
+#include <mutex>
+#include "Bruinbase.h"
+#include "PageFile.h"
+#include "IoEngine.h"
+#include "IoStats.h"
+#include "ReplacementPolicy.h"
+
+/**
+ * A fixed-capacity pool of page frames shared by all PageFiles.
+ *
+ * The frames are split into shards. A page always lives in the shard
+ * picked by hashing (fd, pid), and each shard has its own latch, hash
+ * table and replacement policy, so threads reading different pages
+ * rarely wait for each other. Disk I/O is done without holding a latch; a frame
+ * that is being read or written is marked busy and other threads wait
+ * for it instead.
+ *
+ * A pinned frame is never evicted, so its memory can be used in place
+ * until it is unpinned. A dirty frame is written back before it is
+ * reused, together with the other dirty pages of its file.
+ */
+class BufferPool {
+ public:
+
+  static const size_t DEFAULT_CAPACITY = 16 * 1024 * 1024; // 16MB
+  static const int    SHARD_COUNT = 16;
+
+  /**
+   * what fetch() does with a page that is not in the pool
+   */
+  enum Fetch {
+    FETCH_READ,       // read it from the disk
+    FETCH_OVERWRITE,  // take a frame without reading. the caller fills it
+    FETCH_CACHED,     // return -1
+    FETCH_FILL        // like FETCH_OVERWRITE, but other threads wait for
+                      // the page until filled(). -1 if the page is cached
+  };
+
+  BufferPool(size_t capacity = DEFAULT_CAPACITY);
+  ~BufferPool();
+
+  /**
+   * change the capacity of the pool. all cached pages are dropped.
+   * no other thread may use the pool during the call.
+   * @param capacity[IN] the size of the pool in bytes
+   * @return error code. 0 if no error
+   */
+  RC setCapacity(size_t capacity);
+
+  /**
+   * @return the size of the pool in bytes
+   */
+  size_t getCapacity() const { return capacity; }
+
+  /**
+   * change the replacement policy of the pool. all cached pages are
+   * dropped. no other thread may use the pool during the call.
+   * @param kind[IN] the new policy
+   * @return error code. 0 if no error
+   */
+  RC setPolicy(ReplacementPolicy::Kind kind);
+
+  /**
+   * @return the replacement policy of the pool
+   */
+  ReplacementPolicy::Kind getPolicy() const { return policyKind; }
+
+  /**
+   * @return # of fetch() calls in FETCH_READ mode that found the page
+   *         in the pool
+   */
+  unsigned long long getHitCount();
+
+  /**
+   * @return # of fetch() calls in FETCH_READ mode that read the page
+   */
+  unsigned long long getMissCount();
+
+  /**
+   * find a page in the pool, bringing it in if necessary, and pin it.
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page id in the file
+   * @param mode[IN] what to do when the page is not cached
+   * @param stats[IN] the stats of the file. may be NULL
+   * @return the pinned frame. -1 if the page is not cached in
+   *         FETCH_CACHED mode or is cached in FETCH_FILL mode.
+   *         RC_FRAME_PINNED if no frame can be freed.
+   *         another negative error code on I/O error
+   */
+  int fetch(int fd, PageId pid, Fetch mode, IoStats* stats);
+
+  /**
+   * bring a run of pages into the pool ahead of their use without pinning
+   * them. pages that are already cached are skipped, and each run of
+   * consecutive missing pages is read with a single system call.
+   * read-ahead gives up quietly when no clean frame is available.
+   * @param fd[IN] the file descriptor of the pages
+   * @param first[IN] the first page id of the run
+   * @param count[IN] # of pages in the run
+   * @param stats[IN] the stats of the file. may be NULL
+   * @return # of pages read from the disk or a negative error code
+   */
+  int readAhead(int fd, PageId first, int count, IoStats* stats);
+
+  /**
+   * start reading a set of pages into the pool and return without
+   * waiting for them. a thread that fetches one of the pages before it
+   * has arrived waits for that page only. pages that are cached already
+   * are skipped, and so are the rest when no clean frame is available.
+   * @param fd[IN] the file descriptor of the pages
+   * @param pids[IN] the page ids
+   * @param n[IN] # of page ids
+   * @param stats[IN] the stats of the file. may be NULL
+   * @return # of reads started or a negative error code
+   */
+  int prefetch(int fd, const PageId* pids, int n, IoStats* stats);
+
+  /**
+   * unpin a frame returned by fetch().
+   * @param frame[IN] the frame
+   */
+  void unpin(int frame);
+
+  /**
+   * unpin the frame of a cached page.
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page id
+   */
+  void unpin(int fd, PageId pid);
+
+  /**
+   * let the other threads use a frame taken with FETCH_FILL.
+   * the frame stays pinned.
+   * @param frame[IN] the frame, filled by now
+   */
+  void filled(int frame);
+
+  /**
+   * mark a pinned frame as modified. it is written back later.
+   * @param frame[IN] the frame
+   */
+  void setDirty(int frame);
+
+  /**
+   * write back the dirty pages of a file in page-id order.
+   * adjacent pages are written with a single system call.
+   * @param fd[IN] the file descriptor
+   * @return error code. 0 if no error
+   */
+  RC flushFile(int fd);
+
+  /**
+   * write back the dirty pages of every file.
+   * @return error code. 0 if no error
+   */
+  RC flushAll();
+
+  /**
+   * drop every cached page of a file. dirty pages are discarded,
+   * so the file must be flushed first.
+   * @param fd[IN] the file descriptor
+   */
+  void releaseFile(int fd);
+
+  /**
+   * @return the memory of the frame. it is PageFile::PAGE_SIZE bytes long
+   */
+  char* data(int frame) { return arena + (size_t)frame * PageFile::PAGE_SIZE; }
+
+  /**
+   * @param frame[IN] the frame
+   * @return true if the frame is neither pinned nor being read or written.
+   *         the latch of the frame's shard must be held
+   */
+  bool evictable(int frame) const { return frames[frame].pinCount == 0 && !frames[frame].busy; }
+
+ private:
+  struct Frame {
+    int      fd;        // file descriptor of the cached page. -1 if free
+    PageId   pid;       // page id of the cached page
+    int      pinCount;  // # of users currently holding the frame
+    bool     dirty;     // true if the frame is newer than the disk page
+    bool     busy;      // true while the frame is read or written back
+    unsigned version;   // bumped on every setDirty()
+    int      shard;     // the shard the frame belongs to
+    int      hashNext;  // next frame in the same hash bucket
+    IoStats* stats;     // the stats of the file of the cached page
+  };
+
+  struct Shard {
+    std::mutex latch;               // protects the frames of the shard
+    std::condition_variable ready;  // signaled when a busy frame is done
+    int  begin, end;   // the frames [begin, end) belong to the shard
+    int* buckets;      // hash bucket heads. -1 if empty
+    int  bucketMask;   // (# of buckets - 1). the bucket count is a power of 2
+    int  freeList;     // first free frame, linked through hashNext
+    ReplacementPolicy* policy;  // picks the frame to evict
+    unsigned long long hits;    // FETCH_READ calls that found the page
+    unsigned long long misses;  // FETCH_READ calls that read the page
+  };
+
+  RC   init(size_t capacity);
+  void destroy();
+  RC   rebuild(size_t capacity, ReplacementPolicy::Kind kind);
+
+  Shard& shardOf(int fd, PageId pid);
+  int  bucketOf(const Shard& s, int fd, PageId pid) const;
+  int  find(Shard& s, int fd, PageId pid);
+  int  victim(Shard& s);
+  int  claim(int fd, PageId pid, IoStats* stats);
+  int  readRun(int fd, PageId first, const int* run, int n);
+  static void prefetched(IoRequest* req);
+  void install(Shard& s, int frame, int fd, PageId pid, IoStats* stats);
+  void release(Shard& s, int frame);
+  void hashRemove(Shard& s, int frame);
+
+  size_t capacity;    // the size of the pool in bytes
+  int    frameCount;  // # of frames in the pool
+  char*  arena;       // frameCount pages of memory
+  Frame* frames;      // frame descriptors
+  Shard* shards;      // the shards of the pool
+  int    shardCount;  // # of shards
+  ReplacementPolicy::Kind policyKind;  // the policy of every shard
+
+  // the pool owns raw memory and must not be copied
+  BufferPool(const BufferPool&);
+  BufferPool& operator=(const BufferPool&);
+};
+
+#endif // BUFFERPOOL_H
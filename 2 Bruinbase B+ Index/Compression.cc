@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Compression.h"
+#include <cstring>
+
+typedef unsigned char byte;
+
+static const int MIN_MATCH = 4;      // the shortest back reference
+static const int LAST_LITERALS = 5;  // a block ends with this many literals
+static const int MATCH_LIMIT = 12;   // no match starts this close to the end
+static const int MAX_OFFSET = 65535; // offsets are 2 bytes
+static const int HASH_BITS = 12;
+
+// read 4 bytes, whatever their alignment
+static unsigned read32(const byte* p)
+{
+  unsigned v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static int hash(unsigned v)
+{
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// write a length that did not fit in the 4 bits of the token.
+// return false if the output is full
+static bool writeLength(byte*& out, const byte* end, int length)
+{
+  for (; length >= 255; length -= 255) {
+    if (out >= end) return false;
+    *out++ = 255;
+  }
+  if (out >= end) return false;
+  *out++ = length;
+  return true;
+}
+
+// write a run of literals followed by a back reference.
+// an offset of 0 means the literals end the block.
+// return false if the output is full
+static bool writeSequence(byte*& out, const byte* end, const byte* literals, int count,
+                          int offset, int length)
+{
+  byte* token = out;
+
+  if (out >= end) return false;
+  out++;
+  *token = ((count < 15) ? count : 15) << 4;
+  if (count >= 15 && !writeLength(out, end, count - 15)) return false;
+  if (end - out < count) return false;
+  memcpy(out, literals, count);
+  out += count;
+
+  if (offset == 0) return true;
+
+  if (end - out < 2) return false;
+  *out++ = offset & 0xFF;
+  *out++ = offset >> 8;
+  length -= MIN_MATCH;
+  *token |= (length < 15) ? length : 15;
+  if (length >= 15 && !writeLength(out, end, length - 15)) return false;
+  return true;
+}
+
+int Compression::compress(const char* src, int n, char* dst, int capacity)
+{
+  const byte* in = (const byte*)src;
+  byte*       out = (byte*)dst;
+  const byte* end = out + capacity;
+  int         table[1 << HASH_BITS];
+  int         anchor = 0;  // the first byte not written out yet
+  int         i = 0;
+
+  for (int h = 0; h < (1 << HASH_BITS); h++) table[h] = -1;
+
+  // remember the last position of each 4-byte string and refer back
+  // to it when it comes again
+  while (i < n - MATCH_LIMIT) {
+    unsigned v = read32(in + i);
+    int h = hash(v);
+    int ref = table[h];
+    table[h] = i;
+    if (ref < 0 || i - ref > MAX_OFFSET || read32(in + ref) != v) {
+      i++;
+      continue;
+    }
+
+    int length = MIN_MATCH;
+    while (i + length < n - LAST_LITERALS && in[ref + length] == in[i + length]) length++;
+
+    if (!writeSequence(out, end, in + anchor, i - anchor, i - ref, length)) return -1;
+    i += length;
+    anchor = i;
+  }
+
+  if (!writeSequence(out, end, in + anchor, n - anchor, 0, 0)) return -1;
+  return out - (byte*)dst;
+}
+
+int Compression::decompress(const char* src, int n, char* dst, int capacity)
+{
+  const byte* in = (const byte*)src;
+  const byte* inEnd = in + n;
+  byte*       out = (byte*)dst;
+  byte*       outEnd = out + capacity;
+
+  while (in < inEnd) {
+    int token = *in++;
+
+    // the literals
+    int count = token >> 4;
+    if (count == 15) {
+      int b;
+      do {
+        if (in >= inEnd) return -1;
+        count += (b = *in++);
+      } while (b == 255);
+    }
+    if (inEnd - in < count || outEnd - out < count) return -1;
+    memcpy(out, in, count);
+    in += count;
+    out += count;
+
+    // the last sequence has no back reference
+    if (in == inEnd) break;
+
+    if (inEnd - in < 2) return -1;
+    int offset = in[0] | (in[1] << 8);
+    in += 2;
+    if (offset == 0 || offset > out - (byte*)dst) return -1;
+
+    int length = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15) {
+      int b;
+      do {
+        if (in >= inEnd) return -1;
+        length += (b = *in++);
+      } while (b == 255);
+    }
+    if (outEnd - out < length) return -1;
+
+    // the reference may overlap the bytes it produces, e.g. a run of
+    // zeros, so it is copied a byte at a time
+    const byte* ref = out - offset;
+    for (int k = 0; k < length; k++) out[k] = ref[k];
+    out += length;
+  }
+
+  return out - (byte*)dst;
+}
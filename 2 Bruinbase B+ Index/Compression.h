@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+/**
+ * a fast LZ77 compressor for pages, writing the block format of LZ4.
+ *
+ * the compressed form is a sequence of literal runs, each followed by a
+ * back reference (offset, length) into the bytes decompressed so far.
+ * there is no entropy coding, so both directions run at memory speed;
+ * what is saved are repeated strings and the zero padding of the pages.
+ */
+class Compression {
+ public:
+  /**
+   * compress a block of bytes.
+   * @param src[IN] the bytes to compress
+   * @param n[IN] # of bytes
+   * @param dst[OUT] the compressed form
+   * @param capacity[IN] the size of dst
+   * @return the size of the compressed form. -1 if it does not fit in
+   *         capacity bytes
+   */
+  static int compress(const char* src, int n, char* dst, int capacity);
+
+  /**
+   * decompress a block made by compress().
+   * @param src[IN] the compressed form
+   * @param n[IN] its size
+   * @param dst[OUT] the decompressed bytes
+   * @param capacity[IN] the size of dst
+   * @return # of bytes decompressed. -1 if the block is corrupt or does
+   *         not fit in capacity bytes
+   */
+  static int decompress(const char* src, int n, char* dst, int capacity);
+};
+
+#endif // COMPRESSION_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "Dictionary.h"
+#include <algorithm>
+#include <cstring>
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// the file is a stream of values running across the pages, each stored
+// as (length + 1) followed by its bytes. the zeros after the last value
+// end the stream, so an empty value is told apart from the end.
+//
+
+Dictionary::Dictionary()
+{
+  pendingPid = 0;
+}
+
+RC Dictionary::open(const string& filename, char mode)
+{
+  RC rc;
+
+  if ((rc = pf.open(filename, mode)) < 0) return rc;
+
+  values.clear();
+  codes.clear();
+  sorted.clear();
+  ranks.clear();
+
+  // the dictionary is read in one piece; it is much smaller than the table
+  vector<char> data((size_t)pf.endPid() * PageFile::PAGE_SIZE);
+  for (PageId pid = 0; pid < pf.endPid(); pid++) {
+    if ((rc = pf.read(pid, &data[(size_t)pid * PageFile::PAGE_SIZE])) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
+
+  size_t pos = 0;
+  while (pos + sizeof(int) <= data.size()) {
+    int length;
+    memcpy(&length, &data[pos], sizeof(int));
+    if (length == 0) break;
+    if (length < 0 || data.size() - pos - sizeof(int) < (size_t)length - 1) {
+      pf.close();
+      return RC_INVALID_FILE_FORMAT;
+    }
+    values.emplace_back(&data[pos + sizeof(int)], length - 1);
+    codes.emplace(values.back(), values.size() - 1);
+    pos += sizeof(int) + length - 1;
+  }
+
+  // new values go after the last one, in the page it ends in
+  pendingPid = pos / PageFile::PAGE_SIZE;
+  pending.assign(data.begin() + (size_t)pendingPid * PageFile::PAGE_SIZE, data.begin() + pos);
+
+  sort();
+  return 0;
+}
+
+RC Dictionary::close()
+{
+  RC rc = flush();
+
+  values.clear();
+  codes.clear();
+  sorted.clear();
+  ranks.clear();
+  pending.clear();
+  pendingPid = 0;
+
+  RC rc2 = pf.close();
+  return (rc < 0) ? rc : rc2;
+}
+
+int Dictionary::encode(const string& value)
+{
+  std::unordered_map<string_view, int>::const_iterator it = codes.find(value);
+  if (it != codes.end()) return it->second;
+
+  int code = values.size();
+  values.push_back(value);
+  codes.emplace(values.back(), code);
+
+  int length = value.size() + 1;
+  pending.insert(pending.end(), (const char*)&length, (const char*)&length + sizeof(int));
+  pending.insert(pending.end(), value.begin(), value.end());
+  return code;
+}
+
+RC Dictionary::flush()
+{
+  RC rc;
+
+  // every value has a rank once it is in the file
+  if (sorted.size() == values.size()) return 0;
+
+  // write the pages from the one the new values start in
+  size_t used = pending.size();
+  int    pages = (used + PageFile::PAGE_SIZE - 1) / PageFile::PAGE_SIZE;
+  pending.resize((size_t)pages * PageFile::PAGE_SIZE, 0);
+  if ((rc = pf.writeBatch(pendingPid, pending.data(), pages)) < 0) {
+    pending.resize(used);
+    return rc;
+  }
+
+  // keep the last page if the next value still goes into it
+  size_t rest = used % PageFile::PAGE_SIZE;
+  if (rest == 0) {
+    pendingPid += pages;
+    pending.clear();
+  } else {
+    pendingPid += pages - 1;
+    pending.erase(pending.begin(), pending.begin() + (size_t)(pages - 1) * PageFile::PAGE_SIZE);
+    pending.resize(rest);
+  }
+
+  sort();
+  return 0;
+}
+
+void Dictionary::locate(string_view value, int& lo, int& hi) const
+{
+  vector<int>::const_iterator it = std::lower_bound(sorted.begin(), sorted.end(), value,
+    [this](int code, string_view v) { return string_view(values[code]) < v; });
+
+  lo = it - sorted.begin();
+  hi = lo + (it != sorted.end() && values[*it] == value);
+}
+
+void Dictionary::sort()
+{
+  size_t old = sorted.size();
+
+  // only the values added since the last sort() are sorted. they are
+  // merged into the ones sorted before
+  for (size_t code = old; code < values.size(); code++) sorted.push_back(code);
+  auto byValue = [this](int a, int b) { return values[a] < values[b]; };
+  std::sort(sorted.begin() + old, sorted.end(), byValue);
+  std::inplace_merge(sorted.begin(), sorted.begin() + old, sorted.end(), byValue);
+
+  ranks.resize(values.size());
+  for (size_t i = 0; i < sorted.size(); i++) ranks[sorted[i]] = i;
+}
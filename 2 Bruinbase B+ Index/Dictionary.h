@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "PageFile.h"
+
+/**
+ * the distinct values of a column, each stored once in a file of its
+ * own and referred to by an integer code.
+ *
+ * codes are given out in the order the values first appear, so that the
+ * code of a value never changes. the dictionary also keeps the rank of
+ * each code in the sorted order of the values, so a comparison of two
+ * values, or of a value with a constant, is a comparison of two integers.
+ */
+class Dictionary {
+ public:
+  Dictionary();
+
+  /**
+   * open a dictionary file and read every value of it into memory.
+   * when opened in 'w' mode, if the file does not exist, it is created.
+   * @param filename[IN] the name of the file to open
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename, char mode);
+
+  /**
+   * write the new values out and close the file.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * write the values added since the last flush() to the file and bring
+   * the ranks up to date.
+   * @return error code. 0 if no error
+   */
+  RC flush();
+
+  /**
+   * @return # of distinct values. the codes are 0 to size()-1
+   */
+  int size() const { return values.size(); }
+
+  /**
+   * @param code[IN] the code of a value. must be in [0, size())
+   * @return the value. valid until the dictionary is closed
+   */
+  std::string_view getValue(int code) const { return values[code]; }
+
+  /**
+   * find the code of a value, adding the value if it is new.
+   * the value reaches the file on flush().
+   * @param value[IN] the value
+   * @return the code of the value
+   */
+  int encode(const std::string& value);
+
+  /**
+   * the rank of each code in the sorted order of the values:
+   * getRanks()[a] < getRanks()[b] if and only if value a < value b.
+   * values added since the last flush() have no rank yet.
+   * @return the ranks, indexed by code
+   */
+  const int* getRanks() const { return ranks.data(); }
+
+  /**
+   * find where a value falls in the sorted order of the values.
+   * the values equal to it have a rank in [lo, hi), the smaller values
+   * a rank below lo and the larger ones a rank of hi or above.
+   * @param value[IN] the value to look for. need not be in the dictionary
+   * @param lo[OUT] the rank of the first value not smaller than value
+   * @param hi[OUT] the rank of the first value larger than value
+   */
+  void locate(std::string_view value, int& lo, int& hi) const;
+
+ private:
+  void sort();
+
+  PageFile pf;
+  std::deque<std::string> values;  // by code. a deque, so that the
+                                   // values never move in memory
+  std::unordered_map<std::string_view, int> codes;  // the code of each value
+  std::vector<int>  sorted;   // the codes in the sorted order of their values
+  std::vector<int>  ranks;    // the position of each code in sorted
+  std::vector<char> pending;  // the end of the file not written yet
+  PageId pendingPid;          // the page pending starts at
+};
+
+#endif // DICTIONARY_H
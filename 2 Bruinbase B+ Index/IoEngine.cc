@@ -0,0 +1,439 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "IoEngine.h"
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using std::vector;
+
+void IoEngine::wait(IoRequest* reqs, int n)
+{
+  std::unique_lock<std::mutex> lock(latch);
+  for (int i = 0; i < n; i++) {
+    while (!reqs[i].done) completed.wait(lock);
+  }
+}
+
+void IoEngine::finish(IoRequest* req, ssize_t result)
+{
+  req->result = result;
+  if (req->complete != NULL) {
+    req->complete(req);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(latch);
+  req->done = true;
+  completed.notify_all();
+}
+
+ssize_t IoEngine::perform(const IoRequest* req)
+{
+  ssize_t n;
+  do {
+    n = req->write ? ::pwrite(req->fd, req->buffer, req->length, req->offset)
+                   : ::pread(req->fd, req->buffer, req->length, req->offset);
+  } while (n < 0 && errno == EINTR);
+  return (n < 0) ? -errno : n;
+}
+
+/**
+ * does the I/O inside submit()
+ */
+class SyncEngine : public IoEngine {
+ public:
+  RC submit(IoRequest* reqs, int n)
+  {
+    for (int i = 0; i < n; i++) finish(&reqs[i], perform(&reqs[i]));
+    return 0;
+  }
+
+  Kind kind() const { return IO_SYNC; }
+};
+
+/**
+ * hands the requests to a few worker threads doing blocking I/O,
+ * so that the disk sees several requests at once
+ */
+class ThreadEngine : public IoEngine {
+ public:
+  static const int WORKER_COUNT = 4;
+
+  ThreadEngine() { stopping = false; }
+
+  ~ThreadEngine()
+  {
+    {
+      std::lock_guard<std::mutex> lock(queueLatch);
+      stopping = true;
+    }
+    queued.notify_all();
+    for (unsigned i = 0; i < workers.size(); i++) workers[i].join();
+  }
+
+  RC submit(IoRequest* reqs, int n)
+  {
+    {
+      std::lock_guard<std::mutex> lock(queueLatch);
+      // the workers are started on first use
+      if (workers.empty()) {
+        for (int i = 0; i < WORKER_COUNT; i++) {
+          workers.push_back(std::thread(&ThreadEngine::work, this));
+        }
+      }
+      for (int i = 0; i < n; i++) queue.push_back(&reqs[i]);
+    }
+    queued.notify_all();
+    return 0;
+  }
+
+  Kind kind() const { return IO_THREADS; }
+
+ private:
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(queueLatch);
+    for (;;) {
+      while (queue.empty() && !stopping) queued.wait(lock);
+      if (queue.empty()) return;
+      IoRequest* req = queue.front();
+      queue.pop_front();
+      lock.unlock();
+      finish(req, perform(req));
+      lock.lock();
+    }
+  }
+
+  std::mutex queueLatch;              // protects queue and stopping
+  std::condition_variable queued;     // signaled when a request is queued
+  std::deque<IoRequest*> queue;       // requests not picked up yet
+  vector<std::thread> workers;
+  bool stopping;                      // set when the engine goes away
+};
+
+#ifdef HAVE_IO_URING
+/**
+ * submits the requests to an io_uring. a reaper thread waits for the
+ * completions, so nobody has to poll for them.
+ */
+class UringEngine : public IoEngine {
+ public:
+  static const unsigned RING_ENTRIES = 256;
+
+  UringEngine() { ringFd = -1; }
+
+  ~UringEngine()
+  {
+    if (ringFd < 0) return;
+
+    // a request without user data tells the reaper to quit
+    {
+      std::unique_lock<std::mutex> lock(submitLatch);
+      while (inflight >= cqEntries) room.wait(lock);
+      push(IORING_OP_NOP, NULL);
+      enter(1, 0, 0);
+    }
+    reaper.join();
+
+    ::munmap(sqes, sqesSize);
+    if (cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+    ::munmap(sqRing, sqRingSize);
+    ::close(ringFd);
+  }
+
+  /**
+   * set up the ring and start the reaper.
+   * @return error code. RC_NOT_SUPPORTED if the kernel lacks io_uring
+   */
+  RC init()
+  {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ringFd = (int)::syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+    if (ringFd < 0) return RC_NOT_SUPPORTED;
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+      cqRingSize = sqRingSize;
+    }
+    sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    sqRing = ::mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd, IORING_OFF_SQ_RING);
+    cqRing = (p.features & IORING_FEAT_SINGLE_MMAP) ? sqRing
+           : ::mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe*)::mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+      if (sqes != MAP_FAILED) ::munmap(sqes, sqesSize);
+      if (cqRing != MAP_FAILED && cqRing != sqRing) ::munmap(cqRing, cqRingSize);
+      if (sqRing != MAP_FAILED) ::munmap(sqRing, sqRingSize);
+      ::close(ringFd);
+      ringFd = -1;
+      return RC_NOT_SUPPORTED;
+    }
+
+    char* sq = (char*)sqRing;
+    sqHead = (unsigned*)(sq + p.sq_off.head);
+    sqTail = (unsigned*)(sq + p.sq_off.tail);
+    sqMask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    sqEntries = p.sq_entries;
+    sqArray = (unsigned*)(sq + p.sq_off.array);
+
+    char* cq = (char*)cqRing;
+    cqHead = (unsigned*)(cq + p.cq_off.head);
+    cqTail = (unsigned*)(cq + p.cq_off.tail);
+    cqMask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    cqEntries = p.cq_entries;
+    cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    inflight = 0;
+    pending = 0;
+    reaper = std::thread(&UringEngine::reap, this);
+    return 0;
+  }
+
+  RC submit(IoRequest* reqs, int n)
+  {
+    std::unique_lock<std::mutex> lock(submitLatch);
+
+    for (int i = 0; i < n; i++) {
+      // never have more requests in flight than the completion queue holds
+      while (inflight >= cqEntries) {
+        if (pending > 0) {
+          if (flush(lock) < 0) return fail(lock, reqs + i, n - i);
+          continue;
+        }
+        room.wait(lock);
+      }
+      if (pending == sqEntries && flush(lock) < 0) return fail(lock, reqs + i, n - i);
+
+      reqs[i].iov.iov_base = reqs[i].buffer;
+      reqs[i].iov.iov_len = reqs[i].length;
+      push(reqs[i].write ? IORING_OP_WRITEV : IORING_OP_READV, &reqs[i]);
+    }
+    if (flush(lock) < 0) return fail(lock, NULL, 0);
+    return 0;
+  }
+
+  Kind kind() const { return IO_URING; }
+
+ private:
+  /**
+   * put a request in the submission queue. submitLatch must be held
+   * and the queue must have room.
+   */
+  void push(int opcode, IoRequest* req)
+  {
+    unsigned tail = *sqTail;
+    unsigned index = tail & sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    if (req != NULL) {
+      sqe->fd = req->fd;
+      sqe->addr = (unsigned long)&req->iov;
+      sqe->len = 1;
+      sqe->off = req->offset;
+    } else {
+      sqe->fd = -1;
+    }
+    sqe->user_data = (unsigned long)req;
+    sqArray[index] = index;
+
+    // the kernel must see the entry before the new tail
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    pending++;
+    inflight++;
+  }
+
+  /**
+   * hand the queued entries to the kernel and/or wait for completions.
+   * @return # of entries consumed or -errno
+   */
+  int enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+  {
+    int rc;
+    do {
+      rc = (int)::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+    } while (rc < 0 && (errno == EINTR || errno == EAGAIN));
+    if (rc < 0) return -errno;
+    if (toSubmit > 0) pending -= rc;
+    return rc;
+  }
+
+  /**
+   * hand every queued entry to the kernel. submitLatch must be held.
+   * @return 0, or -errno if the kernel does not take them
+   */
+  int flush(std::unique_lock<std::mutex>& lock)
+  {
+    while (pending > 0) {
+      int rc = enter(pending, 0, 0);
+      if (rc < 0) return rc;
+      if (rc > 0) continue;
+      // the kernel takes fewer entries when it is short of resources.
+      // wait for a request in flight to complete, if there is one
+      if (inflight == pending) return -EBUSY;
+      room.wait(lock);
+    }
+    return 0;
+  }
+
+  /**
+   * take the entries the kernel has not seen back off the submission
+   * queue, and complete them and the requests that were never queued
+   * with an error. submitLatch must be held. it is released.
+   * @return RC_FILE_READ_FAILED
+   */
+  RC fail(std::unique_lock<std::mutex>& lock, IoRequest* reqs, int n)
+  {
+    vector<IoRequest*> dropped;
+    unsigned tail = *sqTail;
+    for (; pending > 0; pending--) {
+      tail--;
+      dropped.push_back((IoRequest*)(unsigned long)sqes[sqArray[tail & sqMask]].user_data);
+      inflight--;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    room.notify_all();
+    lock.unlock();
+
+    // complete() may free a request, so it is not called under the latch
+    for (unsigned i = 0; i < dropped.size(); i++) finish(dropped[i], -EIO);
+    for (int i = 0; i < n; i++) finish(&reqs[i], -EIO);
+    return RC_FILE_READ_FAILED;
+  }
+
+  /**
+   * the body of the reaper thread
+   */
+  void reap()
+  {
+    bool stopping = false;
+
+    while (!stopping) {
+      unsigned head = *cqHead;
+      unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+      if (head == tail) {
+        ::syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        continue;
+      }
+
+      // take the completions off the ring while holding the latch the
+      // requests were submitted under, then report them
+      vector<std::pair<IoRequest*, int> > done;
+      {
+        std::lock_guard<std::mutex> lock(submitLatch);
+        for (; head != tail; head++) {
+          struct io_uring_cqe* cqe = &cqes[head & cqMask];
+          done.push_back(std::make_pair((IoRequest*)(unsigned long)cqe->user_data, (int)cqe->res));
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        inflight -= done.size();
+        room.notify_all();
+      }
+
+      for (unsigned i = 0; i < done.size(); i++) {
+        if (done[i].first == NULL) stopping = true;
+        else finish(done[i].first, done[i].second);
+      }
+    }
+  }
+
+  int      ringFd;
+  void*    sqRing;        // the submission queue ring
+  void*    cqRing;        // the completion queue ring. may be sqRing
+  size_t   sqRingSize;
+  size_t   cqRingSize;
+  size_t   sqesSize;
+  struct io_uring_sqe* sqes;  // the submission queue entries
+  struct io_uring_cqe* cqes;  // the completion queue entries
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqArray;
+  unsigned  sqMask;
+  unsigned  sqEntries;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned  cqMask;
+  unsigned  cqEntries;
+
+  std::mutex submitLatch;       // protects the submission queue and inflight
+  std::condition_variable room; // signaled when requests complete
+  unsigned inflight;            // # of requests submitted but not reaped
+  unsigned pending;             // # of queued entries the kernel has not seen
+  std::thread reaper;
+};
+#endif // HAVE_IO_URING
+
+// the shared engine. it is created on first use
+static IoEngine* engine = NULL;
+static std::mutex engineLatch;
+
+// deletes the shared engine at exit so that its threads are joined
+static struct EngineReaper {
+  ~EngineReaper() { delete engine; engine = NULL; }
+} engineReaper;
+
+static IoEngine* create(IoEngine::Kind kind)
+{
+  switch (kind) {
+  case IoEngine::IO_URING:
+#ifdef HAVE_IO_URING
+    {
+      UringEngine* uring = new UringEngine;
+      if (uring->init() == 0) return uring;
+      delete uring;
+    }
+#endif
+    return NULL;
+  case IoEngine::IO_THREADS:
+    return new ThreadEngine;
+  default:
+    return new SyncEngine;
+  }
+}
+
+IoEngine& IoEngine::instance()
+{
+  std::lock_guard<std::mutex> lock(engineLatch);
+  if (engine == NULL) {
+    engine = create(IO_URING);
+    if (engine == NULL) engine = create(IO_THREADS);
+  }
+  return *engine;
+}
+
+RC IoEngine::setKind(Kind kind)
+{
+  IoEngine* e = create(kind);
+  if (e == NULL) return RC_NOT_SUPPORTED;
+
+  std::lock_guard<std::mutex> lock(engineLatch);
+  delete engine;
+  engine = e;
+  return 0;
+}
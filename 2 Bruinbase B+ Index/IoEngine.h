@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IOENGINE_H
+#define IOENGINE_H
+
+#include <condition_variable>
+#include <mutex>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "Bruinbase.h"
+
+/**
+ * a single read or write handed to an IoEngine.
+ * the request must stay in place until it has completed.
+ */
+struct IoRequest {
+  int     fd;        // the file to read or write
+  bool    write;     // true for a write, false for a read
+  char*   buffer;    // the memory to read into or write from
+  size_t  length;    // # of bytes to transfer
+  off_t   offset;    // the position in the file
+  ssize_t result;    // # of bytes transferred or -errno. set on completion
+  bool    done;      // set on completion when complete is NULL
+  void  (*complete)(IoRequest* req); // called on completion. may be NULL
+  void*   arg;       // for use by complete()
+  int     tag;       // for use by complete()
+  struct iovec iov;  // used by the engine
+};
+
+/**
+ * submits page reads and writes without waiting for them.
+ *
+ * a request is completed by the engine, possibly on another thread.
+ * if it has a complete() function, the function is called and the engine
+ * does not touch the request any more, so complete() may free it.
+ * otherwise the request is marked done and can be waited for with wait().
+ *
+ * three engines are available: io_uring, a small pool of worker threads
+ * doing pread()/pwrite(), and a synchronous engine that does the I/O
+ * inside submit(). instance() picks io_uring when the kernel supports it
+ * and the thread pool otherwise.
+ */
+class IoEngine {
+ public:
+  enum Kind { IO_URING, IO_THREADS, IO_SYNC };
+
+  virtual ~IoEngine() {}
+
+  /**
+   * @return the engine shared by all page files
+   */
+  static IoEngine& instance();
+
+  /**
+   * replace the shared engine. no request may be in flight.
+   * @param kind[IN] the engine to use
+   * @return error code. RC_NOT_SUPPORTED if the kernel lacks io_uring
+   */
+  static RC setKind(Kind kind);
+
+  /**
+   * start a batch of requests. every request is completed exactly once,
+   * even when an error is returned.
+   * @param reqs[IN] the requests
+   * @param n[IN] # of requests
+   * @return error code. 0 if no error
+   */
+  virtual RC submit(IoRequest* reqs, int n) = 0;
+
+  /**
+   * wait until a batch of requests without complete() has completed.
+   * @param reqs[IN] the requests
+   * @param n[IN] # of requests
+   */
+  void wait(IoRequest* reqs, int n);
+
+  /**
+   * @return the kind of the engine
+   */
+  virtual Kind kind() const = 0;
+
+ protected:
+  /**
+   * report the completion of a request.
+   * @param req[IN] the request
+   * @param result[IN] # of bytes transferred or -errno
+   */
+  void finish(IoRequest* req, ssize_t result);
+
+  /**
+   * do a request with a blocking system call.
+   * @param req[IN] the request
+   * @return # of bytes transferred or -errno
+   */
+  static ssize_t perform(const IoRequest* req);
+
+ private:
+  std::mutex latch;                   // protects the done flags
+  std::condition_variable completed;  // signaled when a request is done
+};
+
+#endif // IOENGINE_H
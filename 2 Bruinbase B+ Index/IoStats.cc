@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "IoStats.h"
+#include <mutex>
+#include <time.h>
+
+using std::map;
+using std::string;
+
+// the query stats of each thread
+static thread_local IoStats* queryStats = NULL;
+
+// the stats of every file opened so far, by name.
+// map entries never move, so the pointers handed out stay valid
+static std::mutex fileLatch;
+static map<string, IoStats> fileStats;
+
+IoStats::Scope::Scope(IoStats* stats)
+{
+  saved = queryStats;
+  queryStats = stats;
+}
+
+IoStats::Scope::~Scope()
+{
+  queryStats = saved;
+}
+
+IoStats::IoStats()
+{
+  reset();
+}
+
+IoStats::IoStats(const IoStats& s)
+{
+  *this = s;
+}
+
+IoStats& IoStats::operator=(const IoStats& s)
+{
+  for (int i = 0; i < VALUE_COUNT; i++) {
+    values[i].store(s.values[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  return *this;
+}
+
+unsigned long long IoStats::getLatency(int bucket) const
+{
+  if (bucket < 0 || bucket >= LATENCY_BUCKETS) return 0;
+  return values[COUNTER_COUNT + bucket].load(std::memory_order_relaxed);
+}
+
+unsigned long long IoStats::getLevelReads(int level) const
+{
+  if (level < 1 || level > MAX_LEVELS) return 0;
+  return values[COUNTER_COUNT + LATENCY_BUCKETS + level - 1].load(std::memory_order_relaxed);
+}
+
+void IoStats::reset()
+{
+  for (int i = 0; i < VALUE_COUNT; i++) values[i].store(0, std::memory_order_relaxed);
+}
+
+const char* IoStats::name(Counter c)
+{
+  switch (c) {
+  case LOGICAL_READS:   return "logical_reads";
+  case CACHE_HITS:      return "cache_hits";
+  case PHYSICAL_READS:  return "physical_reads";
+  case READ_AHEAD:      return "read_ahead";
+  case BYTES_READ:      return "bytes_read";
+  case LOGICAL_WRITES:  return "logical_writes";
+  case PHYSICAL_WRITES: return "physical_writes";
+  case BYTES_WRITTEN:   return "bytes_written";
+  case SYSCALLS:        return "syscalls";
+  default:              return "unknown";
+  }
+}
+
+void IoStats::print(FILE* out, const char* indent) const
+{
+  for (int c = 0; c < COUNTER_COUNT; c++) {
+    fprintf(out, "%s%-16s %llu\n", indent, name((Counter)c), get((Counter)c));
+  }
+
+  // only the buckets and levels that saw something
+  char label[32];
+  for (int b = 0; b < LATENCY_BUCKETS; b++) {
+    if (getLatency(b) == 0) continue;
+    if (b == LATENCY_BUCKETS - 1) snprintf(label, sizeof(label), "syscalls >=%lluus", 1ULL << (b - 1));
+    else snprintf(label, sizeof(label), "syscalls <%lluus", 1ULL << b);
+    fprintf(out, "%s%-16s %llu\n", indent, label, getLatency(b));
+  }
+  for (int l = 1; l <= MAX_LEVELS; l++) {
+    if (getLevelReads(l) == 0) continue;
+    snprintf(label, sizeof(label), "level %d reads", l);
+    fprintf(out, "%s%-16s %llu\n", indent, label, getLevelReads(l));
+  }
+}
+
+void IoStats::printJson(FILE* out) const
+{
+  fprintf(out, "{");
+  for (int c = 0; c < COUNTER_COUNT; c++) {
+    fprintf(out, "\"%s\": %llu, ", name((Counter)c), get((Counter)c));
+  }
+  fprintf(out, "\"syscall_latency_us\": [");
+  for (int b = 0; b < LATENCY_BUCKETS; b++) {
+    fprintf(out, "%s%llu", (b > 0) ? ", " : "", getLatency(b));
+  }
+  fprintf(out, "], \"level_reads\": [");
+  for (int l = 1; l <= MAX_LEVELS; l++) {
+    fprintf(out, "%s%llu", (l > 1) ? ", " : "", getLevelReads(l));
+  }
+  fprintf(out, "]}");
+}
+
+void IoStats::count(IoStats* file, Counter c, unsigned long long n, IoStats* query)
+{
+  if (file != NULL) file->add(c, n);
+  if (query != NULL) query->add(c, n);
+  total().add(c, n);
+}
+
+void IoStats::countSyscall(IoStats* file, unsigned long long start, IoStats* query)
+{
+  unsigned long long us = (now() - start) / 1000;
+  int b = 0;
+
+  while (us > 0 && b < LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    b++;
+  }
+
+  count(file, SYSCALLS, 1, query);
+  if (file != NULL) file->add(COUNTER_COUNT + b, 1);
+  if (query != NULL) query->add(COUNTER_COUNT + b, 1);
+  total().add(COUNTER_COUNT + b, 1);
+}
+
+void IoStats::countLevel(IoStats* file, int level)
+{
+  if (level < 1 || level > MAX_LEVELS) return;
+  int i = COUNTER_COUNT + LATENCY_BUCKETS + level - 1;
+  IoStats* query = current();
+
+  if (file != NULL) file->add(i, 1);
+  if (query != NULL) query->add(i, 1);
+  total().add(i, 1);
+}
+
+unsigned long long IoStats::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+IoStats* IoStats::current()
+{
+  return queryStats;
+}
+
+IoStats& IoStats::total()
+{
+  static IoStats stats;
+  return stats;
+}
+
+IoStats* IoStats::forFile(const string& filename)
+{
+  std::lock_guard<std::mutex> lock(fileLatch);
+  return &fileStats[filename];
+}
+
+map<string, IoStats> IoStats::files()
+{
+  std::lock_guard<std::mutex> lock(fileLatch);
+  return fileStats;
+}
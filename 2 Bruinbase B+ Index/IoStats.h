@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+
+/**
+ * I/O counters of a file, of a query or of the whole process.
+ *
+ * every event is counted three times: in the stats of the file it
+ * happened to, in the stats of the query running on the calling thread
+ * (see Scope) and in the process totals. the counters are 64-bit and
+ * may be updated by several threads at the same time.
+ */
+class IoStats {
+ public:
+  enum Counter {
+    LOGICAL_READS,    // read() and pin() calls
+    CACHE_HITS,       // logical reads served without a disk read
+    PHYSICAL_READS,   // pages read from the disk
+    READ_AHEAD,       // pages read before they were asked for
+    BYTES_READ,       // bytes read from the disk
+    LOGICAL_WRITES,   // write() calls
+    PHYSICAL_WRITES,  // pages written to the disk
+    BYTES_WRITTEN,    // bytes written to the disk
+    SYSCALLS,         // read and write system calls
+    COUNTER_COUNT
+  };
+
+  // bucket 0 counts the system calls faster than 1us, bucket i those
+  // taking [2^(i-1), 2^i) us. the last bucket takes the slower rest
+  static const int LATENCY_BUCKETS = 24;
+
+  // b+tree levels are counted from 1 (the root)
+  static const int MAX_LEVELS = 16;
+
+  /**
+   * makes an IoStats the query stats of the calling thread
+   * for the lifetime of the scope.
+   */
+  class Scope {
+   public:
+    Scope(IoStats* stats);
+    ~Scope();
+   private:
+    IoStats* saved;  // the query stats the scope replaced
+  };
+
+  IoStats();
+  IoStats(const IoStats& s);
+  IoStats& operator=(const IoStats& s);
+
+  /**
+   * @param c[IN] the counter
+   * @return the value of the counter
+   */
+  unsigned long long get(Counter c) const { return values[c].load(std::memory_order_relaxed); }
+
+  /**
+   * @param bucket[IN] the histogram bucket. see LATENCY_BUCKETS
+   * @return # of system calls that fell into the bucket
+   */
+  unsigned long long getLatency(int bucket) const;
+
+  /**
+   * @param level[IN] the b+tree level. 1 is the root
+   * @return # of node reads on the level
+   */
+  unsigned long long getLevelReads(int level) const;
+
+  /**
+   * set every counter to 0.
+   */
+  void reset();
+
+  /**
+   * print the counters in a human readable form.
+   * @param out[IN] the stream to print to
+   * @param indent[IN] the prefix of every line
+   */
+  void print(FILE* out, const char* indent) const;
+
+  /**
+   * print the counters as a JSON object.
+   * @param out[IN] the stream to print to
+   */
+  void printJson(FILE* out) const;
+
+  /**
+   * @param c[IN] the counter
+   * @return the name of the counter, as used in print() and printJson()
+   */
+  static const char* name(Counter c);
+
+  /**
+   * count an event of a file.
+   * @param file[IN] the stats of the file. may be NULL
+   * @param c[IN] the counter
+   * @param n[IN] the amount to add
+   * @param query[IN] the stats of the query the event belongs to
+   */
+  static void count(IoStats* file, Counter c, unsigned long long n = 1, IoStats* query = current());
+
+  /**
+   * count a system call and its duration.
+   * @param file[IN] the stats of the file. may be NULL
+   * @param start[IN] the time the call started, as returned by now()
+   * @param query[IN] the stats of the query the call belongs to
+   */
+  static void countSyscall(IoStats* file, unsigned long long start, IoStats* query = current());
+
+  /**
+   * count a b+tree node read.
+   * @param file[IN] the stats of the index file. may be NULL
+   * @param level[IN] the level of the node. 1 is the root
+   */
+  static void countLevel(IoStats* file, int level);
+
+  /**
+   * @return a monotonic clock in nanoseconds
+   */
+  static unsigned long long now();
+
+  /**
+   * @return the query stats of the calling thread. NULL if none
+   */
+  static IoStats* current();
+
+  /**
+   * @return the totals of the process
+   */
+  static IoStats& total();
+
+  /**
+   * find the stats of a file by name. the stats are kept for the life
+   * of the process, across every open() of the file.
+   * @param filename[IN] the name of the file
+   * @return the stats of the file
+   */
+  static IoStats* forFile(const std::string& filename);
+
+  /**
+   * @return a copy of the stats of every file opened so far
+   */
+  static std::map<std::string, IoStats> files();
+
+ private:
+  void add(int i, unsigned long long n) { values[i].fetch_add(n, std::memory_order_relaxed); }
+
+  static const int VALUE_COUNT = COUNTER_COUNT + LATENCY_BUCKETS + MAX_LEVELS;
+
+  // the counters, then the latency histogram, then the level reads
+  std::atomic<unsigned long long> values[VALUE_COUNT];
+};
+
+#endif // IOSTATS_H
@@ -9,24 +9,89 @@
 
 #include "Bruinbase.h"
 #include "PageFile.h"
+#include "BufferPool.h"
+#include "Compression.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
+#include <vector>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 using std::string;
+using std::vector;
+
+// the header stored in the first disk page of a file.
+// files written before the header was introduced start with page 0
+// instead and always use 1KB pages.
+struct FileHeader {
+  int magic;     // PageFile::FILE_MAGIC
+  int version;   // PageFile::FILE_VERSION
+  int pageSize;  // the page size the file was created with
+  int format;    // chosen by the user of the file. see setFormat()
+  int flags;     // FLAG_COMPRESSED
+};
+
+// the pages of the file are compressed. see setCompression()
+static const int FLAG_COMPRESSED = 1;
+
+//
+// a compressed file keeps the pages in extents of EXTENT_PAGES pages,
+// each compressed into as few disk pages as it takes. the extents are
+// followed by the directory of the extents and a trailer page that
+// tells where the directory starts.
+//
+
+struct ExtentEntry {
+  PageId disk;    // the first disk page of the extent, counting the header
+  int    length;  // # bytes of the compressed extent. 0 if it is stored as it is
+  int    pages;   // # pages in the extent
+};
+
+struct ExtentTrailer {
+  int    magic;      // EXTENT_MAGIC
+  int    count;      // # extents
+  PageId directory;  // the first disk page of the directory
+  PageId pages;      // # pages of the file
+};
+
+static const int EXTENT_MAGIC = 0x54584542;  // "BEXT" on little endian
+static const int EXTENT_BYTES = PageFile::EXTENT_PAGES * PageFile::PAGE_SIZE;
+static const int ENTRIES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(ExtentEntry);
+
+struct PageFile::Extents {
+  vector<ExtentEntry> directory; // the extents in page order
+  vector<char> tail;   // the last extent, not compressed
+  PageId tailPid;      // the first page of the last extent
+  bool   tailDirty;    // the last extent changed since it was written
+  bool   directoryDirty; // the directory changed since it was written
+  PageId end;          // the disk page after the last extent written
+};
 
 // initialize static private member of PageFile Class
-int PageFile::readCount = 0;
-int PageFile::writeCount = 0;
-int PageFile::cacheClock = 1;
-struct PageFile::cacheStruct PageFile::readCache[PageFile::CACHE_COUNT];
+bool PageFile::writeBack = true;
+bool PageFile::mmapReadOnly = true;
+bool PageFile::directIo = false;
+int PageFile::readAheadPages = 32;
+BufferPool PageFile::bufferPool;
 
 // default constructor, set file id to -1, page id to 0
 PageFile::PageFile() 
 { 
   fd = -1; 
   epid = 0; 
+  base = 0;
+  format = 0;
+  direct = false;
+  map = NULL;
+  touched = NULL;
+  extents = NULL;
+  stats = NULL;
+  access = ACCESS_NORMAL;
+  lastPid = -1;
+  aheadPid = 0;
 }
 
 // constructor with parameter, given a file and its mode
@@ -34,10 +99,26 @@ PageFile::PageFile(const string& filename, char mode)
 {
   fd = -1;
   epid = 0;
+  base = 0;
+  format = 0;
+  direct = false;
+  map = NULL;
+  touched = NULL;
+  extents = NULL;
+  stats = NULL;
+  access = ACCESS_NORMAL;
+  lastPid = -1;
+  aheadPid = 0;
 // call in-class function open. .c_str() convert to C-string
   open(filename.c_str(), mode);
 }
 
+// destructor, close the file if the user has not done so
+PageFile::~PageFile()
+{
+  if (fd >= 0) close();
+}
+
 // RC, return type (defined in bruinbase.h, return code)
 RC PageFile::open(const string& filename, char mode)
 {
@@ -70,15 +151,57 @@ RC PageFile::open(const string& filename, char mode)
     return RC_INVALID_FILE_MODE;
   }
 
-  // open the file
-  fd = ::open(filename.c_str(), oflag, 0644);
+  // open the file. fall back to the page cache if the file system
+  // does not do direct I/O
+  direct = false;
+  if (directIo) {
+    fd = ::open(filename.c_str(), oflag | O_DIRECT, 0644);
+    if (fd >= 0) direct = true;
+  }
+  if (!direct) fd = ::open(filename.c_str(), oflag, 0644);
   if (fd < 0) { fd = -1; return RC_FILE_OPEN_FAILED; }
+  stats = IoStats::forFile(filename);
 
   // get the size of the file to set the end pid
   rc = ::fstat(fd, &statbuf);
   if (rc < 0) { ::close(fd); fd = -1; return RC_FILE_OPEN_FAILED; }
+
+  // check the file header, or write one to a new file
+  if ((rc = openHeader(statbuf.st_size, oflag != O_RDONLY)) < 0) {
+    ::close(fd);
+    fd = -1;
+    return rc;
+  }
+
 // st_size = total bytes, epid is ending page number
-  epid = statbuf.st_size / PAGE_SIZE;
+  epid = statbuf.st_size / PAGE_SIZE - base;
+  if (epid < 0) epid = 0;
+
+  // a compressed file has fewer disk pages than pages
+  if (extents != NULL && (rc = openExtents(epid)) < 0) {
+    delete extents;
+    extents = NULL;
+    ::close(fd);
+    fd = -1;
+    return rc;
+  }
+
+  // nothing has been read yet
+  access = ACCESS_NORMAL;
+  lastPid = -1;
+  aheadPid = 0;
+
+  // nobody writes to a read-only file through us, so we can hand out
+  // its pages straight from a mapping instead of copying them around
+  // a direct file is kept out of the page cache, so it is not mapped.
+  // neither is a compressed file
+  if (oflag == O_RDONLY && mmapReadOnly && !direct && extents == NULL && epid > 0) {
+    void* addr = ::mmap(NULL, (size_t)(epid + base) * PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      map = (char*)addr;
+      touched = new std::atomic<char>[epid]();
+    }
+  }
 
   return 0;
 }
@@ -87,109 +210,697 @@ RC PageFile::close()
 {
   if (fd <= 0) return RC_FILE_CLOSE_FAILED;
 
+  // write back the dirty pages and evict all cached pages for this file
+  RC rc = flush();
+  bufferPool.releaseFile(fd);
+
+  if (map != NULL) {
+    ::munmap(map, (size_t)(epid + base) * PAGE_SIZE);
+    map = NULL;
+    delete[] touched;
+    touched = NULL;
+  }
+  delete extents;
+  extents = NULL;
+
   // close the file
   if (::close(fd) < 0) return RC_FILE_CLOSE_FAILED;
 
-  // evict all cached pages for this file
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
+  // set the fd and epid to the initial state
+  fd = -1; 
+  epid = 0;
+  base = 0;
+  format = 0;
+  return rc;
+}
+
+RC PageFile::openHeader(off_t size, bool writable)
+{
+  FileHeader header;
+  alignas(DIRECT_ALIGNMENT) char page[PAGE_SIZE];
+
+  // a new file gets a header page in front of page 0
+  if (size == 0) {
+    if (!writable) {
+      base = 0;
+      return 0;
     }
+    memset(page, 0, PAGE_SIZE);
+    header.magic = FILE_MAGIC;
+    header.version = FILE_VERSION;
+    header.pageSize = PAGE_SIZE;
+    header.format = 0;
+    header.flags = 0;
+    memcpy(page, &header, sizeof(header));
+    ssize_t n = writePage(0, page);
+    if (n < 0 && errno == EINVAL && dropDirect()) n = writePage(0, page);
+    if (n < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
+    base = 1;
+    format = 0;
+    return 0;
   }
 
-  // set the fd and epid to the initial state
-  fd = -1; 
+  // the first read also tells if the device takes our page size directly
+  ssize_t n = readPage(0, page);
+  if (n < 0 && errno == EINVAL && dropDirect()) n = readPage(0, page);
+  if (n < (ssize_t)sizeof(header)) memset(page, 0, sizeof(header));
+  memcpy(&header, page, sizeof(header));
+
+  if (header.magic != FILE_MAGIC) {
+    // a file without a header. it was written with 1KB pages
+    if (PAGE_SIZE != LEGACY_PAGE_SIZE) return RC_INVALID_FILE_FORMAT;
+    base = 0;
+    format = 0;
+    return 0;
+  }
+
+  // the page size is fixed at compile time, so it has to match
+  if (header.version != FILE_VERSION || header.pageSize != PAGE_SIZE) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+  base = 1;
+  format = header.format;
+  if (header.flags & FLAG_COMPRESSED) extents = new Extents;
+  return 0;
+}
+
+RC PageFile::setFormat(int format)
+{
+  FileHeader header;
+  alignas(DIRECT_ALIGNMENT) char page[PAGE_SIZE];
+
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+
+  // a file without a header page has nowhere to keep it
+  if (base == 0) return (format == 0) ? 0 : RC_NOT_SUPPORTED;
+
+  if (readPage(0, page) < PAGE_SIZE) return RC_FILE_READ_FAILED;
+  memcpy(&header, page, sizeof(header));
+  header.format = format;
+  memcpy(page, &header, sizeof(header));
+  if (writePage(0, page) < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
+
+  this->format = format;
+  return 0;
+}
+
+RC PageFile::setCompression(bool on)
+{
+  FileHeader header;
+  alignas(DIRECT_ALIGNMENT) char page[PAGE_SIZE];
+
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+  if (on == isCompressed()) return 0;
+
+  // the pages are laid out differently, so it has to be decided
+  // before the first page is written
+  if (base == 0 || epid > 0) return RC_NOT_SUPPORTED;
+
+  if (readPage(0, page) < PAGE_SIZE) return RC_FILE_READ_FAILED;
+  memcpy(&header, page, sizeof(header));
+  if (on) header.flags |= FLAG_COMPRESSED;
+  else header.flags &= ~FLAG_COMPRESSED;
+  memcpy(page, &header, sizeof(header));
+  if (writePage(0, page) < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
+
+  if (on) {
+    extents = new Extents;
+    return openExtents(0);
+  }
+  delete extents;
+  extents = NULL;
+  return 0;
+}
+
+RC PageFile::openExtents(PageId pages)
+{
+  RC   rc;
+  ExtentTrailer trailer;
+  alignas(DIRECT_ALIGNMENT) char page[PAGE_SIZE];
+  Extents& x = *extents;
+
+  x.directory.clear();
+  x.tail.assign(EXTENT_BYTES, 0);
+  x.tailPid = 0;
+  x.tailDirty = false;
+  x.directoryDirty = false;
+  x.end = base;
   epid = 0;
+  if (pages == 0) return 0;
+
+  // the trailer is the last disk page
+  if (readPage(base + pages - 1, page) < PAGE_SIZE) return RC_FILE_READ_FAILED;
+  memcpy(&trailer, page, sizeof(trailer));
+  if (trailer.magic != EXTENT_MAGIC || trailer.count < 0 || trailer.directory < base ||
+      trailer.directory >= base + pages || trailer.pages < 0 ||
+      trailer.pages > trailer.count * EXTENT_PAGES ||
+      trailer.pages <= (trailer.count - 1) * EXTENT_PAGES) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+
+  // the directory is in the pages before it
+  x.directory.resize(trailer.count);
+  for (int i = 0; i < trailer.count; i += ENTRIES_PER_PAGE) {
+    if (readPage(trailer.directory + i / ENTRIES_PER_PAGE, page) < PAGE_SIZE) return RC_FILE_READ_FAILED;
+    int n = std::min(ENTRIES_PER_PAGE, trailer.count - i);
+    memcpy(&x.directory[i], page, n * sizeof(ExtentEntry));
+  }
+  x.end = trailer.directory;
+  epid = trailer.pages;
+
+  // pages are added to the last extent in memory
+  if (trailer.count > 0) {
+    x.tailPid = (trailer.count - 1) * EXTENT_PAGES;
+    if ((rc = readExtent(x.tailPid, &x.tail[0], false)) < 0) return rc;
+  }
+  return 0;
+}
+
+RC PageFile::readExtent(PageId pid, char* buffer, bool cache) const
+{
+  const ExtentEntry& e = extents->directory[pid / EXTENT_PAGES];
+  alignas(DIRECT_ALIGNMENT) char disk[EXTENT_BYTES];
+  int bytes = (e.length > 0) ? e.length : e.pages * PAGE_SIZE;
+  int pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  if (bytes > EXTENT_BYTES || e.pages < 1 || e.pages > EXTENT_PAGES) return RC_INVALID_FILE_FORMAT;
+
+  // the whole extent is read with one system call
+  unsigned long long start = IoStats::now();
+  ssize_t n = ::pread(fd, disk, (size_t)pages * PAGE_SIZE, (off_t)e.disk * PAGE_SIZE);
+  IoStats::countSyscall(stats, start);
+  if (n < bytes) return RC_FILE_READ_FAILED;
+  IoStats::count(stats, IoStats::PHYSICAL_READS, pages);
+  IoStats::count(stats, IoStats::BYTES_READ, n);
+
+  if (e.length == 0) {
+    memcpy(buffer, disk, bytes);
+  } else if (Compression::decompress(disk, e.length, buffer, EXTENT_BYTES) != e.pages * PAGE_SIZE) {
+    return RC_INVALID_FILE_FORMAT;
+  }
+  if (!cache) return 0;
+
+  // the other pages of the extent are likely to be read next
+  PageId first = pid - pid % EXTENT_PAGES;
+  for (int i = 0; i < e.pages; i++) {
+    int frame = bufferPool.fetch(fd, first + i + base, BufferPool::FETCH_FILL, stats);
+    if (frame < 0) continue;  // cached already, or no frame to spare
+    memcpy(bufferPool.data(frame), buffer + (size_t)i * PAGE_SIZE, PAGE_SIZE);
+    bufferPool.filled(frame);
+    bufferPool.unpin(frame);
+  }
+  return 0;
+}
+
+RC PageFile::writeExtent()
+{
+  Extents& x = *extents;
+  alignas(DIRECT_ALIGNMENT) char disk[EXTENT_BYTES];
+  int index = x.tailPid / EXTENT_PAGES;
+  int raw = (epid - x.tailPid) * PAGE_SIZE;
+  ExtentEntry e;
+
+  if (!x.tailDirty || raw <= 0) return 0;
+
+  // keep the extent as it is if it does not get smaller
+  e.pages = epid - x.tailPid;
+  e.length = Compression::compress(&x.tail[0], raw, disk, raw - 1);
+  int bytes = e.length;
+  if (e.length < 0) {
+    e.length = 0;
+    bytes = raw;
+    memcpy(disk, &x.tail[0], raw);
+  }
+  int pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+  memset(disk + bytes, 0, (size_t)pages * PAGE_SIZE - bytes);
+
+  // the last extent is written over its old copy, which nothing follows
+  // but the directory
+  e.disk = (index < (int)x.directory.size()) ? x.directory[index].disk : x.end;
+
+  size_t size = (size_t)pages * PAGE_SIZE;
+  size_t done = 0;
+  while (done < size) {
+    unsigned long long start = IoStats::now();
+    ssize_t n = ::pwrite(fd, disk + done, size - done, (off_t)e.disk * PAGE_SIZE + done);
+    IoStats::countSyscall(stats, start);
+    if (n <= 0) return RC_FILE_WRITE_FAILED;
+    done += n;
+  }
+  IoStats::count(stats, IoStats::PHYSICAL_WRITES, pages);
+  IoStats::count(stats, IoStats::BYTES_WRITTEN, size);
+
+  if (index < (int)x.directory.size()) x.directory[index] = e;
+  else x.directory.push_back(e);
+  x.end = e.disk + pages;
+  x.tailDirty = false;
+  x.directoryDirty = true;
+  return 0;
+}
+
+RC PageFile::flushExtents()
+{
+  RC rc;
+  Extents& x = *extents;
+  ExtentTrailer trailer;
+  alignas(DIRECT_ALIGNMENT) char page[PAGE_SIZE];
+
+  if ((rc = writeExtent()) < 0) return rc;
+  if (!x.directoryDirty) return 0;
+
+  trailer.magic = EXTENT_MAGIC;
+  trailer.count = x.directory.size();
+  trailer.directory = x.end;
+  trailer.pages = epid;
+
+  PageId disk = x.end;
+  for (int i = 0; i < trailer.count; i += ENTRIES_PER_PAGE) {
+    int n = std::min(ENTRIES_PER_PAGE, trailer.count - i);
+    memset(page, 0, PAGE_SIZE);
+    memcpy(page, &x.directory[i], n * sizeof(ExtentEntry));
+    if (writePage(disk++, page) < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
+  }
+  memset(page, 0, PAGE_SIZE);
+  memcpy(page, &trailer, sizeof(trailer));
+  if (writePage(disk++, page) < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
+
+  // the old trailer may lie further out if the extents got smaller
+  if (::ftruncate(fd, (off_t)disk * PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+
+  x.directoryDirty = false;
   return 0;
 }
 
+bool PageFile::dropDirect()
+{
+  int flags = ::fcntl(fd, F_GETFL);
+
+  if (!direct || flags < 0 || ::fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0) return false;
+  direct = false;
+  return true;
+}
+
+ssize_t PageFile::readPage(PageId page, void* buffer) const
+{
+  off_t offset = (off_t)page * PAGE_SIZE;
+
+  if (!direct || ((size_t)buffer & (DIRECT_ALIGNMENT - 1)) == 0) {
+    return ::pread(fd, buffer, PAGE_SIZE, offset);
+  }
+
+  // direct I/O needs aligned memory
+  alignas(DIRECT_ALIGNMENT) char bounce[PAGE_SIZE];
+  ssize_t n = ::pread(fd, bounce, PAGE_SIZE, offset);
+  if (n > 0) memcpy(buffer, bounce, n);
+  return n;
+}
+
+ssize_t PageFile::writePage(PageId page, const void* buffer)
+{
+  off_t offset = (off_t)page * PAGE_SIZE;
+
+  if (!direct || ((size_t)buffer & (DIRECT_ALIGNMENT - 1)) == 0) {
+    return ::pwrite(fd, buffer, PAGE_SIZE, offset);
+  }
+
+  // direct I/O needs aligned memory
+  alignas(DIRECT_ALIGNMENT) char bounce[PAGE_SIZE];
+  memcpy(bounce, buffer, PAGE_SIZE);
+  return ::pwrite(fd, bounce, PAGE_SIZE, offset);
+}
+
+RC PageFile::flush()
+{
+  RC rc;
+
+  if (fd < 0) return 0;
+  if (extents != NULL && (rc = flushExtents()) < 0) return rc;
+  return bufferPool.flushFile(fd);
+}
+
 PageId PageFile::endPid() const 
 {
   return epid;
 }
 
-RC PageFile::seek(PageId pid) const
+RC PageFile::advise(Access access) const
+{
+  int madv, fadv;
+
+  this->access = access;
+  if (fd < 0) return 0;
+
+  switch (access) {
+  case ACCESS_SEQUENTIAL:
+    madv = MADV_SEQUENTIAL;
+    fadv = POSIX_FADV_SEQUENTIAL;
+    break;
+  case ACCESS_RANDOM:
+    madv = MADV_RANDOM;
+    fadv = POSIX_FADV_RANDOM;
+    break;
+  default:
+    madv = MADV_NORMAL;
+    fadv = POSIX_FADV_NORMAL;
+    break;
+  }
+
+  if (map != NULL) {
+    return (::madvise(map, (size_t)(epid + base) * PAGE_SIZE, madv) < 0) ? RC_FILE_READ_FAILED : 0;
+  }
+  // posix_fadvise() returns the error number instead of setting errno
+  return (::posix_fadvise(fd, 0, 0, fadv) != 0) ? RC_FILE_READ_FAILED : 0;
+}
+
+void PageFile::readAhead(PageId pid) const
+{
+  if (readAheadPages <= 1 || access == ACCESS_RANDOM) return;
+
+  // a reader is sequential when it says so or when it moves to the next page
+  PageId last = lastPid.exchange(pid, std::memory_order_relaxed);
+  if (pid == last) return;
+  if (access != ACCESS_SEQUENTIAL && pid != last + 1) return;
+
+  // start over when the reader left the window
+  PageId start = aheadPid.load(std::memory_order_relaxed);
+  if (start < pid || start > pid + readAheadPages) start = pid;
+
+  // refill the window once the reader is half way through it
+  if (start - pid > readAheadPages / 2) return;
+  PageId end = pid + readAheadPages;
+  if (end > epid) end = epid;
+  if (start >= end) return;
+
+  aheadPid.store(end, std::memory_order_relaxed);
+  bufferPool.readAhead(fd, start + base, end - start, stats);
+}
+
+bool PageFile::isWritable(PageId pid) const
 {
-  return (::lseek(fd, pid * PAGE_SIZE, SEEK_SET) < 0) ? RC_FILE_SEEK_FAILED : 0;
+  if (pid < 0 || fd < 0) return false;
+  if (extents == NULL) return true;
+  return pid >= extents->tailPid && pid <= epid;
 }
 
 RC PageFile::write(PageId pid, const void* buffer)
 {
-  RC rc;
+  int frame;
+
   if (pid < 0) return RC_INVALID_PID; 
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+
+  if (extents != NULL) {
+    Extents& x = *extents;
 
-  // seek to the location of the page
-  if ((rc = seek(pid)) < 0) return rc;
+    // a compressed file only grows at the end
+    if (pid < x.tailPid || pid > epid) return RC_NOT_SUPPORTED;
+    if (pid >= x.tailPid + EXTENT_PAGES) {
+      RC rc;
+      if ((rc = writeExtent()) < 0) return rc;
+      x.tailPid += EXTENT_PAGES;
+      memset(&x.tail[0], 0, EXTENT_BYTES);
+    }
+    memcpy(&x.tail[(size_t)(pid - x.tailPid) * PAGE_SIZE], buffer, PAGE_SIZE);
+    x.tailDirty = true;
+    if (pid >= epid) epid = pid + 1;
+    IoStats::count(stats, IoStats::LOGICAL_WRITES);
+    return 0;
+  }
 
-  // write the buffer to the disk page
-  if (::write(fd, buffer, PAGE_SIZE) < 0) return RC_FILE_WRITE_FAILED;
+  if (writeBack) {
+    // keep the page dirty in the buffer pool
+    frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_OVERWRITE, stats);
+    if (frame >= 0) {
+      if (bufferPool.data(frame) != buffer) {
+        memcpy(bufferPool.data(frame), buffer, PAGE_SIZE);
+      }
+      bufferPool.setDirty(frame);
+      bufferPool.unpin(frame);
+    }
+  } else {
+    frame = -1;
+  }
 
-  // if the page is in read cache, invalidate it
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid &&
-        readCache[i].lastAccessed != 0) {
-       readCache[i].fd = 0;
-       readCache[i].pid = 0;
-       readCache[i].lastAccessed = 0;
-       break;
+  if (frame < 0) {
+    // write the buffer to the disk page
+    unsigned long long start = IoStats::now();
+    ssize_t n = writePage(pid + base, buffer);
+    IoStats::countSyscall(stats, start);
+    if (n < PAGE_SIZE) {
+      return RC_FILE_WRITE_FAILED;
     }
+
+    // if the page is cached, keep the cached copy up to date
+    frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_CACHED, stats);
+    if (frame >= 0) {
+      if (bufferPool.data(frame) != buffer) {
+        memcpy(bufferPool.data(frame), buffer, PAGE_SIZE);
+      }
+      bufferPool.unpin(frame);
+    }
+
+    IoStats::count(stats, IoStats::PHYSICAL_WRITES);
+    IoStats::count(stats, IoStats::BYTES_WRITTEN, PAGE_SIZE);
   }
 
   // if the written pid >= end pid, update the end pid
   if (pid >= epid) epid = pid + 1;
 
-  // increase page write count
-  writeCount++;
+  IoStats::count(stats, IoStats::LOGICAL_WRITES);
 
   return 0;
 }
 
-RC PageFile::read(PageId pid, void* buffer) const
+RC PageFile::writeBatch(PageId pid, const void* buffer, int n)
 {
-  RC rc;
+  const char* src = (const char*)buffer;
 
-  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+  if (pid < 0) return RC_INVALID_PID; 
+  if (fd < 0) return RC_FILE_WRITE_FAILED;
+
+  // a compressed file collects the pages into extents
+  if (extents != NULL) {
+    RC rc;
+    for (int i = 0; i < n; i++) {
+      if ((rc = write(pid + i, src + (size_t)i * PAGE_SIZE)) < 0) return rc;
+    }
+    return 0;
+  }
 
-  //
-  // if the page is in cache, read it from there
-  //
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].fd == fd && readCache[i].pid == pid && 
-        readCache[i].lastAccessed != 0) {
-       memcpy(buffer, readCache[i].buffer, PAGE_SIZE);
-       readCache[i].lastAccessed = ++cacheClock;
-       return 0;
+  // update the cached copies first, so a dirty copy flushed
+  // in the meantime cannot overwrite the new content
+  for (int i = 0; i < n; i++) {
+    int frame = bufferPool.fetch(fd, pid + i + base, BufferPool::FETCH_CACHED, stats);
+    if (frame >= 0) {
+      memcpy(bufferPool.data(frame), src + (size_t)i * PAGE_SIZE, PAGE_SIZE);
+      bufferPool.unpin(frame);
     }
   }
 
-  // seek to the page
-  if ((rc = seek(pid)) < 0) return rc;
-  
-  // find the cache slot to evict
-  int toEvict = 0; 
-  for (int i = 0; i < CACHE_COUNT; i++) {
-    if (readCache[i].lastAccessed == 0) {
-      toEvict = i;
-      break;
+  if (direct && ((size_t)buffer & (DIRECT_ALIGNMENT - 1)) != 0) {
+    // direct I/O needs aligned memory. go through the bounce buffer
+    for (int i = 0; i < n; i++) {
+      unsigned long long start = IoStats::now();
+      ssize_t written = writePage(pid + i + base, src + (size_t)i * PAGE_SIZE);
+      IoStats::countSyscall(stats, start);
+      if (written < PAGE_SIZE) return RC_FILE_WRITE_FAILED;
     }
-    if (readCache[i].lastAccessed < readCache[toEvict].lastAccessed) {
-      toEvict = i;
+  } else {
+    // pwrite() may stop short of a large request
+    size_t size = (size_t)n * PAGE_SIZE;
+    size_t done = 0;
+    while (done < size) {
+      unsigned long long start = IoStats::now();
+      ssize_t written = ::pwrite(fd, src + done, size - done, (off_t)(pid + base) * PAGE_SIZE + done);
+      IoStats::countSyscall(stats, start);
+      if (written < 0 && errno == EINVAL && dropDirect()) continue;
+      if (written <= 0) return RC_FILE_WRITE_FAILED;
+      done += written;
     }
   }
-  readCache[toEvict].fd = fd;
-  readCache[toEvict].pid = pid;
-  readCache[toEvict].lastAccessed = ++cacheClock;
- 
-  // read the page to cache first and copy it to the buffer
-  if (::read(fd, readCache[toEvict].buffer, PAGE_SIZE) < 0) {
-    return RC_FILE_READ_FAILED;
+
+  IoStats::count(stats, IoStats::LOGICAL_WRITES, n);
+  IoStats::count(stats, IoStats::PHYSICAL_WRITES, n);
+  IoStats::count(stats, IoStats::BYTES_WRITTEN, (unsigned long long)n * PAGE_SIZE);
+
+  // if the written pages go beyond the end pid, update the end pid
+  if (pid + n > epid) epid = pid + n;
+
+  return 0;
+}
+
+RC PageFile::read(PageId pid, void* buffer) const
+{
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+  IoStats::count(stats, IoStats::LOGICAL_READS);
+
+  if (map != NULL) {
+    memcpy(buffer, mapPage(pid), PAGE_SIZE);
+    return 0;
   }
-  memcpy(buffer, readCache[toEvict].buffer, PAGE_SIZE);
 
-  // increase the page read count
-  readCount++;
+  if (extents != NULL) {
+    // the last extent is in memory
+    if (pid >= extents->tailPid) {
+      memcpy(buffer, &extents->tail[(size_t)(pid - extents->tailPid) * PAGE_SIZE], PAGE_SIZE);
+      IoStats::count(stats, IoStats::CACHE_HITS);
+      return 0;
+    }
 
+    int frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_CACHED, stats);
+    if (frame >= 0) {
+      memcpy(buffer, bufferPool.data(frame), PAGE_SIZE);
+      bufferPool.unpin(frame);
+      IoStats::count(stats, IoStats::CACHE_HITS);
+      return 0;
+    }
+
+    char extent[EXTENT_BYTES];
+    RC rc;
+    if ((rc = readExtent(pid, extent, true)) < 0) return rc;
+    memcpy(buffer, extent + (size_t)(pid % EXTENT_PAGES) * PAGE_SIZE, PAGE_SIZE);
+    return 0;
+  }
+
+  readAhead(pid);
+  int frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_READ, stats);
+
+  if (frame >= 0) {
+    memcpy(buffer, bufferPool.data(frame), PAGE_SIZE);
+    bufferPool.unpin(frame);
+    return 0;
+  }
+  if (frame != RC_FRAME_PINNED) return frame;
+
+  // every frame is pinned. read the page directly into the buffer
+  unsigned long long start = IoStats::now();
+  ssize_t n = readPage(pid + base, buffer);
+  IoStats::countSyscall(stats, start);
+  if (n < 0) return RC_FILE_READ_FAILED;
+
+  IoStats::count(stats, IoStats::PHYSICAL_READS);
+  IoStats::count(stats, IoStats::BYTES_READ, n);
+
+  return 0;
+}
+
+RC PageFile::pin(PageId pid, char*& page) const
+{
+  if (pid < 0 || pid >= epid) return RC_INVALID_PID; 
+  IoStats::count(stats, IoStats::LOGICAL_READS);
+
+  if (map != NULL) {
+    page = mapPage(pid);
+    return 0;
+  }
+
+  if (extents != NULL) {
+    if (pid >= extents->tailPid) {
+      page = &extents->tail[(size_t)(pid - extents->tailPid) * PAGE_SIZE];
+      IoStats::count(stats, IoStats::CACHE_HITS);
+      return 0;
+    }
+
+    int frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_CACHED, stats);
+    if (frame >= 0) {
+      IoStats::count(stats, IoStats::CACHE_HITS);
+    } else {
+      // bring the extent in and pin the page from the pool.
+      // the page is not there if the pool had no frame to spare
+      char extent[EXTENT_BYTES];
+      RC rc;
+      if ((rc = readExtent(pid, extent, true)) < 0) return rc;
+      frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_CACHED, stats);
+      if (frame < 0) return RC_FRAME_PINNED;
+    }
+    page = bufferPool.data(frame);
+    return 0;
+  }
+
+  readAhead(pid);
+  int frame = bufferPool.fetch(fd, pid + base, BufferPool::FETCH_READ, stats);
+  if (frame < 0) return frame;
+
+  page = bufferPool.data(frame);
   return 0;
 }
+
+RC PageFile::prefetch(const PageId* pids, int n) const
+{
+  // the extents of a compressed file are read when they are needed
+  if (fd < 0 || extents != NULL) return 0;
+
+  if (map != NULL) {
+    // madvise() works on whole memory pages
+    static const size_t pageMask = ::sysconf(_SC_PAGESIZE) - 1;
+    for (int i = 0; i < n; i++) {
+      if (pids[i] < 0 || pids[i] >= epid) continue;
+      size_t addr = (size_t)(map + (size_t)(pids[i] + base) * PAGE_SIZE);
+      size_t start = addr & ~pageMask;
+      ::madvise((void*)start, addr + PAGE_SIZE - start, MADV_WILLNEED);
+    }
+    return 0;
+  }
+
+  vector<PageId> disk;
+  for (int i = 0; i < n; i++) {
+    if (pids[i] >= 0 && pids[i] < epid) disk.push_back(pids[i] + base);
+  }
+  if (disk.empty()) return 0;
+
+  RC rc = bufferPool.prefetch(fd, &disk[0], disk.size(), stats);
+  return (rc < 0) ? rc : 0;
+}
+
+void PageFile::unpin(PageId pid) const
+{
+  // the pages of the last extent of a compressed file are not pinned
+  if (extents != NULL && pid >= extents->tailPid) return;
+  if (map == NULL) bufferPool.unpin(fd, pid + base);
+}
+
+char* PageFile::mapPage(PageId pid) const
+{
+  // count the first access to a page as a page read. the kernel does
+  // the actual I/O on a page fault, so no system call is counted
+  if (touched[pid].exchange(1, std::memory_order_relaxed) == 0) {
+    IoStats::count(stats, IoStats::PHYSICAL_READS);
+    IoStats::count(stats, IoStats::BYTES_READ, PAGE_SIZE);
+  } else {
+    IoStats::count(stats, IoStats::CACHE_HITS);
+  }
+  return map + (size_t)(pid + base) * PAGE_SIZE;
+}
+
+RC PageFile::setCacheSize(size_t bytes)
+{
+  return bufferPool.setCapacity(bytes);
+}
+
+size_t PageFile::getCacheSize()
+{
+  return bufferPool.getCapacity();
+}
+
+RC PageFile::setCachePolicy(const char* name)
+{
+  ReplacementPolicy::Kind kind;
+
+  if (!ReplacementPolicy::parse(name, kind)) return RC_NOT_SUPPORTED;
+  return bufferPool.setPolicy(kind);
+}
+
+const char* PageFile::getCachePolicy()
+{
+  return ReplacementPolicy::name(bufferPool.getPolicy());
+}
+
+unsigned long long PageFile::getCacheHitCount()
+{
+  return bufferPool.getHitCount();
+}
+
+unsigned long long PageFile::getCacheMissCount()
+{
+  return bufferPool.getMissCount();
+}
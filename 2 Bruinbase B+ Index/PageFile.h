@@ -10,25 +10,56 @@
 #ifndef PAGEFILE_H
 #define PAGEFILE_H
 
+#include <atomic>
 #include <string>
+#include <cstddef>
+#include <sys/types.h>
 #include "Bruinbase.h"
+#include "IoStats.h"
 
 typedef int PageId;
 
+// the page size is fixed when bruinbase is built, e.g. "make PAGE_SIZE=4096"
+#ifndef BRUINBASE_PAGE_SIZE
+#define BRUINBASE_PAGE_SIZE 1024
+#endif
+
+class BufferPool;
+
 /**
- * read/write a file in the unit of a page
+ * read/write a file in the unit of a page.
+ * read(), pin() and unpin() may be called by several threads at the same
+ * time, also on the same PageFile. open(), write(), flush() and close()
+ * need exclusive access to the PageFile.
  */
 class PageFile {
  public:
 
-  static const int PAGE_SIZE = 1024;    // the size of a page is 1KB
+  static const int PAGE_SIZE = BRUINBASE_PAGE_SIZE; // 1KB by default
+  static const int LEGACY_PAGE_SIZE = 1024; // files without a header use 1KB pages
+  static const int FILE_MAGIC = 0x42425246;   // "FRBB" on little endian
+  static const int FILE_VERSION = 1;
+  static const int DIRECT_ALIGNMENT = 4096; // memory alignment for direct I/O
+  static const int EXTENT_PAGES = (PAGE_SIZE < 16384) ? 16384 / PAGE_SIZE : 1; // see setCompression()
+
+  /**
+   * the expected access pattern of a file. see advise().
+   */
+  enum Access { ACCESS_NORMAL, ACCESS_SEQUENTIAL, ACCESS_RANDOM };
 
   PageFile();
   PageFile(const std::string& filename, char mode);
 
+  /**
+   * close the file if it is still open so that no dirty page is lost.
+   */
+  ~PageFile();
+
   /**
    * open a file in read or write mode.
    * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'r' mode, the whole file is memory-mapped unless
+   * mapping is turned off with setMmap(false).
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
    * @return error code. 0 if no error
@@ -36,10 +67,17 @@ class PageFile {
   RC open(const std::string& filename, char mode);
 
   /**
-   * close the file.
+   * close the file. the dirty pages of the file are written back first.
    * @return error code. 0 if no error
    */
   RC close();
+
+  /**
+   * write back the dirty pages of the file in page-id order.
+   * adjacent pages are written with a single system call.
+   * @return error code. 0 if no error
+   */
+  RC flush();
   
   /**
    * read a disk page into memory buffer.
@@ -48,17 +86,69 @@ class PageFile {
    * @return error code. 0 if no error
    */
   RC read(PageId pid, void *buffer) const;
+
+  /**
+   * pin a disk page in the buffer pool and return its frame so that the
+   * caller can work on it in place. the frame stays valid until unpin().
+   * changes made through the frame reach the disk only when the frame
+   * is passed to write(). for a memory-mapped file the page is returned
+   * directly from the mapping and must not be modified.
+   * @param pid[IN] the page to pin
+   * @param page[OUT] the frame that holds the page
+   * @return error code. 0 if no error
+   */
+  RC pin(PageId pid, char*& page) const;
+
+  /**
+   * start reading a set of pages in the background so that later read()
+   * and pin() calls find them in memory. the call does not wait for the
+   * disk. the pages are read through the shared IoEngine, or for a
+   * memory-mapped file by the kernel.
+   * @param pids[IN] the pages to read. invalid page ids are ignored
+   * @param n[IN] # of pages
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const PageId* pids, int n) const;
+
+  /**
+   * release a page pinned by pin().
+   * @param pid[IN] the page to unpin
+   */
+  void unpin(PageId pid) const;
   
   /**
    * write the memory buffer to the disk page.
    * if (pid >= endPid()), the file is expanded such that
    * endPid() becomes (pid + 1).
+   * in write-back mode the page is kept dirty in the buffer pool
+   * and reaches the disk on eviction, flush() or close().
    * @param pid[IN] page to write to
    * @param buffer[IN] the content to write
    * @return error code. 0 if no error
    */
   RC write(PageId pid, const void *buffer);
+
+  /**
+   * write a run of consecutive pages to the disk with one system call.
+   * unlike write(), the pages do not go through the buffer pool, so a
+   * bulk load does not push everything else out of it. cached copies
+   * of the pages are updated.
+   * @param pid[IN] the first page of the run
+   * @param buffer[IN] n pages of content
+   * @param n[IN] # of pages
+   * @return error code. 0 if no error
+   */
+  RC writeBatch(PageId pid, const void* buffer, int n);
     
+  /**
+   * tell the kernel how the file is going to be accessed. a file read
+   * through the buffer pool also starts reading ahead right away when
+   * ACCESS_SEQUENTIAL is given, and never when ACCESS_RANDOM is given.
+   * @param access[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(Access access) const;
+
   /**
    * note the +1 part. The last page id in the file is actually endPid()-1.
    * that is, the last page can be read by "read(endPid()-1, buffer)".
@@ -66,47 +156,250 @@ class PageFile {
    */
   PageId endPid() const;
 
+  /**
+   * @return the I/O stats of the file, kept across every open() of the
+   *         same file name. NULL if the file has never been opened
+   */
+  IoStats* getStats() const { return stats; }
+
+  /**
+   * @return the format number stored in the header of the file.
+   *         0 for a file that never had one set
+   */
+  int getFormat() const { return format; }
+
+  /**
+   * store a format number in the header of the file, so that the user
+   * of the file can tell later how its pages are laid out.
+   * @param format[IN] the format number
+   * @return error code. RC_NOT_SUPPORTED for a file without a header
+   */
+  RC setFormat(int format);
+
+  /**
+   * @return true if the pages of the file are stored compressed
+   */
+  bool isCompressed() const { return extents != NULL; }
+
+  /**
+   * @param pid[IN] a page
+   * @return true if write() takes the page. a compressed file takes
+   *         only the pages of its last extent and the page at the end
+   */
+  bool isWritable(PageId pid) const;
+
+  /**
+   * store the pages of an empty file compressed from now on.
+   *
+   * the pages are compressed EXTENT_PAGES at a time. each extent takes
+   * as many disk pages as its compressed form needs, and a directory at
+   * the end of the file tells where each extent starts, so reading a
+   * page takes one disk read and one decompression. the decompressed
+   * pages of the extent are cached in the buffer pool. pages can only
+   * be written in the last extent, i.e. the file can only grow at the
+   * end; the last extent is kept in memory until flush().
+   * @param on[IN] true to compress the pages
+   * @return error code. RC_NOT_SUPPORTED for a file without a header
+   *         or a file that has pages already
+   */
+  RC setCompression(bool on);
+
   /**
    * @return the total # of disk reads
    */
-  static int getPageReadCount()  { return readCount; }
+  static unsigned long long getPageReadCount() { return IoStats::total().get(IoStats::PHYSICAL_READS); }
   
   /**
    * @return the total # of disk writes
    */
-  static int getPageWriteCount() { return writeCount; }
+  static unsigned long long getPageWriteCount() { return IoStats::total().get(IoStats::PHYSICAL_WRITES); }
+
+  /**
+   * @return the total # of write() calls, including the pages
+   *         that have not reached the disk yet
+   */
+  static unsigned long long getLogicalWriteCount() { return IoStats::total().get(IoStats::LOGICAL_WRITES); }
+
+  /**
+   * turn memory-mapping of files opened in 'r' mode on (the default) or off.
+   * @param on[IN] true to map read-only files
+   */
+  static void setMmap(bool on) { mmapReadOnly = on; }
+
+  /**
+   * open files with O_DIRECT so that their pages bypass the kernel page
+   * cache and are only cached by the buffer pool. direct files are never
+   * memory-mapped. a file system or device that does not take direct
+   * I/O of PAGE_SIZE blocks is used through the page cache as before.
+   * it affects the files opened afterwards.
+   * @param on[IN] true to turn direct I/O on. it is off by default
+   */
+  static void setDirectIo(bool on) { directIo = on; }
+
+  /**
+   * choose between write-back (the default) and write-through.
+   * @param on[IN] true for write-back, false for write-through
+   */
+  static void setWriteBack(bool on) { writeBack = on; }
+
+  /**
+   * set how many pages are read ahead of a sequential reader of a file
+   * that is not memory-mapped. 0 or 1 turns read-ahead off.
+   * @param pages[IN] # of pages in a read-ahead batch
+   */
+  static void setReadAhead(int pages) { readAheadPages = pages; }
+
+  /**
+   * @return # of pages in a read-ahead batch
+   */
+  static int getReadAhead() { return readAheadPages; }
+
+  /**
+   * resize the buffer pool shared by all page files.
+   * cached pages are dropped, so no page may be pinned.
+   * @param bytes[IN] the new size of the pool in bytes
+   * @return error code. 0 if no error
+   */
+  static RC setCacheSize(size_t bytes);
+
+  /**
+   * @return the size of the buffer pool in bytes
+   */
+  static size_t getCacheSize();
+
+  /**
+   * change the replacement policy of the buffer pool.
+   * cached pages are dropped, so no page may be pinned.
+   * @param name[IN] "lru" (the default), "clock", "2q" or "lru2"
+   * @return error code. 0 if no error
+   */
+  static RC setCachePolicy(const char* name);
+
+  /**
+   * @return the name of the replacement policy of the buffer pool
+   */
+  static const char* getCachePolicy();
+
+  /**
+   * @return # of page reads served by the buffer pool without a disk read
+   */
+  static unsigned long long getCacheHitCount();
+
+  /**
+   * @return # of page reads that missed the buffer pool
+   */
+  static unsigned long long getCacheMissCount();
 
  protected:
   /**
-   * move the file cursor to the beginning of a page.
+   * find a page in the mapping of the file.
    * this is an internal function not exposed to public.
-   * @param pid[IN] page to seek to
-   * @return error code. 0 if no error
+   * @param pid[IN] the page. it must be smaller than endPid()
+   * @return the address of the page in the mapping
    */
-  RC seek(PageId pid) const;
+  char* mapPage(PageId pid) const;
 
  private:
+  /**
+   * write the header page of a new file or validate the header of an
+   * existing one, and set base accordingly.
+   * @param size[IN] the size of the file in bytes
+   * @param writable[IN] whether the file is opened in 'w' mode
+   * @return error code. RC_INVALID_FILE_FORMAT if the file was created
+   *         with another page size
+   */
+  RC openHeader(off_t size, bool writable);
+
+  /**
+   * turn direct I/O off for the file after the kernel has refused it.
+   * @return true if it was on
+   */
+  bool dropDirect();
+
+  /**
+   * read a disk page, copying through aligned memory if direct I/O
+   * needs it.
+   * @param page[IN] the disk page, counting the header pages
+   * @param buffer[OUT] the memory to read into
+   * @return # of bytes read or -1 with errno set
+   */
+  ssize_t readPage(PageId page, void* buffer) const;
+
+  /**
+   * write a disk page, copying through aligned memory if direct I/O
+   * needs it.
+   * @param page[IN] the disk page, counting the header pages
+   * @param buffer[IN] the content to write
+   * @return # of bytes written or -1 with errno set
+   */
+  ssize_t writePage(PageId page, const void* buffer);
+
+  /**
+   * read the pages following pid into the buffer pool if the file
+   * is being read sequentially.
+   * @param pid[IN] the page that is about to be read
+   */
+  void readAhead(PageId pid) const;
+
+  // the extents of a compressed file
+  struct Extents;
+
+  /**
+   * read the extent directory of a compressed file and bring its last
+   * extent into memory.
+   * @param pages[IN] # of disk pages after the header
+   * @return error code. 0 if no error
+   */
+  RC openExtents(PageId pages);
+
+  /**
+   * read and decompress the extent of a page of a compressed file.
+   * @param pid[IN] the page
+   * @param buffer[OUT] the content of the extent, EXTENT_PAGES pages
+   * @param cache[IN] true to cache the pages of the extent in the buffer pool
+   * @return error code. 0 if no error
+   */
+  RC readExtent(PageId pid, char* buffer, bool cache) const;
+
+  /**
+   * compress the last extent of a compressed file and write it to the disk.
+   * @return error code. 0 if no error
+   */
+  RC writeExtent();
+
+  /**
+   * write the last extent and the extent directory of a compressed file.
+   * @return error code. 0 if no error
+   */
+  RC flushExtents();
+
   int     fd;     // file descriptor of the associated unix file
   PageId  epid;   // (last page id + 1) of the file
+  int     base;   // # of header pages in front of page 0. 0 for old files
+  int     format; // the format number in the header
+  bool    direct; // true if the file is opened with O_DIRECT
+  char*   map;    // the file mapped in memory. NULL if it is not mapped
+  std::atomic<char>* touched; // the pages of the mapping read so far
+  Extents* extents; // the extent directory. NULL unless the file is compressed
+  IoStats* stats; // the I/O stats of the file
+  mutable std::atomic<int> access;      // the Access given to advise()
+  mutable std::atomic<PageId> lastPid;  // the page read most recently
+  mutable std::atomic<PageId> aheadPid; // the first page not read ahead yet
 
-  //
-  // the following set of members implement LRU caching 
-  //
-  static const int CACHE_COUNT = 10;
+  // the pages of all open files are cached in a shared buffer pool
+  static BufferPool bufferPool;
 
-  static int cacheClock; // clock tick counter for LRU policy
+  static bool writeBack; // keep written pages dirty in the buffer pool
+  static bool mmapReadOnly; // map the files opened in 'r' mode
+  static bool directIo; // open files with O_DIRECT
+  static int readAheadPages; // # of pages read ahead of a sequential reader
 
-  // the actual cache data structure
-  static struct cacheStruct {
-    int    fd;              // file id of the cached page
-    PageId pid;             // page id of the cached page
-    int    lastAccessed;    // the last time the cached page was accessed
-                            //   (lastAccessed == 0) means that the buffer is empty
-    char buffer[PAGE_SIZE]; // the buffer used for caching
-  } readCache[CACHE_COUNT];
+  // a copy would share fd and the mapping
+  PageFile(const PageFile&);
+  PageFile& operator=(const PageFile&);
 
-  static int readCount;  // total # of page reads 
-  static int writeCount; // total # of page writes 
+  static_assert(PAGE_SIZE >= 1024 && PAGE_SIZE <= 65536 && (PAGE_SIZE & (PAGE_SIZE - 1)) == 0,
+                "BRUINBASE_PAGE_SIZE must be a power of 2 between 1KB and 64KB");
 };
   
 #endif // PAGEFILE_H
@@ -9,9 +9,13 @@
 
 #include "Bruinbase.h"
 #include "RecordFile.h"
+#include <algorithm>
 #include <cstring>
+#include <memory>
+#include <vector>
 
 using std::string;
+using std::vector;
 
 //
 // helper functions for page manipultation
@@ -20,9 +24,6 @@ using std::string;
 // compute the pointer to the n'th slot in a page
 static char* slotPtr(char* page, int n);
 
-// read the record in the n'th slot in the page
-static void readSlot(const char* page, int n, int& key, std::string& value);
-
 // write the record to the n'th slot in the page
 static void writeSlot(char* page, int n, int key, const std::string& value);
 
@@ -32,6 +33,210 @@ static int getRecordCount(const char* page);
 // update # records stored in the page
 static void setRecordCount(char* page, int count);
 
+// store a value in a slot of MAX_VALUE_LENGTH bytes
+static void writeValue(char* ptr, const std::string& value);
+
+//
+// FORMAT_PAX pages hold the slots of FORMAT_FIXED pages, but the keys
+// of all slots come first, one after another, followed by the values.
+// a query on the keys alone touches only the first part of the page.
+//
+
+// compute the pointer to the keys of a page
+static char* paxKeys(char* page);
+
+// compute the pointer to the value of the n'th slot in a page
+static char* paxValue(char* page, int n);
+
+// write the record to the n'th slot in the page
+static void paxWrite(char* page, int n, int key, const std::string& value);
+
+//
+// FORMAT_DICT pages hold DICT_RECORDS_PER_PAGE keys, laid out as in
+// FORMAT_PAX pages, followed by the dictionary code of each value.
+//
+
+// compute the pointer to the codes of a page
+static char* dictCodes(char* page);
+
+// write the record to the n'th slot in the page
+static void dictWrite(char* page, int n, int key, int code);
+
+// the name of a file kept next to a table file, e.g. its dictionary
+static std::string sideFileName(const std::string& filename, const char* extension);
+
+//
+// FORMAT_SLOTTED pages start with # records like FORMAT_FIXED pages,
+// followed by the start of the record area and the slot directory.
+// records are packed from the end of the page toward the directory,
+// so a slot id stays valid for the life of the file.
+//
+
+struct SlottedHeader {
+  int count;      // # records in the page. OVERFLOW_PAGE for an overflow page
+  int dataStart;  // the offset of the first byte of the record area
+};
+
+struct Slot {
+  unsigned short offset;  // where the record starts in the page
+  unsigned short length;  // # bytes of the record. OVERFLOW_SLOT if the
+                          // value is in overflow pages
+};
+
+// the record of a value kept in overflow pages
+struct OverflowRecord {
+  int    key;
+  int    length;  // the length of the value
+  PageId first;   // the first overflow page
+};
+
+// an overflow page holds a piece of a long value
+struct OverflowHeader {
+  int    marker;  // OVERFLOW_PAGE, in place of # records
+  PageId next;    // the next overflow page of the value. -1 at the end
+  int    length;  // # bytes of the value in this page
+};
+
+static const int OVERFLOW_PAGE = -1;
+static const unsigned short OVERFLOW_SLOT = 0xFFFF;
+static const int OVERFLOW_CHUNK = PageFile::PAGE_SIZE - sizeof(OverflowHeader);
+
+// make the page an empty slotted page
+static void initSlotted(char* page);
+
+// compute the pointer to the n'th slot of the directory
+static Slot* slottedSlot(char* page, int n);
+
+// get # bytes still free in a slotted page
+static int slottedFree(const char* page);
+
+// add a record to a slotted page and return its slot number
+static int slottedPut(char* page, const char* record, int size, unsigned short length);
+
+// build the slotted record of a value and return its size. the value
+// is in overflow pages from first on if it is longer than MAX_INLINE_LENGTH
+static int slottedRecord(char* record, int key, const std::string& value,
+                         PageId first, unsigned short& length);
+
+// # overflow pages a value takes
+static int overflowPages(const std::string& value);
+
+// make the page the i'th overflow page of a value
+static void overflowPage(char* page, const std::string& value, int i, PageId next);
+
+//
+// appendBatch() collects new pages in memory and writes them
+// BATCH_PAGES at a time with PageFile::writeBatch()
+//
+
+static const int BATCH_PAGES = (1024 * 1024) / PageFile::PAGE_SIZE;
+
+class PageBatch {
+ public:
+  PageBatch(PageFile& pf)
+    : pf(pf), buffer(new char[BATCH_PAGES * PageFile::PAGE_SIZE + PageFile::DIRECT_ALIGNMENT])
+  {
+    // aligned, so that direct I/O can write the run as it is
+    run = buffer.get() + (-(size_t)buffer.get() & (PageFile::DIRECT_ALIGNMENT - 1));
+    runPid = pf.endPid();
+    runCount = 0;
+    current = NULL;
+    pid = -1;
+  }
+
+  /**
+   * continue adding records to a page already in the file.
+   * @param p[IN] the page
+   * @return error code. 0 if no error
+   */
+  RC resume(PageId p)
+  {
+    pid = p;
+    current = tail;
+    return pf.read(p, tail);
+  }
+
+  /**
+   * take the next page at the end of the file.
+   * @param page[OUT] the page, to be filled by the caller
+   * @param p[OUT] its page id
+   * @return error code. 0 if no error
+   */
+  RC add(char*& page, PageId& p)
+  {
+    RC rc;
+    if (runCount == BATCH_PAGES && (rc = writeRun(true)) < 0) return rc;
+    page = run + (size_t)runCount * PageFile::PAGE_SIZE;
+    p = runPid + runCount;
+    runCount++;
+    return 0;
+  }
+
+  /**
+   * finish the current page and make a new page the current one.
+   * @return error code. 0 if no error
+   */
+  RC next()
+  {
+    RC rc;
+    if ((rc = finish()) < 0) return rc;
+    return add(current, pid);
+  }
+
+  /**
+   * write every page out.
+   * @return error code. 0 if no error
+   */
+  RC flush()
+  {
+    RC rc;
+    if ((rc = writeRun(false)) < 0) return rc;
+    return finish();
+  }
+
+  /**
+   * finish the current page. the next record goes to a new page.
+   * @return error code. 0 if no error
+   */
+  RC finish()
+  {
+    RC rc = 0;
+    // the pages of the run are written by writeRun(). the tail is not
+    if (current == tail) rc = pf.write(pid, tail);
+    current = NULL;
+    return rc;
+  }
+
+  char*  page() const { return current; }
+  PageId getPid() const { return pid; }
+
+ private:
+  // write the run to the disk. if keep is set, the current page is
+  // moved to tail, as records are still going to be added to it
+  RC writeRun(bool keep)
+  {
+    RC rc;
+    if (runCount == 0) return 0;
+    if (keep && current != NULL && current != tail) {
+      memcpy(tail, current, PageFile::PAGE_SIZE);
+      current = tail;
+    }
+    if ((rc = pf.writeBatch(runPid, run, runCount)) < 0) return rc;
+    runPid += runCount;
+    runCount = 0;
+    return 0;
+  }
+
+  PageFile& pf;
+  std::unique_ptr<char[]> buffer;
+  char*  run;       // the new pages not written yet
+  PageId runPid;    // the page id of the first page of the run
+  int    runCount;  // # pages in the run
+  char   tail[PageFile::PAGE_SIZE]; // the current page when it is not in the run
+  char*  current;   // the page records are added to. NULL if none
+  PageId pid;       // the page id of the current page
+};
+
 
 //
 // helper functions for RecordId manipulation
@@ -103,14 +308,19 @@ bool operator != (const RecordId& r1, const RecordId& r2)
 }
 
 
+RecordFile::Format RecordFile::defaultFormat = RecordFile::FORMAT_FIXED;
+bool RecordFile::defaultCompression = false;
+
 RecordFile::RecordFile()
 {
   erid.pid = 0;
   erid.sid = 0;
+  format = FORMAT_FIXED;
 }
 
 RecordFile::RecordFile(const string& filename, char mode)
 {
+  format = FORMAT_FIXED;
   open(filename, mode);
 }
 
@@ -121,6 +331,35 @@ RC RecordFile::open(const string& filename, char mode)
 
   // open the page file
   if ((rc = pf.open(filename, mode)) < 0) return rc;
+
+  // a new file takes the default format. an old file keeps its own
+  format = (Format)pf.getFormat();
+  if ((mode == 'w' || mode == 'W') && pf.endPid() == 0 && format != defaultFormat) {
+    if ((rc = pf.setFormat(defaultFormat)) < 0) {
+      pf.close();
+      return rc;
+    }
+    format = defaultFormat;
+  }
+  if ((mode == 'w' || mode == 'W') && pf.endPid() == 0 && defaultCompression) {
+    if ((rc = pf.setCompression(true)) < 0) {
+      pf.close();
+      return rc;
+    }
+  }
+  if (format != FORMAT_FIXED && format != FORMAT_SLOTTED && format != FORMAT_PAX &&
+      format != FORMAT_DICT) {
+    pf.close();
+    return RC_INVALID_FILE_FORMAT;
+  }
+  if (format == FORMAT_DICT && (rc = dict.open(sideFileName(filename, ".dic"), mode)) < 0) {
+    pf.close();
+    return rc;
+  }
+  if ((rc = zones.open(sideFileName(filename, ".zmp"), mode)) < 0) {
+    close();
+    return rc;
+  }
   
   //
   // in the rest of this function, we set the end record id
@@ -129,6 +368,9 @@ RC RecordFile::open(const string& filename, char mode)
   // get the end pid of the file
   erid.pid = pf.endPid();
 
+  // zones of pages the file does not have are left from an older file
+  zones.truncate(erid.pid);
+
   // if the end pid is zero, the file is empty.
   // set the end record id to (0, 0).
   if (erid.pid == 0) {
@@ -142,13 +384,26 @@ RC RecordFile::open(const string& filename, char mode)
   if ((rc = pf.read(--erid.pid, page)) < 0) {
     // an error occurred during page read
     erid.pid = erid.sid = 0;
-    pf.close();
+    close();
     return rc;
   }
 
+  // long values may follow the last page of records in a slotted file
+  while (format == FORMAT_SLOTTED && getRecordCount(page) == OVERFLOW_PAGE) {
+    if (erid.pid == 0) {
+      erid.sid = 0;
+      return 0;
+    }
+    if ((rc = pf.read(--erid.pid, page)) < 0) {
+      erid.pid = erid.sid = 0;
+      close();
+      return rc;
+    }
+  }
+
   // get # records in the last page
   erid.sid = getRecordCount(page);
-  if (erid.sid >= RECORDS_PER_PAGE) {
+  if (fixedSlots() && erid.sid >= RECORDS_PER_PAGE) {
     // the last page is full. advance the end record id to the next page.
     erid.pid++;
     erid.sid = 0;
@@ -159,36 +414,195 @@ RC RecordFile::open(const string& filename, char mode)
 
 RC RecordFile::close()
 {
+  RC rc = 0;
+
   erid.pid = 0;
   erid.sid = 0;
 
-  return pf.close();
+  // the codes in the pages refer to the dictionary, so it is written first
+  if (format == FORMAT_DICT) rc = dict.close();
+  RC rc2 = pf.close();
+  if (rc == 0) rc = rc2;
+
+  // and the zones describe the pages once they are written
+  rc2 = zones.close();
+  return (rc < 0) ? rc : rc2;
 }
 
 RC RecordFile::read(const RecordId& rid, int& key, string& value) const
 {
-  RC   rc;
-  char page[PageFile::PAGE_SIZE];
-  
+  RecordPage page;
+  std::string_view view;
+  RC rc;
+
+  // read the record in place and copy only the value out
+  if ((rc = read(rid, key, view, page)) < 0) return rc;
+  value.assign(view.data(), view.size());
+  return 0;
+}
+
+RC RecordFile::read(const RecordId& rid, int& key, std::string_view& value, RecordPage& page) const
+{
+  RC rc;
+
   // check whether the rid is in the valid range
   if (rid.pid < 0 || rid.pid > erid.pid) return RC_INVALID_RID;
-  if (rid.sid < 0 || rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
+  if (rid.sid < 0) return RC_INVALID_RID;
+  if (fixedSlots() && rid.sid >= RecordFile::RECORDS_PER_PAGE) return RC_INVALID_RID;
   if (rid >= erid) return RC_INVALID_RID;
-  
-  // read the page containing the record
-  if ((rc = pf.read(rid.pid, page)) < 0) return rc;
 
-  // read the record from the slot in the page
-  readSlot(page, rid.sid, key, value);
+  // keep the page of the previous record if it is the same one
+  if ((rc = readPage(rid.pid, page)) < 0) return (rc == RC_INVALID_PID) ? RC_INVALID_RID : rc;
+  return page.read(rid.sid, key, value);
+}
+
+RC RecordFile::readPage(PageId pid, RecordPage& page) const
+{
+  RC    rc;
+  char* frame;
+
+  // the pages after the last page of records hold no records
+  if (pid < 0 || pid > erid.pid || (pid == erid.pid && erid.sid == 0)) return RC_INVALID_PID;
+  if (page.file == this && page.pid == pid) return 0;
+  page.release();
+
+  // pin the page instead of copying it out
+  if ((rc = pf.pin(pid, frame)) == 0) {
+    page.data = frame;
+    page.pinned = true;
+  } else if (rc == RC_FRAME_PINNED) {
+    // every frame of the buffer pool is in use. read a private copy
+    page.copy.resize(PageFile::PAGE_SIZE);
+    if ((rc = pf.read(pid, &page.copy[0])) < 0) return rc;
+    page.data = &page.copy[0];
+    page.pinned = false;
+  } else {
+    return rc;
+  }
+
+  page.file = this;
+  page.pid = pid;
+  page.count = getRecordCount(page.data);
+  // an overflow page has a negative count
+  if (page.count < 0) page.count = 0;
+  if (fixedSlots() && page.count > RECORDS_PER_PAGE) page.count = RECORDS_PER_PAGE;
+  if (format == FORMAT_DICT && page.count > DICT_RECORDS_PER_PAGE) page.count = DICT_RECORDS_PER_PAGE;
+  return 0;
+}
+
+RC RecordFile::readOverflow(PageId first, int length, string& value) const
+{
+  RC   rc;
+  OverflowHeader header;
+  char chunk[PageFile::PAGE_SIZE];
+
+  // collect the value from its overflow pages
+  value.clear();
+  value.reserve(length);
+  for (PageId pid = first; (int)value.size() < length; pid = header.next) {
+    if (pid < 0) return RC_INVALID_FILE_FORMAT;
+    if ((rc = pf.read(pid, chunk)) < 0) return rc;
+    memcpy(&header, chunk, sizeof(header));
+    if (header.marker != OVERFLOW_PAGE) return RC_INVALID_FILE_FORMAT;
+    value.append(chunk + sizeof(header), header.length);
+  }
+  return 0;
+}
+
+RecordPage::RecordPage()
+{
+  file = NULL;
+  pid = -1;
+  data = NULL;
+  pinned = false;
+  count = 0;
+}
+
+RecordPage::~RecordPage()
+{
+  release();
+}
 
+void RecordPage::release()
+{
+  if (pinned) file->pf.unpin(pid);
+  file = NULL;
+  pid = -1;
+  data = NULL;
+  pinned = false;
+  count = 0;
+}
+
+RC RecordPage::read(int sid, int& key, std::string_view& value)
+{
+  if (sid < 0 || sid >= count) return RC_INVALID_RID;
+
+  if (file->format == RecordFile::FORMAT_FIXED) {
+    // the value is a NUL-terminated string in a slot of a fixed size
+    const char* ptr = slotPtr(const_cast<char*>(data), sid);
+    memcpy(&key, ptr, sizeof(int));
+    ptr += sizeof(int);
+    value = std::string_view(ptr, strnlen(ptr, RecordFile::MAX_VALUE_LENGTH));
+    return 0;
+  }
+
+  if (file->format == RecordFile::FORMAT_PAX) {
+    memcpy(&key, paxKeys(const_cast<char*>(data)) + sid * sizeof(int), sizeof(int));
+    const char* ptr = paxValue(const_cast<char*>(data), sid);
+    value = std::string_view(ptr, strnlen(ptr, RecordFile::MAX_VALUE_LENGTH));
+    return 0;
+  }
+
+  if (file->format == RecordFile::FORMAT_DICT) {
+    int code = getCodes()[sid];
+    key = getKeys()[sid];
+    if (code < 0 || code >= file->dict.size()) return RC_INVALID_FILE_FORMAT;
+    value = file->dict.getValue(code);
+    return 0;
+  }
+
+  Slot* slot = slottedSlot(const_cast<char*>(data), sid);
+  const char* ptr = data + slot->offset;
+
+  if (slot->length != OVERFLOW_SLOT) {
+    memcpy(&key, ptr, sizeof(int));
+    value = std::string_view(ptr + sizeof(int), slot->length - sizeof(int));
+    return 0;
+  }
+
+  // a long value has to be put together from its overflow pages
+  OverflowRecord record;
+  RC rc;
+
+  memcpy(&record, ptr, sizeof(record));
+  key = record.key;
+  if ((rc = file->readOverflow(record.first, record.length, overflow)) < 0) return rc;
+  value = overflow;
   return 0;
 }
 
+const int* RecordPage::getKeys() const
+{
+  if (file == NULL) return NULL;
+  if (file->format != RecordFile::FORMAT_PAX && file->format != RecordFile::FORMAT_DICT) return NULL;
+  // the page is in a frame, the mapping or a vector, so the keys are aligned
+  return (const int*)paxKeys(const_cast<char*>(data));
+}
+
+const int* RecordPage::getCodes() const
+{
+  if (file == NULL || file->format != RecordFile::FORMAT_DICT) return NULL;
+  return (const int*)dictCodes(const_cast<char*>(data));
+}
+
 RC RecordFile::append(int key, const std::string& value, RecordId& rid)
 {
   RC   rc;
   char page[PageFile::PAGE_SIZE];
 
+  if (format == FORMAT_SLOTTED) return appendSlotted(key, value, rid);
+  if (format == FORMAT_DICT) return appendDict(key, value, rid);
+
   // unless we are writing to the the first slot of an empty page,
   // we have to read the page first
   if (erid.sid > 0) {
@@ -197,10 +611,13 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
     // if this is the first slot of an empty page
     // we can simply initialize the page with zeros
     memset(page, 0, PageFile::PAGE_SIZE);
+    zones.clear(erid.pid);
   }
+  zones.add(erid.pid, key, value);
     
   // write the record to the first empty slot 
-  writeSlot(page, erid.sid, key, value);
+  if (format == FORMAT_PAX) paxWrite(page, erid.sid, key, value);
+  else writeSlot(page, erid.sid, key, value);
 
   // the first four bytes in the page stores # records in the page.
   // update this number.
@@ -218,6 +635,241 @@ RC RecordFile::append(int key, const std::string& value, RecordId& rid)
   return 0;
 }
 
+RC RecordFile::appendSlotted(int key, const string& value, RecordId& rid)
+{
+  RC    rc;
+  char  page[PageFile::PAGE_SIZE];
+  char  record[sizeof(int) + MAX_INLINE_LENGTH];
+  int   size;
+  PageId first = -1;
+  unsigned short length;
+
+  // a long value goes to overflow pages. the record points to them
+  if ((int)value.size() > MAX_INLINE_LENGTH) {
+    if ((rc = writeOverflow(value, first)) < 0) return rc;
+  }
+  size = slottedRecord(record, key, value, first, length);
+
+  // add the record to the last page of records if it fits there.
+  // otherwise start a new page after everything written so far. the
+  // overflow pages may have closed the extent of the last page of a
+  // compressed file, which can not be written any more
+  PageId pid = erid.pid;
+  bool   fits = false;
+  if (erid.sid > 0 && pf.isWritable(pid)) {
+    if ((rc = pf.read(pid, page)) < 0) return rc;
+    fits = (slottedFree(page) >= size + (int)sizeof(Slot));
+  }
+  if (!fits) {
+    pid = pf.endPid();
+    initSlotted(page);
+    zones.clear(pid);
+  }
+  zones.add(pid, key, value);
+  int sid = slottedPut(page, record, size, length);
+
+  if ((rc = pf.write(pid, page)) < 0) return rc;
+
+  rid.pid = pid;
+  rid.sid = sid;
+  erid.pid = pid;
+  erid.sid = sid + 1;
+
+  return 0;
+}
+
+RC RecordFile::appendDict(int key, const string& value, RecordId& rid)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  code = dict.encode(value);
+
+  // a record must not refer to a value that is not in the file yet
+  if ((rc = dict.flush()) < 0) return rc;
+
+  // the last page of records takes the record if it is not full
+  rid = erid;
+  if (erid.sid > 0 && erid.sid < DICT_RECORDS_PER_PAGE) {
+    if ((rc = pf.read(erid.pid, page)) < 0) return rc;
+  } else {
+    if (erid.sid > 0) {
+      rid.pid++;
+      rid.sid = 0;
+    }
+    memset(page, 0, PageFile::PAGE_SIZE);
+    zones.clear(rid.pid);
+  }
+  zones.add(rid.pid, key, value);
+
+  dictWrite(page, rid.sid, key, code);
+  setRecordCount(page, rid.sid + 1);
+  if ((rc = pf.write(rid.pid, page)) < 0) return rc;
+
+  erid.pid = rid.pid;
+  erid.sid = rid.sid + 1;
+  return 0;
+}
+
+RC RecordFile::writeOverflow(const string& value, PageId& first)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+  int  n = overflowPages(value);
+
+  // the pieces go to consecutive pages at the end of the file
+  first = pf.endPid();
+  for (int i = 0; i < n; i++) {
+    overflowPage(page, value, i, (i + 1 < n) ? first + i + 1 : -1);
+    if ((rc = pf.write(first + i, page)) < 0) return rc;
+  }
+  return 0;
+}
+
+RC RecordFile::appendBatch(const int* keys, const string* values, int n, vector<RecordId>& rids)
+{
+  RC        rc;
+  PageBatch batch(pf);
+  RecordId  rid;
+  int       sid = erid.sid;  // # records in the current page
+
+  rids.clear();
+  rids.reserve(n);
+
+  // the new values of the batch go to the dictionary file first,
+  // as the pages of the batch may be written before the batch ends
+  vector<int> codes;
+  if (format == FORMAT_DICT) {
+    codes.resize(n);
+    for (int i = 0; i < n; i++) codes[i] = dict.encode(values[i]);
+    if ((rc = dict.flush()) < 0) return rc;
+  }
+
+  // the last page of records is filled up first, unless it lies in an
+  // extent of a compressed file that has been written out
+  if (erid.sid > 0 && pf.isWritable(erid.pid) && (rc = batch.resume(erid.pid)) < 0) return rc;
+
+  for (int i = 0; i < n; i++) {
+    if (format == FORMAT_SLOTTED) {
+      char   record[sizeof(int) + MAX_INLINE_LENGTH];
+      PageId first = -1;
+      unsigned short length;
+
+      // the overflow pages of a long value go before the page of its
+      // record, as in appendSlotted()
+      if ((int)values[i].size() > MAX_INLINE_LENGTH) {
+        // in a compressed file they may close the extent of the current
+        // page before it is written, so the record goes to a new page
+        if (pf.isCompressed() && (rc = batch.finish()) < 0) return rc;
+        int m = overflowPages(values[i]);
+        for (int j = 0; j < m; j++) {
+          char*  page;
+          PageId p;
+          if ((rc = batch.add(page, p)) < 0) return rc;
+          if (j == 0) first = p;
+          overflowPage(page, values[i], j, (j + 1 < m) ? p + 1 : -1);
+        }
+      }
+      int size = slottedRecord(record, keys[i], values[i], first, length);
+
+      if (batch.page() == NULL || slottedFree(batch.page()) < size + (int)sizeof(Slot)) {
+        if ((rc = batch.next()) < 0) return rc;
+        initSlotted(batch.page());
+        zones.clear(batch.getPid());
+      }
+      sid = slottedPut(batch.page(), record, size, length);
+    } else {
+      int slots = (format == FORMAT_DICT) ? DICT_RECORDS_PER_PAGE : RECORDS_PER_PAGE;
+      if (batch.page() == NULL || sid == slots) {
+        if ((rc = batch.next()) < 0) return rc;
+        memset(batch.page(), 0, PageFile::PAGE_SIZE);
+        zones.clear(batch.getPid());
+        sid = 0;
+      }
+      if (format == FORMAT_DICT) dictWrite(batch.page(), sid, keys[i], codes[i]);
+      else if (format == FORMAT_PAX) paxWrite(batch.page(), sid, keys[i], values[i]);
+      else writeSlot(batch.page(), sid, keys[i], values[i]);
+      setRecordCount(batch.page(), sid + 1);
+    }
+
+    rid.pid = batch.getPid();
+    rid.sid = sid++;
+    rids.push_back(rid);
+    zones.add(rid.pid, keys[i], values[i]);
+  }
+
+  if ((rc = batch.flush()) < 0) return rc;
+
+  // the next record goes after the last one, as with append()
+  if (!rids.empty()) {
+    erid = rids.back();
+    if (fixedSlots()) ++erid;
+    else erid.sid++;
+  }
+
+  return 0;
+}
+
+RC RecordFile::first(RecordId& rid) const
+{
+  rid.pid = 0;
+  rid.sid = -1;
+  return next(rid);
+}
+
+RC RecordFile::next(RecordId& rid) const
+{
+  RC    rc;
+  char* page;
+  int   count;
+
+  if (fixedSlots()) {
+    ++rid;
+    if (rid > erid) rid = erid;
+    return 0;
+  }
+
+  // the record count of each page tells where its records end.
+  // overflow pages have a negative count and are skipped
+  rid.sid++;
+  while (rid < erid) {
+    if ((rc = pf.pin(rid.pid, page)) == 0) {
+      count = getRecordCount(page);
+      pf.unpin(rid.pid);
+    } else if (rc == RC_FRAME_PINNED) {
+      char copy[PageFile::PAGE_SIZE];
+      if ((rc = pf.read(rid.pid, copy)) < 0) return rc;
+      count = getRecordCount(copy);
+    } else {
+      return rc;
+    }
+
+    if (rid.sid < count) return 0;
+    rid.pid++;
+    rid.sid = 0;
+  }
+
+  rid = erid;
+  return 0;
+}
+
+RC RecordFile::advise(PageFile::Access access) const
+{
+  return pf.advise(access);
+}
+
+RC RecordFile::prefetch(const RecordId* rids, int n) const
+{
+  vector<PageId> pids;
+
+  // several records usually share a page
+  for (int i = 0; i < n; i++) pids.push_back(rids[i].pid);
+  std::sort(pids.begin(), pids.end());
+  pids.erase(std::unique(pids.begin(), pids.end()), pids.end());
+
+  if (pids.empty()) return 0;
+  return pf.prefetch(&pids[0], pids.size());
+}
+
 const RecordId& RecordFile::endRid() const
 {
   return erid;
@@ -247,18 +899,6 @@ static char* slotPtr(char* page, int n)
   return (page+sizeof(int)) + (sizeof(int)+RecordFile::MAX_VALUE_LENGTH)*n;
 }
 
-static void readSlot(const char* page, int n, int& key, std::string& value)
-{
-  // compute the location of the record
-  char *ptr = slotPtr(const_cast<char*>(page), n);
-
-  // read the key 
-  memcpy(&key, ptr, sizeof(int));
-
-  // read the value
-  value.assign(ptr + sizeof(int));
-}
-
 static void writeSlot(char* page, int n, int key, const std::string& value)
 {
   // compute the location of the record
@@ -268,11 +908,135 @@ static void writeSlot(char* page, int n, int key, const std::string& value)
   memcpy(ptr, &key, sizeof(int));
 
   // store the value. 
+  writeValue(ptr + sizeof(int), value);
+}
+
+static void writeValue(char* ptr, const std::string& value)
+{
   if ((int)value.size() >= RecordFile::MAX_VALUE_LENGTH) {
     // when the string is longer than MAX_VALUE_LENGTH, truncate it.
-    memcpy(ptr + sizeof(int), value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
-    *(ptr + sizeof(int) + RecordFile::MAX_VALUE_LENGTH - 1) = 0;
+    memcpy(ptr, value.c_str(), RecordFile::MAX_VALUE_LENGTH -1);
+    *(ptr + RecordFile::MAX_VALUE_LENGTH - 1) = 0;
   } else {
-    strcpy(ptr + sizeof(int), value.c_str());
+    strcpy(ptr, value.c_str());
+  }
+}
+
+static char* paxKeys(char* page)
+{
+  // the keys follow # records in the page
+  return page + sizeof(int);
+}
+
+static char* paxValue(char* page, int n)
+{
+  // the values follow the keys of all RECORDS_PER_PAGE slots
+  return paxKeys(page) + sizeof(int) * RecordFile::RECORDS_PER_PAGE + RecordFile::MAX_VALUE_LENGTH * n;
+}
+
+static void paxWrite(char* page, int n, int key, const std::string& value)
+{
+  memcpy(paxKeys(page) + sizeof(int) * n, &key, sizeof(int));
+  writeValue(paxValue(page, n), value);
+}
+
+static char* dictCodes(char* page)
+{
+  // the codes follow the keys of all DICT_RECORDS_PER_PAGE slots
+  return paxKeys(page) + sizeof(int) * RecordFile::DICT_RECORDS_PER_PAGE;
+}
+
+static void dictWrite(char* page, int n, int key, int code)
+{
+  memcpy(paxKeys(page) + sizeof(int) * n, &key, sizeof(int));
+  memcpy(dictCodes(page) + sizeof(int) * n, &code, sizeof(int));
+}
+
+static std::string sideFileName(const std::string& filename, const char* extension)
+{
+  // movie.tbl -> movie.dic
+  std::string::size_type dot = filename.rfind('.');
+  std::string::size_type slash = filename.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return filename + extension;
+  return filename.substr(0, dot) + extension;
+}
+
+static int slottedRecord(char* record, int key, const std::string& value,
+                         PageId first, unsigned short& length)
+{
+  if (first >= 0) {
+    OverflowRecord o;
+    o.key = key;
+    o.length = value.size();
+    o.first = first;
+    memcpy(record, &o, sizeof(o));
+    length = OVERFLOW_SLOT;
+    return sizeof(o);
   }
+
+  memcpy(record, &key, sizeof(int));
+  memcpy(record + sizeof(int), value.data(), value.size());
+  length = sizeof(int) + value.size();
+  return length;
+}
+
+static int overflowPages(const std::string& value)
+{
+  return (value.size() + OVERFLOW_CHUNK - 1) / OVERFLOW_CHUNK;
+}
+
+static void overflowPage(char* page, const std::string& value, int i, PageId next)
+{
+  OverflowHeader header;
+  header.marker = OVERFLOW_PAGE;
+  header.next = next;
+  header.length = std::min((int)value.size() - i * OVERFLOW_CHUNK, OVERFLOW_CHUNK);
+
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, &header, sizeof(header));
+  memcpy(page + sizeof(header), value.data() + i * OVERFLOW_CHUNK, header.length);
+}
+
+static void initSlotted(char* page)
+{
+  SlottedHeader header;
+
+  header.count = 0;
+  header.dataStart = PageFile::PAGE_SIZE;
+  memset(page, 0, PageFile::PAGE_SIZE);
+  memcpy(page, &header, sizeof(header));
+}
+
+static Slot* slottedSlot(char* page, int n)
+{
+  // the slot directory follows the page header
+  return (Slot*)(page + sizeof(SlottedHeader)) + n;
+}
+
+static int slottedFree(const char* page)
+{
+  SlottedHeader header;
+
+  // the gap between the end of the directory and the record area
+  memcpy(&header, page, sizeof(header));
+  return header.dataStart - (int)(sizeof(SlottedHeader) + header.count * sizeof(Slot));
+}
+
+static int slottedPut(char* page, const char* record, int size, unsigned short length)
+{
+  SlottedHeader header;
+
+  memcpy(&header, page, sizeof(header));
+
+  // the record goes right below the records stored before it
+  header.dataStart -= size;
+  memcpy(page + header.dataStart, record, size);
+
+  Slot* slot = slottedSlot(page, header.count);
+  slot->offset = header.dataStart;
+  slot->length = length;
+
+  header.count++;
+  memcpy(page, &header, sizeof(header));
+  return header.count - 1;
 }
@@ -11,7 +11,11 @@
 #define RECORDFILE_H
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include "PageFile.h"
+#include "Dictionary.h"
+#include "ZoneMap.h"
 
 /**
  * The data structure for pointing to a particular record in a RecordFile.
@@ -38,26 +42,139 @@ bool operator<= (const RecordId& r1, const RecordId& r2);
 bool operator== (const RecordId& r1, const RecordId& r2);
 bool operator!= (const RecordId& r1, const RecordId& r2);
 
+class RecordFile;
+
+/**
+ * a page of a RecordFile held in memory, pinned in the buffer pool when
+ * possible. the records are read in place: the values handed out point
+ * into the page and stay valid until the page is released or replaced
+ * by another one.
+ */
+class RecordPage {
+ public:
+  RecordPage();
+
+  /**
+   * release the page if one is held.
+   */
+  ~RecordPage();
+
+  /**
+   * @return the id of the page. -1 if no page is held
+   */
+  PageId getPid() const { return pid; }
+
+  /**
+   * @return # of records in the page. 0 for a page that holds no records
+   */
+  int getRecordCount() const { return count; }
+
+  /**
+   * the keys of the records of a FORMAT_PAX or FORMAT_DICT page, one
+   * after another. a query that needs only the keys can go through them
+   * without touching the values.
+   * @return the keys of the getRecordCount() records. NULL if the page
+   *         is in neither format
+   */
+  const int* getKeys() const;
+
+  /**
+   * the dictionary codes of the values of a FORMAT_DICT page, one after
+   * another. see RecordFile::getDictionary().
+   * @return the codes of the getRecordCount() records. NULL if the page
+   *         is not in FORMAT_DICT
+   */
+  const int* getCodes() const;
+
+  /**
+   * read a record of the page without copying it.
+   * a value kept in overflow pages is assembled in a buffer of the
+   * RecordPage, which is reused by the next such value.
+   * @param sid[IN] the slot number of the record
+   * @param key[OUT] the record key
+   * @param value[OUT] the record value
+   * @return error code. 0 if no error
+   */
+  RC read(int sid, int& key, std::string_view& value);
+
+  /**
+   * unpin the page. the values read from it become invalid.
+   */
+  void release();
+
+ private:
+  friend class RecordFile;
+
+  const RecordFile* file;  // the file of the page. NULL if none is held
+  PageId      pid;         // the id of the page
+  const char* data;        // the page in the buffer pool, the mapping or copy
+  bool        pinned;      // true if the page has to be unpinned
+  int         count;       // # of records in the page
+  std::vector<char> copy;  // the page when no frame could be pinned
+  std::string overflow;    // the last value read from overflow pages
+
+  // the page may be pinned, so it must not be copied
+  RecordPage(const RecordPage&);
+  RecordPage& operator=(const RecordPage&);
+};
+
 /**
  * read/write a record to a file
  */
 class RecordFile {
  public:
 
-  // maximum length of the value field
+  /**
+   * how the records are laid out in the pages of a file.
+   * the format is chosen when the file is created and kept in its header.
+   */
+  enum Format {
+    FORMAT_FIXED = 0,   // RECORDS_PER_PAGE slots of MAX_VALUE_LENGTH bytes
+    FORMAT_SLOTTED = 1, // a slot directory and packed variable-length records
+    FORMAT_PAX = 2,     // the slots of FORMAT_FIXED, with the keys of a page
+                        // stored together ahead of the values
+    FORMAT_DICT = 3     // the keys of a page, then a dictionary code in
+                        // place of each value. see getDictionary()
+  };
+
+  // maximum length of the value field in FORMAT_FIXED and FORMAT_PAX
   static const int MAX_VALUE_LENGTH = 100;  
 
+  // longer values are kept in overflow pages in FORMAT_SLOTTED
+  static const int MAX_INLINE_LENGTH = PageFile::PAGE_SIZE / 4;
+
   // number of record slots per page
   static const int RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int))/ (sizeof(int) + MAX_VALUE_LENGTH);  
     // Note that we subtract sizeof(int) from PAGE_SIZE because the first
     // four bytes in the page is used to store # records in the page.
 
+  // number of records per page in FORMAT_DICT
+  static const int DICT_RECORDS_PER_PAGE = (PageFile::PAGE_SIZE - sizeof(int)) / (2 * sizeof(int));
+
   RecordFile();
   RecordFile(const std::string& filename, char mode);
   
+  /**
+   * choose the format of the files created from now on.
+   * @param format[IN] the format. FORMAT_FIXED by default
+   */
+  static void setDefaultFormat(Format format) { defaultFormat = format; }
+
+  /**
+   * choose whether the pages of the files created from now on are
+   * compressed. see PageFile::setCompression().
+   * @param on[IN] true to compress. off by default
+   */
+  static void setDefaultCompression(bool on) { defaultCompression = on; }
+
   /**
    * open a file in read or write mode.
-   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'w' mode, if the file does not exist, it is created
+   * in the format given to setDefaultFormat() and compressed if
+   * setDefaultCompression() says so. the zone map of the file is kept
+   * next to it, in a file named after it with the extension ".zmp",
+   * and the dictionary of a FORMAT_DICT file in one with the extension
+   * ".dic".
    * @param filename[IN] the name of the file to open
    * @param mode[IN] 'r' for read, 'w' for write
    * @return error code. 0 if no error
@@ -79,6 +196,28 @@ class RecordFile {
    */
   RC read(const RecordId& rid, int& key, std::string& value) const;
 
+  /**
+   * read a record without copying it. the page of the record is kept in
+   * the given RecordPage, so reading the next record of the same page
+   * does not touch the buffer pool again.
+   * @param rid[IN] the id of the record to read
+   * @param key[OUT] the record key
+   * @param value[OUT] the record value. valid while page holds the page
+   * @param page[IN/OUT] the page of the previous record, if any
+   * @return error code. 0 if no error
+   */
+  RC read(const RecordId& rid, int& key, std::string_view& value, RecordPage& page) const;
+
+  /**
+   * bring a page of records into memory for reading its records in place.
+   * going through the pages from 0 until RC_INVALID_PID is returned
+   * visits every record of the file.
+   * @param pid[IN] the page to read
+   * @param page[OUT] the page. the page it held before is released
+   * @return error code. RC_INVALID_PID after the last page of records
+   */
+  RC readPage(PageId pid, RecordPage& page) const;
+
   /**
    * append a new record at the end of the file.
    * note that RecordFile does not have write() function.
@@ -90,15 +229,104 @@ class RecordFile {
    */
   RC append(int key, const std::string& value, RecordId& rid);
 
+  /**
+   * append a batch of records at the end of the file. the pages are
+   * filled in memory and written out a run of pages at a time, instead
+   * of reading and writing the last page once per record as append()
+   * does. meant for loading a table.
+   * @param keys[IN] the record keys
+   * @param values[IN] the record values
+   * @param n[IN] # of records
+   * @param rids[OUT] the location of each stored record, in order
+   * @return error code. 0 if no error
+   */
+  RC appendBatch(const int* keys, const std::string* values, int n, std::vector<RecordId>& rids);
+
+  /**
+   * tell the underlying PageFile how the records are going to be read.
+   * @param access[IN] the expected access pattern
+   * @return error code. 0 if no error
+   */
+  RC advise(PageFile::Access access) const;
+
+  /**
+   * start reading the pages of a set of records in the background,
+   * so that reading the records later does not wait for the disk
+   * one page at a time.
+   * @param rids[IN] the records that are going to be read
+   * @param n[IN] # of records
+   * @return error code. 0 if no error
+   */
+  RC prefetch(const RecordId* rids, int n) const;
+
+  /**
+   * find the first record of the file.
+   * @param rid[OUT] the id of the first record. endRid() if the file is empty
+   * @return error code. 0 if no error
+   */
+  RC first(RecordId& rid) const;
+
+  /**
+   * move to the next record of the file. in FORMAT_FIXED and FORMAT_PAX this is the
+   * same as ++rid, but FORMAT_SLOTTED and FORMAT_DICT pages hold more
+   * records than RECORDS_PER_PAGE, so the page has to be looked at.
+   * @param rid[IN/OUT] the current record. the next one on return,
+   *                    or endRid() after the last record
+   * @return error code. 0 if no error
+   */
+  RC next(RecordId& rid) const;
+
+  /**
+   * @return the format of the file
+   */
+  Format getFormat() const { return format; }
+
+  /**
+   * the distinct values of a FORMAT_DICT file. the records of the file
+   * hold the codes of their values, so conditions on the value can be
+   * checked on the ranks of the codes without reading the values.
+   * @return the dictionary. NULL if the file is not in FORMAT_DICT
+   */
+  const Dictionary* getDictionary() const { return (format == FORMAT_DICT) ? &dict : NULL; }
+
+  /**
+   * the range of the keys and values of a page of records. the zone map
+   * is kept up to date by append() and appendBatch(), so a scan can
+   * skip the pages whose range rules out what it looks for.
+   * @param pid[IN] the page
+   * @return the zone of the page. NULL if it is not known, e.g. for a
+   *         page written before the file had a zone map
+   */
+  const ZoneMap::Zone* getZone(PageId pid) const { return zones.find(pid); }
+
   /**
    * note the +1 part. The rid of the last record is endRid()-1.
+   * every record id is smaller than endRid(), but in FORMAT_SLOTTED
+   * and FORMAT_DICT not every smaller record id is a record. use next() to go through
+   * the records.
    * @return (last record id + 1) of the RecordFile
    */
   const RecordId& endRid() const;
 
  private:
+  // true if every page has RECORDS_PER_PAGE slots, so that ++rid walks the file
+  bool fixedSlots() const { return format == FORMAT_FIXED || format == FORMAT_PAX; }
+
+  RC readOverflow(PageId first, int length, std::string& value) const;
+  RC appendSlotted(int key, const std::string& value, RecordId& rid);
+  RC appendDict(int key, const std::string& value, RecordId& rid);
+  RC writeOverflow(const std::string& value, PageId& first);
+
   PageFile pf;     // the PageFile used to store the records
   RecordId erid;   // the last record id of the file + 1
+  Format   format; // the layout of the pages
+  Dictionary dict; // the values of a FORMAT_DICT file
+  ZoneMap  zones;  // the range of the records of each page
+
+  static Format defaultFormat; // the format of new files
+  static bool defaultCompression; // compress the pages of new files
+
+  friend class RecordPage;
 };
 
 #endif // RECORDFILE_H
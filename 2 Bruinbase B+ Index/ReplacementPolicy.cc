@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "ReplacementPolicy.h"
+#include "BufferPool.h"
+#include <cstring>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+
+/**
+ * a doubly linked list of frames, the most recently added first
+ */
+class FrameList {
+ public:
+  FrameList(int begin, int end)
+    : begin(begin), prev(end - begin, -1), next(end - begin, -1), member(end - begin, 0)
+  {
+    head = tail = -1;
+    count = 0;
+  }
+
+  void pushFront(int frame)
+  {
+    int i = frame - begin;
+    prev[i] = -1;
+    next[i] = head;
+    if (head >= 0) prev[head - begin] = frame;
+    head = frame;
+    if (tail < 0) tail = frame;
+    member[i] = 1;
+    count++;
+  }
+
+  void remove(int frame)
+  {
+    int i = frame - begin;
+    if (!member[i]) return;
+    if (prev[i] >= 0) next[prev[i] - begin] = next[i];
+    else head = next[i];
+    if (next[i] >= 0) prev[next[i] - begin] = prev[i];
+    else tail = prev[i];
+    prev[i] = next[i] = -1;
+    member[i] = 0;
+    count--;
+  }
+
+  bool contains(int frame) const { return member[frame - begin] != 0; }
+  int  size() const { return count; }
+
+  /**
+   * @return the oldest frame that may be evicted. -1 if none
+   */
+  int lastEvictable(const BufferPool& pool) const
+  {
+    for (int frame = tail; frame >= 0; frame = prev[frame - begin]) {
+      if (pool.evictable(frame)) return frame;
+    }
+    return -1;
+  }
+
+ private:
+  int         begin;   // the first frame of the shard
+  vector<int> prev;    // neighbor toward the front. -1 at the front
+  vector<int> next;    // neighbor toward the back. -1 at the back
+  vector<char> member; // 1 if the frame is on the list
+  int head, tail;
+  int count;
+};
+
+class LruPolicy : public ReplacementPolicy {
+ public:
+  LruPolicy(int begin, int end) : list(begin, end) {}
+
+  void insert(int frame, int, PageId) { list.pushFront(frame); }
+
+  void access(int frame)
+  {
+    list.remove(frame);
+    list.pushFront(frame);
+  }
+
+  void remove(int frame) { list.remove(frame); }
+
+  int victim(const BufferPool& pool) { return list.lastEvictable(pool); }
+
+ private:
+  FrameList list;
+};
+
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  ClockPolicy(int begin, int end)
+    : begin(begin), referenced(end - begin, 0), resident(end - begin, 0)
+  {
+    hand = 0;
+  }
+
+  void insert(int frame, int, PageId)
+  {
+    resident[frame - begin] = 1;
+    referenced[frame - begin] = 1;
+  }
+
+  void access(int frame) { referenced[frame - begin] = 1; }
+
+  void remove(int frame)
+  {
+    resident[frame - begin] = 0;
+    referenced[frame - begin] = 0;
+  }
+
+  int victim(const BufferPool& pool)
+  {
+    int n = resident.size();
+
+    // two sweeps clear every reference bit, so a free frame is found if any
+    for (int i = 0; i < 2 * n; i++) {
+      int frame = begin + hand;
+      hand = (hand + 1) % n;
+      if (!resident[frame - begin] || !pool.evictable(frame)) continue;
+      if (referenced[frame - begin]) {
+        referenced[frame - begin] = 0;
+        continue;
+      }
+      return frame;
+    }
+    return -1;
+  }
+
+ private:
+  int          begin;
+  vector<char> referenced; // the second chance bit of each frame
+  vector<char> resident;   // 1 if the frame holds a page
+  int          hand;       // the next frame to look at, relative to begin
+};
+
+/**
+ * 2Q as described by Johnson and Shasha. new pages go through a FIFO
+ * (a1in), so a scan touches every page only once and pushes out only
+ * other new pages. pages evicted from the FIFO are remembered for a while
+ * (a1out). a page that comes back while it is remembered is known to be
+ * hot and goes to the LRU list (am).
+ */
+class TwoQueuePolicy : public ReplacementPolicy {
+ public:
+  TwoQueuePolicy(int begin, int end)
+    : begin(begin), a1in(begin, end), am(begin, end), keys(end - begin, 0)
+  {
+    int n = end - begin;
+    // the sizes suggested by the paper
+    a1inLimit = (n / 4 > 0) ? n / 4 : 1;
+    a1outLimit = (n / 2 > 0) ? n / 2 : 1;
+  }
+
+  void insert(int frame, int fd, PageId pid)
+  {
+    unsigned long long key = makeKey(fd, pid);
+    keys[frame - begin] = key;
+
+    std::unordered_map<unsigned long long, std::list<unsigned long long>::iterator>::iterator it;
+    it = a1outIndex.find(key);
+    if (it != a1outIndex.end()) {
+      a1out.erase(it->second);
+      a1outIndex.erase(it);
+      am.pushFront(frame);
+    } else {
+      a1in.pushFront(frame);
+    }
+  }
+
+  void access(int frame)
+  {
+    // a page in a1in stays where it is. its accesses are assumed
+    // to be correlated, like the accesses of a scan
+    if (am.contains(frame)) {
+      am.remove(frame);
+      am.pushFront(frame);
+    }
+  }
+
+  void remove(int frame)
+  {
+    if (a1in.contains(frame)) {
+      a1in.remove(frame);
+      remember(keys[frame - begin]);
+    }
+    am.remove(frame);
+  }
+
+  int victim(const BufferPool& pool)
+  {
+    int frame = -1;
+
+    if (a1in.size() > a1inLimit) frame = a1in.lastEvictable(pool);
+    if (frame < 0) frame = am.lastEvictable(pool);
+    if (frame < 0) frame = a1in.lastEvictable(pool);
+    return frame;
+  }
+
+ private:
+  static unsigned long long makeKey(int fd, PageId pid)
+  {
+    return ((unsigned long long)(unsigned)fd << 32) | (unsigned)pid;
+  }
+
+  void remember(unsigned long long key)
+  {
+    if (a1outIndex.count(key) > 0) return;
+    a1out.push_front(key);
+    a1outIndex[key] = a1out.begin();
+    if ((int)a1out.size() > a1outLimit) {
+      a1outIndex.erase(a1out.back());
+      a1out.pop_back();
+    }
+  }
+
+  int       begin;
+  FrameList a1in;    // pages seen once, in the order they came in
+  FrameList am;      // pages seen again after they were evicted from a1in
+  vector<unsigned long long> keys; // the (fd, pid) of each frame
+  std::list<unsigned long long> a1out; // pages recently evicted from a1in
+  std::unordered_map<unsigned long long, std::list<unsigned long long>::iterator> a1outIndex;
+  int       a1inLimit;   // the size a1in is kept at when it can be
+  int       a1outLimit;  // # of pages a1out remembers
+};
+
+/**
+ * LRU-K with K = 2, as described by O'Neil, O'Neil and Weikum. the victim
+ * is the page whose second last access is the oldest. pages used only
+ * once go first, so a scan does not push out the inner nodes of an index.
+ *
+ * pages used once have an infinite backward 2-distance and are kept on an
+ * LRU list. the other pages are kept ordered by the time of their second
+ * last access, so a victim is found at the front of one of the two.
+ */
+class LruKPolicy : public ReplacementPolicy {
+ public:
+  LruKPolicy(int begin, int end)
+    : begin(begin), once(begin, end), last(end - begin, 0), previous(end - begin, 0)
+  {
+    now = 0;
+    lastFrame = -1;
+  }
+
+  void insert(int frame, int, PageId)
+  {
+    int i = frame - begin;
+    previous[i] = 0;
+    last[i] = ++now;
+    once.pushFront(frame);
+    lastFrame = frame;
+  }
+
+  void access(int frame)
+  {
+    int i = frame - begin;
+    // back-to-back accesses to one page, e.g. to the records of a page,
+    // count as a single access
+    if (frame != lastFrame) {
+      if (once.contains(frame)) once.remove(frame);
+      else twice.erase(std::make_pair(previous[i], frame));
+      previous[i] = last[i];
+      twice.insert(std::make_pair(previous[i], frame));
+    } else if (once.contains(frame)) {
+      once.remove(frame);
+      once.pushFront(frame);
+    }
+    last[i] = ++now;
+    lastFrame = frame;
+  }
+
+  void remove(int frame)
+  {
+    if (once.contains(frame)) once.remove(frame);
+    else twice.erase(std::make_pair(previous[frame - begin], frame));
+    if (lastFrame == frame) lastFrame = -1;
+  }
+
+  int victim(const BufferPool& pool)
+  {
+    int frame = once.lastEvictable(pool);
+    if (frame >= 0) return frame;
+
+    // only the pinned frames at the front are passed over
+    std::set<std::pair<unsigned long long, int> >::const_iterator it;
+    for (it = twice.begin(); it != twice.end(); ++it) {
+      if (pool.evictable(it->second)) return it->second;
+    }
+    return -1;
+  }
+
+ private:
+  int begin;
+  FrameList once;                      // pages used once, the most recent first
+  std::set<std::pair<unsigned long long, int> > twice; // (previous, frame) of the other pages
+  vector<unsigned long long> last;     // the time of the last access
+  vector<unsigned long long> previous; // the time of the access before. 0 if none
+  unsigned long long now;              // the logical clock of the shard
+  int lastFrame;                       // the frame accessed most recently
+};
+
+ReplacementPolicy* ReplacementPolicy::create(Kind kind, int begin, int end)
+{
+  switch (kind) {
+  case POLICY_CLOCK:
+    return new ClockPolicy(begin, end);
+  case POLICY_2Q:
+    return new TwoQueuePolicy(begin, end);
+  case POLICY_LRU_K:
+    return new LruKPolicy(begin, end);
+  default:
+    return new LruPolicy(begin, end);
+  }
+}
+
+bool ReplacementPolicy::parse(const char* name, Kind& kind)
+{
+  if (strcmp(name, "lru") == 0) kind = POLICY_LRU;
+  else if (strcmp(name, "clock") == 0) kind = POLICY_CLOCK;
+  else if (strcmp(name, "2q") == 0) kind = POLICY_2Q;
+  else if (strcmp(name, "lru2") == 0) kind = POLICY_LRU_K;
+  else return false;
+  return true;
+}
+
+const char* ReplacementPolicy::name(Kind kind)
+{
+  switch (kind) {
+  case POLICY_CLOCK:
+    return "clock";
+  case POLICY_2Q:
+    return "2q";
+  case POLICY_LRU_K:
+    return "lru2";
+  default:
+    return "lru";
+  }
+}
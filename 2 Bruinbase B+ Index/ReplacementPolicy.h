@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef REPLACEMENTPOLICY_H
+#define REPLACEMENTPOLICY_H
+
+#include "PageFile.h"
+
+class BufferPool;
+
+/**
+ * decides which frame of a buffer pool shard is reused for a new page.
+ *
+ * a policy only sees the frames that hold a page; free frames are handed
+ * out by the pool itself. every call is made with the latch of the shard
+ * held, so a policy needs no locking of its own.
+ */
+class ReplacementPolicy {
+ public:
+  enum Kind {
+    POLICY_LRU,    // least recently used
+    POLICY_CLOCK,  // second chance
+    POLICY_2Q,     // a FIFO for new pages, an LRU for pages seen twice
+    POLICY_LRU_K   // LRU-2. evicts by the time of the second last access
+  };
+
+  /**
+   * create a policy for a range of frames.
+   * @param kind[IN] the policy
+   * @param begin[IN] the first frame
+   * @param end[IN] (the last frame + 1)
+   * @return the new policy
+   */
+  static ReplacementPolicy* create(Kind kind, int begin, int end);
+
+  /**
+   * find a policy by name.
+   * @param name[IN] "lru", "clock", "2q" or "lru2"
+   * @param kind[OUT] the policy
+   * @return true if the name is known
+   */
+  static bool parse(const char* name, Kind& kind);
+
+  /**
+   * @param kind[IN] a policy
+   * @return the name of the policy, as taken by parse()
+   */
+  static const char* name(Kind kind);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * a page has been brought into a frame.
+   * @param frame[IN] the frame
+   * @param fd[IN] the file descriptor of the page
+   * @param pid[IN] the page id
+   */
+  virtual void insert(int frame, int fd, PageId pid) = 0;
+
+  /**
+   * the page in a frame has been used again.
+   * @param frame[IN] the frame
+   */
+  virtual void access(int frame) = 0;
+
+  /**
+   * a frame no longer holds its page.
+   * @param frame[IN] the frame
+   */
+  virtual void remove(int frame) = 0;
+
+  /**
+   * pick the frame to reuse next. the frame stays in the policy until
+   * remove() is called for it.
+   * @param pool[IN] the pool. it tells which frames may be evicted
+   * @return the frame. -1 if every frame is in use
+   */
+  virtual int victim(const BufferPool& pool) = 0;
+};
+
+#endif // REPLACEMENTPOLICY_H
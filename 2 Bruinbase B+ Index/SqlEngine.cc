@@ -9,12 +9,26 @@
 
 #include <cstdio>
 #include <fstream>
+#include <algorithm>
+#include <map>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "SqlEngine.h"
+#include "BTreeNode.h"
 
 // external functions and variables for load file and sql command parsing
 extern FILE* sqlin;
 int sqlparse(void);
 
+IoStats SqlEngine::queryStats;
+
+// # lines load() reads before storing them with one appendBatch() call
+static const int LOAD_BATCH = 4096;
+
+// # bytes of index entries load() keeps in memory before it adds them
+// to the indexes
+static const size_t LOAD_INDEX_BYTES = 64 << 20;
 
 RC SqlEngine::run(FILE* commandline)
 {
@@ -28,23 +42,242 @@ RC SqlEngine::run(FILE* commandline)
     return 0;
 }
 
+/*
+ * Start reading the tuples of the index entries from cursor on,
+ * up to one leaf node's worth of entries, without waiting for them.
+ * @param idx[IN] the index
+ * @param cursor[IN] the first entry
+ * @param keyMax[IN] the largest key of the scan
+ * @param maxequal[IN] false if the scan stops in front of keyMax
+ * @param rf[IN] the table
+ * @return # of entries covered
+ */
+static int prefetchTuples(BTreeIndex& idx, IndexCursor cursor, int keyMax, bool maxequal, RecordFile& rf)
+{
+    RecordId rids[BTLeafNode::MAX_KEYS];
+    int      key;
+    int      n = 0;
+    
+    while (n < BTLeafNode::MAX_KEYS && idx.readForward(cursor, key, rids[n]) == 0) {
+        if (key > keyMax || (key == keyMax && !maxequal)) break;
+        n++;
+    }
+    rf.prefetch(rids, n);
+    return n;
+}
+
+/*
+ * Check a key against one condition on the key.
+ * @param comp[IN] the comparator of the condition
+ * @param key[IN] the key
+ * @param value[IN] the value of the condition
+ * @return true if the key meets the condition
+ */
+static bool keyMeets(SelCond::Comparator comp, int key, int value)
+{
+    switch (comp) {
+        case SelCond::EQ: return key == value;
+        case SelCond::NE: return key != value;
+        case SelCond::GT: return key > value;
+        case SelCond::LT: return key < value;
+        case SelCond::GE: return key >= value;
+        case SelCond::LE: return key <= value;
+    }
+    return false;
+}
+
+/*
+ * Find the keys of a page that meet every condition on the key.
+ * With SSE2 the conditions are checked four keys at a time.
+ * @param cond[IN] the conditions. all of them are on the key
+ * @param values[IN] the value of each condition
+ * @param keys[IN] the keys of the page
+ * @param n[IN] # of keys
+ * @param match[OUT] match[i] is set to true if keys[i] meets the conditions
+ * @return # of keys that meet the conditions
+ */
+static int filterKeys(const vector<SelCond>& cond, const vector<int>& values,
+                      const int* keys, int n, bool* match)
+{
+    int count = 0;
+    int i = 0;
+    
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        __m128i k = _mm_loadu_si128((const __m128i*)(keys + i));
+        __m128i m = _mm_set1_epi32(-1);
+        for (unsigned c = 0; c < cond.size(); c++) {
+            __m128i v = _mm_set1_epi32(values[c]);
+            switch (cond[c].comp) {
+                case SelCond::EQ: m = _mm_and_si128(m, _mm_cmpeq_epi32(k, v)); break;
+                case SelCond::NE: m = _mm_andnot_si128(_mm_cmpeq_epi32(k, v), m); break;
+                case SelCond::GT: m = _mm_and_si128(m, _mm_cmpgt_epi32(k, v)); break;
+                case SelCond::LT: m = _mm_and_si128(m, _mm_cmplt_epi32(k, v)); break;
+                case SelCond::GE: m = _mm_andnot_si128(_mm_cmplt_epi32(k, v), m); break;
+                case SelCond::LE: m = _mm_andnot_si128(_mm_cmpgt_epi32(k, v), m); break;
+            }
+        }
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(m));
+        for (int j = 0; j < 4; j++) {
+            match[i + j] = (bits >> j) & 1;
+            count += match[i + j];
+        }
+    }
+#endif
+    
+    for (; i < n; i++) {
+        match[i] = true;
+        for (unsigned c = 0; c < cond.size() && match[i]; c++) {
+            match[i] = keyMeets(cond[c].comp, keys[i], values[c]);
+        }
+        count += match[i];
+    }
+    return count;
+}
+
+/*
+ * Check whether any tuple of a page may meet the conditions, from the
+ * range of the keys and values of the page alone.
+ * @param zone[IN] the zone of the page
+ * @param cond[IN] the conditions
+ * @param keyValues[IN] the value of each condition on the key
+ * @return false if no tuple of the page meets the conditions
+ */
+static bool zoneMeets(const ZoneMap::Zone& zone, const vector<SelCond>& cond,
+                      const vector<int>& keyValues)
+{
+    if (zone.count == 0) return false;
+    
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 1) {
+            int v = keyValues[i];
+            switch (cond[i].comp) {
+                case SelCond::EQ: if (v < zone.minKey || v > zone.maxKey) return false; break;
+                case SelCond::NE: if (v == zone.minKey && v == zone.maxKey) return false; break;
+                case SelCond::LT: if (zone.minKey >= v) return false; break;
+                case SelCond::LE: if (zone.minKey > v) return false; break;
+                case SelCond::GT: if (zone.maxKey <= v) return false; break;
+                case SelCond::GE: if (zone.maxKey < v) return false; break;
+            }
+            continue;
+        }
+        
+        // every value is at least lo, and a value starts with at most hi.
+        // so no value reaches the constant if hi is below its first bytes
+        string_view lo(zone.minValue, strnlen(zone.minValue, ZoneMap::PREFIX_LENGTH));
+        string_view hi(zone.maxValue, strnlen(zone.maxValue, ZoneMap::PREFIX_LENGTH));
+        string_view v(cond[i].value);
+        bool below = hi < v.substr(0, ZoneMap::PREFIX_LENGTH);
+        switch (cond[i].comp) {
+            case SelCond::EQ: if (lo > v || below) return false; break;
+            case SelCond::NE: break;
+            case SelCond::LT: if (lo >= v) return false; break;
+            case SelCond::LE: if (lo > v) return false; break;
+            case SelCond::GT: if (below) return false; break;
+            case SelCond::GE: if (below) return false; break;
+        }
+    }
+    return true;
+}
+
+/*
+ * Find where the constant of each condition on the value falls among
+ * the values of a dictionary, so that the condition can be checked on
+ * the rank of a code instead of on the value.
+ * @param dict[IN] the dictionary of the table
+ * @param cond[IN] the conditions. those on the key are skipped
+ * @param lo[OUT] lo[i] is the rank of the first value not smaller than
+ *                the constant of cond[i]
+ * @param hi[OUT] hi[i] is the rank of the first value larger than it
+ */
+static void rankBounds(const Dictionary& dict, const vector<SelCond>& cond,
+                       vector<int>& lo, vector<int>& hi)
+{
+    lo.assign(cond.size(), 0);
+    hi.assign(cond.size(), 0);
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr == 2) dict.locate(cond[i].value, lo[i], hi[i]);
+    }
+}
+
+/*
+ * Check a value of a dictionary-encoded table against every condition
+ * on the value, by the rank of its code alone.
+ * @param cond[IN] the conditions. those on the key are skipped
+ * @param lo[IN] the ranks found by rankBounds()
+ * @param hi[IN] the ranks found by rankBounds()
+ * @param rank[IN] the rank of the code of the value
+ * @return true if the value meets the conditions
+ */
+static bool rankMeets(const vector<SelCond>& cond, const vector<int>& lo,
+                      const vector<int>& hi, int rank)
+{
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr != 2) continue;
+        // the values equal to the constant have a rank in [lo, hi)
+        switch (cond[i].comp) {
+            case SelCond::EQ: if (rank < lo[i] || rank >= hi[i]) return false; break;
+            case SelCond::NE: if (rank >= lo[i] && rank < hi[i]) return false; break;
+            case SelCond::LT: if (rank >= lo[i]) return false; break;
+            case SelCond::LE: if (rank >= hi[i]) return false; break;
+            case SelCond::GT: if (rank < hi[i]) return false; break;
+            case SelCond::GE: if (rank < lo[i]) return false; break;
+        }
+    }
+    return true;
+}
+
+/*
+ * Print a tuple of the result of a SELECT.
+ * @param attr[IN] attribute in the SELECT clause. see SqlEngine::select()
+ * @param key[IN] the key of the tuple
+ * @param value[IN] the value of the tuple
+ */
+static void printTuple(int attr, int key, string_view value)
+{
+    switch (attr) {
+        case 1:  // SELECT key
+            fprintf(stdout, "%d\n", key);
+            break;
+        case 2:  // SELECT value
+            fprintf(stdout, "%.*s\n", (int)value.size(), value.data());
+            break;
+        case 3:  // SELECT *
+            fprintf(stdout, "%d '%.*s'\n", key, (int)value.size(), value.data());
+            break;
+    }
+}
+
 RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
 {
+    // count the I/O of the files below until they are closed
+    queryStats.reset();
+    IoStats::Scope scope(&queryStats);
+    
     RecordFile rf;   // RecordFile containing the table
     RecordId   rid;  // record cursor for table scanning
+    RecordPage page; // the page of the current tuple. values point into it
     BTreeIndex tblidx;
+    BTreeStringIndex validx;  // the index on the value, if there is one
     vector<SelCond> valcond;
     
     RC     rc;
     int    key;
-    string value;
+    string_view value;
     int    count;
+    bool   keyOnly;          // true if the query needs the keys alone
+    vector<int> keyValues;   // the value of each condition on the key
+    const Dictionary* dict;  // the values of a FORMAT_DICT table. NULL if none
+    vector<int> rankLo;      // the ranks of the constant of each condition
+    vector<int> rankHi;      // on the value. see rankBounds()
+    bool   skipPages;        // true if the scan skips pages by their zones
     
     // open the table file
     if ((rc = rf.open(table + ".tbl", 'r')) < 0) {
         fprintf(stderr, "Error: table %s does not exist\n", table.c_str());
         return rc;
     }
+    dict = rf.getDictionary();
     
     
     // check if index exists
@@ -113,33 +346,32 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
             }
         }// keyconstraint = false when only has '!='
         if (!(keyconstraint || ((cond.size()==0) && (attr == 1 || attr == 4)))) {
-            goto direct_scan;
+            goto value_scan;
         }
         
-        if (keyMin > keyMax || (keyMax == keyMin && !(minequal && maxequal))) {
-            goto exit_select;
-            
-        }
-        
-        IndexCursor startidx, endidx, temp, currentidx;
-        tblidx.locate(keyMin, startidx);
-
-        tblidx.locate(keyMax, endidx);
-        temp = startidx;
-        rc = tblidx.readForward(startidx, key, rid);
-
-        if(rc < 0)
-            goto exit_select;
-        
-        if (key > keyMin || minequal) startidx = temp;
-        temp = endidx;
+        // the tuples are fetched in key order, not in file order
+        rf.advise(PageFile::ACCESS_RANDOM);
         
-        rc = tblidx.readForward(endidx, key, rid); // endidx is the end of index
-        if (rc < 0 || key > keyMax || !maxequal) endidx = temp;
-
-        currentidx = startidx;
-        while (tblidx.readForward(currentidx, key, rid) == 0)
+        // the scan starts at the first entry of keyMin, or of the key after
+        // it, and stops at the first entry past keyMax. a key may have
+        // many entries, which may run across leaves
+        IndexCursor currentidx;
+        bool empty = (keyMin > keyMax || (keyMax == keyMin && !(minequal && maxequal)));
+        if (!empty) tblidx.locate((minequal || keyMin == INT_MAX) ? keyMin : keyMin + 1, currentidx);
+        bool needValues = !(valcond.empty() && (attr==1||attr==4));
+        if (dict != NULL) rankBounds(*dict, valcond, rankLo, rankHi);
+        int ahead = 0; // # of index entries whose tuples have been prefetched
+        while (!empty)
         {
+            // start fetching the tuples of the next leaf's worth of entries
+            if (needValues && ahead == 0)
+                ahead = prefetchTuples(tblidx, currentidx, keyMax, maxequal, rf);
+            if (tblidx.readForward(currentidx, key, rid) != 0)
+                break;
+            if (key > keyMax || (key == keyMax && !maxequal))
+                break;
+            ahead--;
+            
             bool ne = false;
             for (int i = 0; i<nelist.size(); i++)
                 if (key == nelist[i]) ne = true;
@@ -152,31 +384,19 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
             }
             else
             {
-                if ((rc = rf.read(rid, key, value)) < 0) {
+                if ((rc = rf.read(rid, key, value, page)) < 0) {
                     fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
                     goto exit_select;
                 }
-                if (meetCond(valcond, key, value))// only check conditions on value
+                // only check conditions on value. the value of a FORMAT_DICT
+                // table is checked on the rank of its code
+                if (dict != NULL ? rankMeets(valcond, rankLo, rankHi, dict->getRanks()[page.getCodes()[rid.sid]])
+                                 : meetCond(valcond, key, value))
                 {
                     count++;
-                    // print the tuple
-                    switch (attr) {
-                        case 1:  // SELECT key
-                            fprintf(stdout, "%d\n", key);
-                            break;
-                        case 2:  // SELECT value
-                            fprintf(stdout, "%s\n", value.c_str());
-                            break;
-                        case 3:  // SELECT *
-                            fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                            break;
-                    }
+                    printTuple(attr, key, value);
                 }
             }
-            
-            if (currentidx.pid == endidx.pid && currentidx.eid >= endidx.eid) {
-                break;
-            }
         }
         
         // print matching tuple count if "select count(*)"
@@ -186,42 +406,151 @@ RC SqlEngine::select(int attr, const string& table, const vector<SelCond>& cond)
         goto exit_select;
     }
     
-direct_scan:
+value_scan:
     
-    // scan the table file from the beginning
-    rid.pid = rid.sid = 0;
-    count = 0;
-    while (rid < rf.endRid()) {
-        // read the tuple
-        if ((rc = rf.read(rid, key, value)) < 0) {
-            fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
-            goto exit_select;
+    // a condition on the value other than '<>' is looked up in the index on
+    // the value, if there is one. the index keeps the first
+    // BTreeStringIndex::MAX_KEY_LENGTH bytes of each value, so the range is
+    // scanned on those bytes and every condition is checked on the tuples
+    if (any_of(cond.begin(), cond.end(), [](const SelCond& c) { return c.attr == 2 && c.comp != SelCond::NE; })
+        && validx.open(table + ".vdx", 'r') == 0)
+    {
+        count = 0;
+        bool hasMin = false, hasMax = false;
+        string valueMin, valueMax;
+        for (unsigned i = 0; i < cond.size(); i++)
+        {
+            if (cond[i].attr != 2) continue;
+            string_view val = cond[i].value;
+            if ((cond[i].comp == SelCond::EQ || cond[i].comp == SelCond::GT || cond[i].comp == SelCond::GE)
+                && (!hasMin || val > valueMin))
+            {
+                valueMin = val;
+                hasMin = true;
+            }
+            if ((cond[i].comp == SelCond::EQ || cond[i].comp == SelCond::LT || cond[i].comp == SelCond::LE)
+                && (!hasMax || val < valueMax))
+            {
+                valueMax = val;
+                hasMax = true;
+            }
         }
+        string_view keyMax = string_view(valueMax).substr(0, BTreeStringIndex::MAX_KEY_LENGTH);
+        
+        // the tuples are fetched in value order, not in file order
+        rf.advise(PageFile::ACCESS_RANDOM);
         
-        // check the conditions on the tuple
-        // the condition is met for the tuple.
-        // increase matching tuple counter
-        if (meetCond(cond, key, value))
+        IndexCursor cursor;
+        string indexKey;
+        bool empty = (hasMin && hasMax && valueMin > valueMax);
+        if (!empty) validx.locate(valueMin, cursor);
+        while (!empty && validx.readForward(cursor, indexKey, rid) == 0)
         {
-            count++;
-            
-            // print the tuple
-            switch (attr) {
-                case 1:  // SELECT key
-                    fprintf(stdout, "%d\n", key);
-                    break;
-                case 2:  // SELECT value
-                    fprintf(stdout, "%s\n", value.c_str());
-                    break;
-                case 3:  // SELECT *
-                    fprintf(stdout, "%d '%s'\n", key, value.c_str());
-                    break;
+            if (hasMax && indexKey > keyMax)
+                break;
+            if ((rc = rf.read(rid, key, value, page)) < 0) {
+                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                validx.close();
+                goto exit_select;
+            }
+            if (meetCond(cond, key, value))
+            {
+                count++;
+                printTuple(attr, key, value);
             }
         }
+        validx.close();
         
+        // print matching tuple count if "select count(*)"
+        if (attr == 4) {
+            fprintf(stdout, "%d\n", count);
+        }
+        rc = 0;
+        goto exit_select;
+    }
+    
+    // scan the table file from the beginning, a page at a time.
+    // the tuples are read in place in the page
+    count = 0;
+    keyOnly = (attr == 1 || attr == 4);
+    for (unsigned i = 0; i < cond.size(); i++) {
+        if (cond[i].attr != 1) keyOnly = false;
+        keyValues.push_back(atoi(cond[i].value));
+    }
+    if (dict != NULL) rankBounds(*dict, cond, rankLo, rankHi);
+    
+    // read ahead only if the zone map does not rule out any page
+    skipPages = false;
+    for (PageId pid = 0; pid <= rf.endRid().pid && !skipPages; pid++) {
+        const ZoneMap::Zone* zone = rf.getZone(pid);
+        skipPages = (zone != NULL && !zoneMeets(*zone, cond, keyValues));
+    }
+    rf.advise(skipPages ? PageFile::ACCESS_NORMAL : PageFile::ACCESS_SEQUENTIAL);
+    
+    for (rid.pid = 0; ; rid.pid++) {
+        // skip the pages whose keys and values are out of range
+        const ZoneMap::Zone* zone = rf.getZone(rid.pid);
+        if (zone != NULL && !zoneMeets(*zone, cond, keyValues)) continue;
+        if ((rc = rf.readPage(rid.pid, page)) < 0) break;
         
-        // move to the next tuple
-        ++rid;
+        // a FORMAT_PAX or FORMAT_DICT page answers a query on the keys alone
+        // without touching the values
+        const int* keys = page.getKeys();
+        if (keyOnly && keys != NULL) {
+            bool match[RecordFile::DICT_RECORDS_PER_PAGE];  // the most records a page holds
+            int  n = page.getRecordCount();
+            count += filterKeys(cond, keyValues, keys, n, match);
+            for (int i = 0; attr == 1 && i < n; i++) {
+                if (match[i]) fprintf(stdout, "%d\n", keys[i]);
+            }
+            continue;
+        }
+        
+        // a FORMAT_DICT page holds the code of each value. every condition
+        // is checked on the keys and the ranks of the codes, and a value
+        // is looked up only to be printed
+        const int* codes = page.getCodes();
+        if (codes != NULL) {
+            const int* ranks = dict->getRanks();
+            for (int i = 0; i < page.getRecordCount(); i++) {
+                if (codes[i] < 0 || codes[i] >= dict->size()) {
+                    fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                    rc = RC_INVALID_FILE_FORMAT;
+                    goto exit_select;
+                }
+                bool ok = rankMeets(cond, rankLo, rankHi, ranks[codes[i]]);
+                for (unsigned c = 0; c < cond.size() && ok; c++) {
+                    if (cond[c].attr == 1) ok = keyMeets(cond[c].comp, keys[i], keyValues[c]);
+                }
+                if (ok) {
+                    count++;
+                    printTuple(attr, keys[i], dict->getValue(codes[i]));
+                }
+            }
+            continue;
+        }
+        
+        for (rid.sid = 0; rid.sid < page.getRecordCount(); rid.sid++) {
+            // read the tuple
+            if ((rc = page.read(rid.sid, key, value)) < 0) {
+                fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+                goto exit_select;
+            }
+            
+            // check the conditions on the tuple
+            // the condition is met for the tuple.
+            // increase matching tuple counter
+            if (meetCond(cond, key, value))
+            {
+                count++;
+                printTuple(attr, key, value);
+            }
+        }
+    }
+    // the scan ends at the first page after the last page of tuples
+    if (rc != RC_INVALID_PID) {
+        fprintf(stderr, "Error: while reading a tuple from table %s\n", table.c_str());
+        goto exit_select;
     }
     // print matching tuple count if "select count(*)"
     if (attr == 4) {
@@ -231,11 +560,61 @@ direct_scan:
     
     // close the table file and return
 exit_select:
+    page.release();
     rf.close();
     return rc;
 }
 
-bool SqlEngine::meetCond(const std::vector<SelCond>& cond, const int key, const string& value)
+/*
+ * Print a string as a JSON string literal.
+ * @param out[IN] the stream to print to
+ * @param s[IN] the string
+ */
+static void printJsonString(FILE* out, const string& s)
+{
+    fputc('"', out);
+    for (unsigned i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+RC SqlEngine::showStats(bool json)
+{
+    map<string, IoStats> files = IoStats::files();
+    map<string, IoStats>::const_iterator it;
+    
+    if (json) {
+        fprintf(stdout, "{\"total\": ");
+        IoStats::total().printJson(stdout);
+        fprintf(stdout, ", \"files\": {");
+        for (it = files.begin(); it != files.end(); ++it) {
+            if (it != files.begin()) fprintf(stdout, ", ");
+            printJsonString(stdout, it->first);
+            fprintf(stdout, ": ");
+            it->second.printJson(stdout);
+        }
+        fprintf(stdout, "}, \"last_query\": ");
+        queryStats.printJson(stdout);
+        fprintf(stdout, "}\n");
+        return 0;
+    }
+    
+    fprintf(stdout, "total:\n");
+    IoStats::total().print(stdout, "  ");
+    for (it = files.begin(); it != files.end(); ++it) {
+        fprintf(stdout, "file %s:\n", it->first.c_str());
+        it->second.print(stdout, "  ");
+    }
+    fprintf(stdout, "last query:\n");
+    queryStats.print(stdout, "  ");
+    return 0;
+}
+
+bool SqlEngine::meetCond(const std::vector<SelCond>& cond, const int key, string_view value)
 {
     int diff = 0;
     // check the conditions on the tuple
@@ -246,7 +625,7 @@ bool SqlEngine::meetCond(const std::vector<SelCond>& cond, const int key, const
                 diff = key - atoi(cond[i].value);
                 break;
             case 2:
-                diff = strcmp(value.c_str(), cond[i].value);
+                diff = value.compare(cond[i].value);
                 break;
         }
         
@@ -275,7 +654,7 @@ bool SqlEngine::meetCond(const std::vector<SelCond>& cond, const int key, const
     return true;
 }
 
-RC SqlEngine::load(const string& table, const string& loadfile, bool index)
+RC SqlEngine::load(const string& table, const string& loadfile, bool index, bool valueIndex)
 {
     /* your code here */
     RC rc;
@@ -287,15 +666,18 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
         return rc;
     }
     string line;
-    int key;
     string value;
+    vector<int> keys(LOAD_BATCH);
+    vector<string> values(LOAD_BATCH);
+    vector<RecordId> rids;
+    vector<IndexEntry> entries;
+    vector<StringIndexEntry> valueEntries;
     RecordFile outfile;
     if ((rc = outfile.open(table+".tbl", 'w')) < 0)
     {
         fprintf(stderr, "Error: Cannot create the output file %s.tbl\n", table.c_str());
         return rc;
     }
-    RecordId rid;
     
     BTreeIndex tblidx;
     if (index)
@@ -306,26 +688,89 @@ RC SqlEngine::load(const string& table, const string& loadfile, bool index)
             return rc;
         }
     }
-    int count = 0;
-    while (getline(infile, line))
+    BTreeStringIndex validx;
+    if (valueIndex)
+    {
+        if ((rc = validx.open(table+".vdx", 'w'))<0)
+        {
+            fprintf(stderr, "Error: Cannot create the index file %s.vdx\n", table.c_str());
+            return rc;
+        }
+    }
+    // the index entries are added once LOAD_INDEX_BYTES of them are kept,
+    // and after the last batch. the first build() builds an empty index
+    // bottom up, the later ones insert the entries one at a time
+    size_t entryBytes = 0;
+    auto buildIndexes = [&]() -> RC
     {
-        count++;
-        parseLoadLine(line, key, value);
-        outfile.append(key, value, rid);
-        if (index && ((rc = tblidx.insert(key, rid))<0))
+        RC rc;
+        if (index && (rc = tblidx.build(entries))<0)
         {
-            fprintf(stderr, "Error: Cannot insert the tuple with key = %d\n", key);
+            fprintf(stderr, "Error: Cannot build the index file %s.idx\n", table.c_str());
             return rc;
         }
+        if (valueIndex && (rc = validx.build(valueEntries))<0)
+        {
+            fprintf(stderr, "Error: Cannot build the index file %s.vdx\n", table.c_str());
+            return rc;
+        }
+        entries.clear();
+        valueEntries.clear();
+        entryBytes = 0;
+        return 0;
+    };
+    
+    // the tuples are stored a batch at a time, so that the table file
+    // is written a run of pages at a time instead of once per tuple
+    int n = 0;
+    bool more = true;
+    while (more)
+    {
+        more = (bool)getline(infile, line);
+        if (more)
+        {
+            parseLoadLine(line, keys[n], value);
+            values[n++] = value;
+            if (n < LOAD_BATCH) continue;
+        }
+        if (n == 0) break;
         
+        if ((rc = outfile.appendBatch(keys.data(), values.data(), n, rids)) < 0)
+        {
+            fprintf(stderr, "Error: Cannot write to the output file %s.tbl\n", table.c_str());
+            return rc;
+        }
+        for (int i = 0; index && i < n; i++)
+        {
+            IndexEntry entry = { keys[i], rids[i] };
+            entries.push_back(entry);
+            entryBytes += sizeof(IndexEntry);
+        }
+        // the values are indexed as the table keeps them: FORMAT_FIXED and
+        // FORMAT_PAX cut the long ones
+        bool cutValues = (outfile.getFormat() == RecordFile::FORMAT_FIXED || outfile.getFormat() == RecordFile::FORMAT_PAX);
+        for (int i = 0; valueIndex && i < n; i++)
+        {
+            StringIndexEntry entry = { cutValues ? values[i].substr(0, RecordFile::MAX_VALUE_LENGTH - 1) : values[i], rids[i] };
+            valueEntries.push_back(entry);
+            entryBytes += sizeof(StringIndexEntry) + entry.key.size();
+        }
+        n = 0;
+        if (entryBytes >= LOAD_INDEX_BYTES && (rc = buildIndexes()) < 0) return rc;
     }
     outfile.close();
     infile.close();
+    if ((rc = buildIndexes()) < 0) return rc;
     if (index && (rc = tblidx.close())<0)
     {
         fprintf(stderr, "Error: Cannot close the index file");
         return rc;
     }
+    if (valueIndex && (rc = validx.close())<0)
+    {
+        fprintf(stderr, "Error: Cannot close the index file");
+        return rc;
+    }
     return 0;
 }
 
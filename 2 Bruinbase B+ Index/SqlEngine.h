@@ -10,10 +10,13 @@
 #ifndef SQLENGINE_H
 #define SQLENGINE_H
 
+#include <string_view>
 #include <vector>
 #include "Bruinbase.h"
 #include "RecordFile.h"
 #include "BTreeIndex.h"
+#include "BTreeStringIndex.h"
+#include "IoStats.h"
 #include <climits>
 #include <cstring>
 using namespace std;
@@ -58,10 +61,11 @@ public:
      * load a table from a load file.
      * @param table[IN] the table name in the LOAD command
      * @param loadfile[IN] the file name of the load file
-     * @param index[IN] true if "WITH INDEX" option was specified
+     * @param index[IN] true if "WITH INDEX" or "WITH INDEX ON key" option was specified
+     * @param valueIndex[IN] true if "WITH INDEX ON value" option was specified
      * @return error code. 0 if no error
      */
-    static RC load(const std::string& table, const std::string& loadfile, bool index);
+    static RC load(const std::string& table, const std::string& loadfile, bool index, bool valueIndex = false);
     
     /**
      * parse a line from the load file into the (key, value) pair.
@@ -72,8 +76,24 @@ public:
      */
     static RC parseLoadLine(const std::string& line, int& key, std::string& value);
     
+    /**
+     * print the I/O stats of the process, of every file opened so far
+     * and of the last SELECT.
+     * @param json[IN] true to print a single JSON object instead of text
+     * @return error code. 0 if no error
+     */
+    static RC showStats(bool json);
+    
+    /**
+     * @return the I/O stats of the last SELECT
+     */
+    static const IoStats& getQueryStats() { return queryStats; }
+    
 private:
-    static bool meetCond(const std::vector<SelCond>& conds, const int key, const std::string& value);
+    static IoStats queryStats;  // the I/O stats of the last SELECT
+    
+
+    static bool meetCond(const std::vector<SelCond>& conds, const int key, std::string_view value);
 };
 
 #endif /* SQLENGINE_H */
@@ -17,15 +17,27 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 {
   struct tms tmsbuf;
   clock_t btime, etime;
-  int     bpagecnt, epagecnt;
 
   btime = times(&tmsbuf);
-  bpagecnt = PageFile::getPageReadCount();
   SqlEngine::select(attr, table, conds);
   etime = times(&tmsbuf);
-  epagecnt = PageFile::getPageReadCount();
 
-  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %d pages\n", ((float)(etime - btime))/sysconf(_SC_CLK_TCK), epagecnt - bpagecnt);
+  const IoStats& stats = SqlEngine::getQueryStats();
+  fprintf(stderr, "  -- %.3f seconds to run the select command. Read %llu pages (%llu logical reads, %llu cache hits)\n",
+	  ((float)(etime - btime))/sysconf(_SC_CLK_TCK), stats.get(IoStats::PHYSICAL_READS),
+	  stats.get(IoStats::LOGICAL_READS), stats.get(IoStats::CACHE_HITS));
+}
+
+// commands without a keyword of their own are spelled with identifiers
+static void runShow(const char* what, const char* format)
+{
+  if (strcasecmp(what, "stats") != 0) {
+    sqlerror("unknown SHOW command. try SHOW STATS");
+  } else if (format == NULL || strcasecmp(format, "json") == 0) {
+    SqlEngine::showStats(format != NULL);
+  } else {
+    sqlerror("unknown SHOW STATS format. try SHOW STATS JSON");
+  }
 }
 
 %}
@@ -42,7 +54,7 @@ static void runSelect(int attr, const char* table, const std::vector<SelCond>& c
 %token <string> INTEGER STRING ID
 %token EQUAL NEQUAL LESS LESSEQUAL GREATER GREATEREQUAL 
 
-%type <integer> attributes attribute comparator
+%type <integer> attributes attribute comparator index_attributes
 %type <string> table value
 %type <cond> condition
 %type <conds> conditions
@@ -56,6 +68,7 @@ commands:
 command:
         load_command { fprintf(stdout, "Bruinbase> "); }
 	| select_command { fprintf(stdout, "Bruinbase> "); }
+	| show_command { fprintf(stdout, "Bruinbase> "); }
 	| quit_command
 	| error LF { fprintf(stdout, "Bruinbase> "); }
 	| LF { fprintf(stdout, "Bruinbase> "); }
@@ -65,6 +78,22 @@ quit_command:
 	QUIT { return 0; }
 	;
 
+show_command:
+	ID ID LF {
+	  if (strcasecmp($1, "show") == 0) runShow($2, NULL);
+	  else sqlerror("syntax error");
+	  free($1);
+	  free($2);
+	}
+	| ID ID ID LF {
+	  if (strcasecmp($1, "show") == 0) runShow($2, $3);
+	  else sqlerror("syntax error");
+	  free($1);
+	  free($2);
+	  free($3);
+	}
+	;
+
 load_command:
 	LOAD table FROM STRING LF { 
 	  SqlEngine::load(std::string($2), std::string($4), false); 
@@ -76,6 +105,18 @@ load_command:
 	  free($2);
 	  free($4);
 	}
+	| LOAD table FROM STRING WITH INDEX ID index_attributes LF { 
+	  if (strcasecmp($7, "on") == 0) SqlEngine::load(std::string($2), std::string($4), ($8 & 1) != 0, ($8 & 2) != 0); 
+	  else sqlerror("syntax error");
+	  free($2);
+	  free($4);
+	  free($7);
+	}
+	;
+
+index_attributes:
+	attribute { $$ = $1; }
+	| index_attributes COMMA attribute { $$ = $1 | $3; }
 	;
 
 select_command:
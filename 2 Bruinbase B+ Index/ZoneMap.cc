@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#include "ZoneMap.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+// the zones are stored one after another, by page id
+static const int ZONES_PER_PAGE = PageFile::PAGE_SIZE / sizeof(ZoneMap::Zone);
+
+// a zone that is not known
+static ZoneMap::Zone unknownZone()
+{
+  ZoneMap::Zone zone;
+  memset(&zone, 0, sizeof(zone));
+  zone.count = -1;
+  return zone;
+}
+
+// the value kept in a zone, without its padding
+static string_view prefix(const char* value)
+{
+  return string_view(value, strnlen(value, ZoneMap::PREFIX_LENGTH));
+}
+
+ZoneMap::ZoneMap()
+{
+  dirty = SIZE_MAX;
+  writable = false;
+  opened = false;
+}
+
+RC ZoneMap::open(const string& filename, char mode)
+{
+  RC   rc;
+  char page[PageFile::PAGE_SIZE];
+
+  zones.clear();
+  dirty = SIZE_MAX;
+  writable = (mode == 'w' || mode == 'W');
+
+  // without a file no page is skipped, which is slower but not wrong
+  if ((rc = pf.open(filename, mode)) < 0) return writable ? rc : 0;
+  opened = true;
+
+  // the zones of a writer that did not close the map may not match the
+  // table. they are dropped, and rewritten by the next writer
+  if (pf.getFormat() == ZONES_CLEAN) {
+    for (PageId pid = 0; pid < pf.endPid(); pid++) {
+      if ((rc = pf.read(pid, page)) < 0) {
+        close();
+        return rc;
+      }
+      for (int i = 0; i < ZONES_PER_PAGE; i++) {
+        Zone zone;
+        memcpy(&zone, page + i * sizeof(Zone), sizeof(Zone));
+        zones.push_back(zone);
+      }
+    }
+    while (!zones.empty() && zones.back().count < 0) zones.pop_back();
+  } else if (writable) {
+    dirty = 0;
+  }
+
+  if (writable && (rc = pf.setFormat(ZONES_WRITING)) < 0) {
+    close();
+    return rc;
+  }
+  return 0;
+}
+
+RC ZoneMap::close()
+{
+  RC rc = 0;
+
+  if (!opened) return 0;
+
+  if (writable && dirty != SIZE_MAX) {
+    // rewrite the pages from the first changed zone to the end of the
+    // file, which may hold zones that were forgotten since
+    PageId first = dirty / ZONES_PER_PAGE;
+    PageId end = std::max((PageId)((zones.size() + ZONES_PER_PAGE - 1) / ZONES_PER_PAGE), pf.endPid());
+    if (end > first) {
+      vector<char> buffer((size_t)(end - first) * PageFile::PAGE_SIZE);
+      Zone unknown = unknownZone();
+      for (size_t i = 0; i < (size_t)(end - first) * ZONES_PER_PAGE; i++) {
+        size_t n = (size_t)first * ZONES_PER_PAGE + i;
+        const Zone* zone = (n < zones.size()) ? &zones[n] : &unknown;
+        size_t offset = (i / ZONES_PER_PAGE) * PageFile::PAGE_SIZE + (i % ZONES_PER_PAGE) * sizeof(Zone);
+        memcpy(&buffer[offset], zone, sizeof(Zone));
+      }
+      rc = pf.writeBatch(first, buffer.data(), end - first);
+    }
+  }
+  if (writable && rc == 0) rc = pf.setFormat(ZONES_CLEAN);
+
+  RC rc2 = pf.close();
+  zones.clear();
+  dirty = SIZE_MAX;
+  opened = false;
+  return (rc < 0) ? rc : rc2;
+}
+
+const ZoneMap::Zone* ZoneMap::find(PageId pid) const
+{
+  if (pid < 0 || (size_t)pid >= zones.size() || zones[pid].count < 0) return NULL;
+  return &zones[pid];
+}
+
+void ZoneMap::clear(PageId pid)
+{
+  if (pid < 0) return;
+  if ((size_t)pid >= zones.size()) zones.resize(pid + 1, unknownZone());
+  memset(&zones[pid], 0, sizeof(Zone));
+  dirty = std::min(dirty, (size_t)pid);
+}
+
+void ZoneMap::add(PageId pid, int key, string_view value)
+{
+  if (pid < 0 || (size_t)pid >= zones.size() || zones[pid].count < 0) return;
+
+  Zone& zone = zones[pid];
+  char  cut[PREFIX_LENGTH];
+
+  memset(cut, 0, PREFIX_LENGTH);
+  memcpy(cut, value.data(), std::min(value.size(), (size_t)PREFIX_LENGTH));
+
+  // the first record sets the range
+  if (zone.count == 0) {
+    zone.minKey = zone.maxKey = key;
+    memcpy(zone.minValue, cut, PREFIX_LENGTH);
+    memcpy(zone.maxValue, cut, PREFIX_LENGTH);
+  } else {
+    zone.minKey = std::min(zone.minKey, key);
+    zone.maxKey = std::max(zone.maxKey, key);
+    if (prefix(cut) < prefix(zone.minValue)) memcpy(zone.minValue, cut, PREFIX_LENGTH);
+    if (prefix(cut) > prefix(zone.maxValue)) memcpy(zone.maxValue, cut, PREFIX_LENGTH);
+  }
+  zone.count++;
+  dirty = std::min(dirty, (size_t)pid);
+}
+
+void ZoneMap::truncate(PageId pid)
+{
+  if (pid < 0) pid = 0;
+  if ((size_t)pid >= zones.size()) return;
+  zones.resize(pid);
+  dirty = std::min(dirty, (size_t)pid);
+}
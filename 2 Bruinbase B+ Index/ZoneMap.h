@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "PageFile.h"
+
+/**
+ * the range of the keys and values of each page of a table, kept in a
+ * small file next to the table. a scan can skip the pages whose range
+ * rules out every record.
+ *
+ * the zones reach the file when the map is closed. while the map is
+ * open for writing, the file is marked as such, so the zones of a
+ * writer that never closed its map are not trusted by the next open().
+ */
+class ZoneMap {
+ public:
+  // # bytes of a value kept in a zone
+  static const int PREFIX_LENGTH = 8;
+
+  /**
+   * the range of the records of a page.
+   * the values are bounded by their first PREFIX_LENGTH bytes: every
+   * value is at least minValue, and the first bytes of every value are
+   * at most maxValue.
+   */
+  struct Zone {
+    int  count;   // # records of the page. -1 if the zone is not known
+    int  minKey;  // the smallest key
+    int  maxKey;  // the largest key
+    char minValue[PREFIX_LENGTH];  // the smallest value, cut and NUL padded
+    char maxValue[PREFIX_LENGTH];  // the largest value, cut and NUL padded
+  };
+
+  ZoneMap();
+
+  /**
+   * open a zone map file and read its zones into memory.
+   * when opened in 'w' mode, if the file does not exist, it is created.
+   * when opened in 'r' mode, a file that does not exist is not an error:
+   * the map is empty and every page has to be read.
+   * @param filename[IN] the name of the file to open
+   * @param mode[IN] 'r' for read, 'w' for write
+   * @return error code. 0 if no error
+   */
+  RC open(const std::string& filename, char mode);
+
+  /**
+   * write the zones out if the map was opened for writing, and close it.
+   * @return error code. 0 if no error
+   */
+  RC close();
+
+  /**
+   * @param pid[IN] the page
+   * @return the zone of the page. NULL if it is not known
+   */
+  const Zone* find(PageId pid) const;
+
+  /**
+   * start the zone of a new page, which holds no records yet.
+   * @param pid[IN] the page
+   */
+  void clear(PageId pid);
+
+  /**
+   * widen the zone of a page by a record added to it. a page whose zone
+   * is not known stays so.
+   * @param pid[IN] the page
+   * @param key[IN] the key of the record
+   * @param value[IN] the value of the record
+   */
+  void add(PageId pid, int key, std::string_view value);
+
+  /**
+   * forget the zones of the pages from a page on, e.g. the pages that
+   * are not in the table.
+   * @param pid[IN] the first page to forget
+   */
+  void truncate(PageId pid);
+
+ private:
+  // the state kept in the format number of the file
+  static const int ZONES_CLEAN = 0;    // the zones match the table
+  static const int ZONES_WRITING = 1;  // a writer has the map open
+
+  PageFile pf;
+  std::vector<Zone> zones;  // by page id
+  size_t dirty;             // the first zone not written out yet
+  bool   writable;          // true if opened in 'w' mode
+  bool   opened;            // false if there is no file
+};
+
+#endif // ZONEMAP_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Micro-benchmark of the key search in a full B+tree node, run by
+ * "make bench". It times BTLeafNode::locate() and
+ * BTNonLeafNode::locateChildPtr() in both node layouts against a
+ * linear scan over interleaved (key, pointer) pairs, the way the nodes
+ * were searched before searchKeys().
+ */
+#include "Bruinbase.h"
+#include "BTreeNode.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+using namespace std;
+
+static const int LOOKUPS = 2000000;
+
+/* the time since start in ns per lookup */
+static double perLookup(chrono::steady_clock::time_point start)
+{
+    chrono::duration<double, nano> t = chrono::steady_clock::now() - start;
+    return t.count() / LOOKUPS;
+}
+
+int main()
+{
+    vector<int> probes(LOOKUPS);
+    long sum = 0;
+
+    srand(1);
+    printf("page size %d, %d lookups, ns per lookup\n", PageFile::PAGE_SIZE, LOOKUPS);
+    printf("%-8s %5s %12s %8s %8s\n", "node", "keys", "linear scan", "interl.", "soa");
+
+    /* leaf nodes: the keys 1, 3, 5, ... are looked up with hits and misses */
+    {
+        int n = BTLeafNode::MAX_KEYS;
+        for (int i = 0; i < LOOKUPS; i++) probes[i] = rand() % (2 * n + 2);
+
+        struct { int key; RecordId rid; } pairs[BTLeafNode::MAX_KEYS];
+        for (int i = 0; i < n; i++) pairs[i].key = 2 * i + 1;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i = 0; i < LOOKUPS; i++) {
+            int eid = 0;
+            while (eid < n && pairs[eid].key < probes[i]) eid++;
+            sum += eid;
+        }
+        double linear = perLookup(start);
+
+        double t[2];
+        for (int format = BT_FORMAT_INTERLEAVED; format <= BT_FORMAT_SOA; format++) {
+            BTLeafNode leaf(format);
+            RecordId rid = { 0, 0 };
+            for (int i = 0; i < n; i++) leaf.append(2 * i + 1, rid);
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < LOOKUPS; i++) {
+                int eid;
+                leaf.locate(probes[i], eid);
+                sum += eid;
+            }
+            t[format] = perLookup(start);
+        }
+        printf("%-8s %5d %12.1f %8.1f %8.1f\n", "leaf", n, linear, t[0], t[1]);
+    }
+
+    /* non-leaf nodes: the child pointer of each key is the key */
+    {
+        int n = BTNonLeafNode::MAX_KEYS;
+        for (int i = 0; i < LOOKUPS; i++) probes[i] = rand() % (2 * n + 2);
+
+        struct { PageId pid; int key; } pairs[BTNonLeafNode::MAX_KEYS];
+        for (int i = 0; i < n; i++) pairs[i].key = 2 * i + 1;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int i = 0; i < LOOKUPS; i++) {
+            int eid = 0;
+            while (eid < n && pairs[eid].key <= probes[i]) eid++;
+            sum += eid;
+        }
+        double linear = perLookup(start);
+
+        double t[2];
+        for (int format = BT_FORMAT_INTERLEAVED; format <= BT_FORMAT_SOA; format++) {
+            BTNonLeafNode node(format);
+            node.initializeRoot(0, 1, 1);
+            for (int i = 1; i < n; i++) node.append(2 * i + 1, 2 * i + 1);
+            start = chrono::steady_clock::now();
+            for (int i = 0; i < LOOKUPS; i++) {
+                PageId pid;
+                node.locateChildPtr(probes[i], pid);
+                sum += pid;
+            }
+            t[format] = perLookup(start);
+        }
+        printf("%-8s %5d %12.1f %8.1f %8.1f\n", "nonleaf", n, linear, t[0], t[1]);
+    }
+
+    /* keeps the loops from being optimized away */
+    return (sum == 42) ? 1 : 0;
+}
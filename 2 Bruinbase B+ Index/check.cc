@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2008 by The Regents of the University of California
+ * Redistribution of this file is permitted under the terms of the GNU
+ * Public License (GPL).
+ */
+
+/*
+ * Regression checks of the storage layer, run by "make check".
+ * Each check prints one line and the program exits with 1 if any fails.
+ */
+#include "Bruinbase.h"
+#include "RecordFile.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+static const char* CHECK_FILE = "check.tbl";
+static const char* CHECK_ZONES = "check.zmp";
+
+/*
+ * @return the value of the i'th record: a value longer than a page,
+ *         stored in overflow pages, every 50 records. the last record
+ *         of each load() batch is one
+ */
+static string valueOf(int i)
+{
+    if (i % 50 == 49) return string(20000, 'A' + i % 26);
+    return "value " + to_string(i);
+}
+
+/*
+ * Read the file from the first record on and compare the records with
+ * the keys 0 to n - 1 and their values.
+ * @return true if the file holds exactly those records, in that order
+ */
+static bool verify(RecordFile& rf, int n)
+{
+    RecordId rid;
+    int key, i = 0;
+    string value;
+
+    if (rf.first(rid) < 0) return false;
+    for (; rid < rf.endRid(); i++) {
+        if (rf.read(rid, key, value) < 0 || key != i || value != valueOf(i)) return false;
+        if (rf.next(rid) < 0) return false;
+    }
+    return i == n;
+}
+
+/*
+ * Load records n to n + count - 1 with append(), or with appendBatch()
+ * 500 records at a time like SqlEngine::load().
+ * @return error code. 0 if no error
+ */
+static RC load(RecordFile& rf, int n, int count, bool batch)
+{
+    vector<int> keys;
+    vector<string> values;
+    vector<RecordId> rids;
+    RecordId rid;
+    RC rc;
+
+    for (int i = n; i < n + count; i++) {
+        if (!batch) {
+            if ((rc = rf.append(i, valueOf(i), rid)) < 0) return rc;
+            continue;
+        }
+        keys.push_back(i);
+        values.push_back(valueOf(i));
+        if (keys.size() == 500 || i + 1 == n + count) {
+            if ((rc = rf.appendBatch(keys.data(), values.data(), keys.size(), rids)) < 0) return rc;
+            keys.clear();
+            values.clear();
+        }
+    }
+    return 0;
+}
+
+/*
+ * Add long values to a FORMAT_SLOTTED file in two loads, the second one
+ * after the file is opened again, and read every record back. In a
+ * compressed file the overflow pages of a long value close the extent
+ * of the last page of records, which can not be written any more.
+ * @return true if every record is read back
+ */
+static bool checkOverflowThenAppend(bool compressed, bool batch)
+{
+    RecordFile rf;
+    bool ok;
+
+    unlink(CHECK_FILE);
+    unlink(CHECK_ZONES);
+    RecordFile::setDefaultFormat(RecordFile::FORMAT_SLOTTED);
+    RecordFile::setDefaultCompression(compressed);
+
+    ok = rf.open(CHECK_FILE, 'w') == 0 && load(rf, 0, 3000, batch) == 0 && verify(rf, 3000);
+    ok = ok && rf.close() == 0;
+    ok = ok && rf.open(CHECK_FILE, 'w') == 0 && load(rf, 3000, 3000, batch) == 0;
+    ok = ok && rf.close() == 0;
+    ok = ok && rf.open(CHECK_FILE, 'r') == 0 && verify(rf, 6000);
+    rf.close();
+    unlink(CHECK_FILE);
+    unlink(CHECK_ZONES);
+
+    printf("%s: overflow then append, %s, %s\n", ok ? "ok" : "FAILED",
+           compressed ? "compressed" : "not compressed", batch ? "appendBatch" : "append");
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    for (int compressed = 0; compressed < 2; compressed++) {
+        for (int batch = 0; batch < 2; batch++) {
+            ok = checkOverflowThenAppend(compressed, batch) && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -2,11 +2,87 @@
 #include "SqlEngine.h"
 #include "BTreeNode.h"
 #include "BTreeIndex.h"
+#include "IoEngine.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <unistd.h>
 using namespace std;
-int main(int argc, const char * argv[])
+int main(int argc, char * const argv[])
 {
+    int c;
+    RC  rc;
+    // -m <megabytes>: size of the buffer pool
+    // -t: write pages through to the disk instead of caching them dirty
+    // -n: read files through the buffer pool instead of memory-mapping them
+    // -a <pages>: # of pages read ahead of a sequential scan. 0 turns it off
+    // -i <engine>: background I/O through "uring", "threads" or "sync"
+    // -d: bypass the kernel page cache with direct I/O
+    // -p <policy>: buffer pool replacement by "lru", "clock", "2q" or "lru2"
+    // -f <format>: record format of new tables, "fixed", "slotted", "pax" or "dict"
+    // -c: compress the pages of new tables
+    // -b <percent>: how full LOAD ... WITH INDEX packs the index nodes
+    while ((c = getopt(argc, argv, "m:tna:i:dp:f:cb:")) != -1) {
+        switch (c) {
+            case 'm':
+                if (PageFile::setCacheSize((size_t)atol(optarg) * 1024 * 1024) < 0) {
+                    fprintf(stderr, "Error: cannot allocate a %s MB buffer pool\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                PageFile::setWriteBack(false);
+                break;
+            case 'n':
+                PageFile::setMmap(false);
+                break;
+            case 'a':
+                PageFile::setReadAhead(atoi(optarg));
+                break;
+            case 'd':
+                PageFile::setDirectIo(true);
+                break;
+            case 'i':
+                if (strcmp(optarg, "uring") == 0) rc = IoEngine::setKind(IoEngine::IO_URING);
+                else if (strcmp(optarg, "threads") == 0) rc = IoEngine::setKind(IoEngine::IO_THREADS);
+                else if (strcmp(optarg, "sync") == 0) rc = IoEngine::setKind(IoEngine::IO_SYNC);
+                else rc = RC_NOT_SUPPORTED;
+                if (rc < 0) {
+                    fprintf(stderr, "Error: I/O engine %s is not available\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (PageFile::setCachePolicy(optarg) < 0) {
+                    fprintf(stderr, "Error: unknown replacement policy %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "fixed") == 0) RecordFile::setDefaultFormat(RecordFile::FORMAT_FIXED);
+                else if (strcmp(optarg, "slotted") == 0) RecordFile::setDefaultFormat(RecordFile::FORMAT_SLOTTED);
+                else if (strcmp(optarg, "pax") == 0) RecordFile::setDefaultFormat(RecordFile::FORMAT_PAX);
+                else if (strcmp(optarg, "dict") == 0) RecordFile::setDefaultFormat(RecordFile::FORMAT_DICT);
+                else {
+                    fprintf(stderr, "Error: unknown record format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                RecordFile::setDefaultCompression(true);
+                break;
+            case 'b':
+                if (BTreeIndex::setFillFactor(atof(optarg) / 100) < 0) {
+                    fprintf(stderr, "Error: the fill factor must be in (0, 100]\n");
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m megabytes] [-t] [-n] [-a pages] [-i uring|threads|sync] [-d] [-p lru|clock|2q|lru2] [-f fixed|slotted|pax|dict] [-c] [-b percent]\n", argv[0]);
+                return 1;
+        }
+    }
     SqlEngine::run(stdin);
     return 0;
 }